@@ -20,6 +20,7 @@
 #include "defs.h"
 #include "fractal-render.h"
 #include "render-png.h"
+#include "thread-pool.h"
 
 
 #define NETWORK_DELIM " \t\r\n"
@@ -85,8 +86,8 @@ struct anim_state {
 };
 
 
-static gpointer thread_func (gpointer data);
-static gpointer network_thread (gpointer data);
+static void thread_func (struct thread_pool_job *job, unsigned worker, void *data, const int *args);
+static void network_thread (struct thread_pool_job *job, unsigned worker, void *data, const int *args);
 static struct work_list_item *generate_work_list (frame_func_t frame_func, void *data);
 static void free_work_list (struct work_list_item *list);
 static void free_work_list_item (struct work_list_item *item);
@@ -154,7 +155,11 @@ anim_render (frame_func_t frame_func, void *data)
 		return;
 
 	g_thread_init (NULL);
-	GThread *threads[zoom_threads], *net_thread = NULL;
+	/*
+	 * The local render threads and the network thread are taken from the
+	 * process-wide thread pool, one worker for each.
+	 */
+	struct thread_pool_job *render_job, *net_job = NULL;
 	state->mutex = g_mutex_new ();
 	if (index_file != NULL) {
 		state->client_index = malloc (frame_count * sizeof (*state->client_index));
@@ -168,18 +173,21 @@ anim_render (frame_func_t frame_func, void *data)
 		}
 		state->term_pipe_r = pipefd[0];
 		state->term_pipe_w = pipefd[1];
-		net_thread = g_thread_create (network_thread, state, TRUE, NULL);
+		net_job = thread_pool_job_new (network_thread, state, 1);
+		thread_pool_job_add (net_job, 0, 0, 0, 0);
+		thread_pool_job_start (net_job);
 	} else {
 		state->term_pipe_r = -1;
 		state->term_pipe_w = -1;
 	}
 	int i;
+	render_job = thread_pool_job_new (thread_func, state, zoom_threads);
 	for (i = 0; i < zoom_threads; i++)
-		threads[i] = g_thread_create (thread_func, state, TRUE, NULL);
-	if (network_port != NULL)
-		g_thread_join (net_thread);
-	for (i = 0; i < zoom_threads; i++)
-		g_thread_join (threads[i]);
+		thread_pool_job_add (render_job, 0, 0, 0, 0);
+	thread_pool_job_start (render_job);
+	if (net_job != NULL)
+		thread_pool_job_wait (net_job);
+	thread_pool_job_wait (render_job);
 	if (index_file != NULL && state->client_index != NULL) {
 		FILE *ixfile = fopen (index_file, "w");
 		if (ixfile != NULL) {
@@ -194,8 +202,8 @@ anim_render (frame_func_t frame_func, void *data)
 }
 
 
-static gpointer
-thread_func (gpointer data)
+static void
+thread_func (struct thread_pool_job *job, unsigned worker, void *data, const int *args)
 {
 	struct anim_state *state = (struct anim_state *) data;
 	while (TRUE) {
@@ -226,13 +234,14 @@ thread_func (gpointer data)
 		 * but it returns the CPU time usage of the whole process intead. Bummer!
 		 * Linux also has pthread_getcpuclockid(), but it apparently always fails.
 		 */
-		unsigned bits;
+		unsigned bits, skipped_iter, j;
+		struct mandel_render_stats stats;
 #if defined (_SC_CLK_TCK) || defined (CLK_TCK)
 		struct tms time_before, time_after;
 		bool clock_ok = zoom_threads == 1 && network_port == NULL && clock_ticks > 0;
 		clock_ok = clock_ok && times (&time_before) != (clock_t) -1;
 #endif
-		render_to_png (&item->md, filename, compression, &bits, img_width, img_height, 1, aa_level);
+		render_to_png (&item->md, filename, compression, &bits, &skipped_iter, &stats, img_width, img_height, 1, aa_level);
 
 #if defined (_SC_CLK_TCK) || defined (CLK_TCK)
 		clock_ok = clock_ok && times (&time_after) != (clock_t) -1;
@@ -246,10 +255,18 @@ thread_func (gpointer data)
 			fprintf (stderr, "[%7.1fs CPU] ", (double) (time_after.tms_utime + time_after.tms_stime - time_before.tms_utime - time_before.tms_stime) / clock_ticks);
 #endif
 		fprintf (stderr, "Frame %u done", item->i);
+		/* The mode most pixels were computed with, glitches may use another one */
+		compute_mode_t mode = COMPUTE_FP;
+		for (j = 0; j < COMPUTE_MAX; j++)
+			if (stats.pixels_by_mode[j] > stats.pixels_by_mode[mode])
+				mode = j;
 		if (bits == 0)
-			fprintf (stderr, ", using FP arithmetic");
+			fprintf (stderr, ", using %s arithmetic", compute_mode_names[mode]);
 		else
-			fprintf (stderr, ", using MP arithmetic (%d bits precision)", bits);
+			fprintf (stderr, ", using %s arithmetic (%d bits precision)", compute_mode_names[mode], bits);
+		if (skipped_iter > 0)
+			fprintf (stderr, ", %u iterations skipped by series approximation", skipped_iter);
+		fprintf (stderr, ", %llu of %llu pixels computed, %llu iterations (%llu saved)", (unsigned long long) stats.pixels_computed, (unsigned long long) (stats.pixels_computed + stats.pixels_inferred), (unsigned long long) stats.iterations, (unsigned long long) stats.saved_iterations);
 		fprintf (stderr, ".\n");
 #ifdef _POSIX_THREAD_SAFE_FUNCTIONS
 		funlockfile (stderr);
@@ -262,7 +279,6 @@ thread_func (gpointer data)
 		}
 		free_work_list_item (item);
 	}
-	return NULL;
 }
 
 
@@ -331,8 +347,8 @@ get_work (struct anim_state *state)
  * only accessing the network-specific parts of the state, as they are
  * really only accessed by this single thread.
  */
-static gpointer
-network_thread (gpointer data)
+static void
+network_thread (struct thread_pool_job *job, unsigned worker, void *data, const int *args)
 {
 	struct anim_state *state = (struct anim_state *) data;
 	struct addrinfo *ai = NULL;
@@ -345,7 +361,7 @@ network_thread (gpointer data)
 	int r = getaddrinfo (NULL, network_port, &aihints, &ai);
 	if (r != 0) {
 		fprintf (stderr, "* ERROR: Cannot resolve network service name: %s\n", gai_strerror (r));
-		return NULL;
+		return;
 	}
 	struct addrinfo *aicur;
 	unsigned listeners = 0;
@@ -360,7 +376,7 @@ network_thread (gpointer data)
 
 	if (listeners == 0) {
 		fprintf (stderr, "* ERROR: Could not create any listening sockets.\n");
-		return NULL;
+		return;
 	}
 
 	fprintf (stderr, "* INFO: Created %u listening sockets.\n", listeners);
@@ -518,8 +534,6 @@ network_thread (gpointer data)
 				disconnect_client (state, i);
 				break;
 		}
-
-	return NULL;
 }
 
 
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include <gmp.h>
+#include <mpfr.h>
+
+#include <glib.h>
+
+#include "defs.h"
+#include "fractal-render.h"
+#include "fp-kernels.h"
+#include "file.h"
+
+
+#define MAX_SIZES 16
+#define MAX_THREAD_COUNTS 16
+/* A point on a tendril which is used at several depths, up to the magnification */
+#define TENDRIL_AREA "area -0.239358750392992414490000297287084670635420071 / 0.871636268791863953664914365755396625241267485 / "
+
+
+struct bench_case {
+	const char *name;
+	const char *coords;
+};
+
+
+struct bench_size {
+	unsigned w, h;
+};
+
+
+static bool parse_command_line (int *argc, char ***argv);
+static bool parse_sizes (const char *s);
+static bool parse_thread_counts (const char *s);
+static bool parse_methods (const char *s);
+static bool bench_load (const char *name, const char *buf, const char *filename, struct mandeldata *md);
+static double area_depth (const struct mandel_area *area);
+static bool bench_run (FILE *f, const char *name, const struct mandeldata *md, render_method_t method, unsigned threads, int mode, const struct bench_size *size);
+static void bench_case (FILE *f, const char *name, const struct mandeldata *md);
+
+
+/*
+ * The built-in corpus. It covers all compute modes (from FP to perturbation
+ * with floatexp), the z^3 and z^4 variants, Julia sets and distance
+ * estimation. The iteration limits are kept low enough for the whole
+ * corpus to run in a few minutes at the default sizes.
+ */
+static const struct bench_case bench_corpus[] = {
+	{"overview",
+		"coord-v1 { type mandelbrot { zpower 2; maxiter 1000; }; "
+		"area -0.5 / 0 / 0.8; representation escape; };"},
+	{"overview-distance",
+		"coord-v1 { type mandelbrot { zpower 2; maxiter 1000; }; "
+		"area -0.5 / 0 / 0.8; representation distance; };"},
+	{"seahorse-2e3",
+		"coord-v1 { type mandelbrot { zpower 2; maxiter 5000; }; "
+		"area -0.743643887037151 / 0.13182590420533 / 2000; representation escape; };"},
+	{"tendril-1e12",
+		"coord-v1 { type mandelbrot { zpower 2; maxiter 5000; }; "
+		TENDRIL_AREA "1e12; representation escape; };"},
+	{"tendril-1e18",
+		"coord-v1 { type mandelbrot { zpower 2; maxiter 5000; }; "
+		TENDRIL_AREA "1e18; representation escape; };"},
+	{"tendril-1e28",
+		"coord-v1 { type mandelbrot { zpower 2; maxiter 5000; }; "
+		TENDRIL_AREA "1e28; representation escape; };"},
+	{"tendril-1e28-distance",
+		"coord-v1 { type mandelbrot { zpower 2; maxiter 5000; }; "
+		TENDRIL_AREA "1e28; representation distance; };"},
+	{"tendril-1e40",
+		"coord-v1 { type mandelbrot { zpower 2; maxiter 5000; }; "
+		TENDRIL_AREA "1.420893e+40; representation escape; };"},
+	{"misiurewicz-1e400",
+		"coord-v1 { type mandelbrot { zpower 2; maxiter 5000; }; "
+		"area 0.0 / 1.0 / 1e400; representation escape; };"},
+	{"z3",
+		"coord-v1 { type mandelbrot { zpower 3; maxiter 3000; }; "
+		"area -0.4 / 0.9 / 10; representation escape; };"},
+	{"z4",
+		"coord-v1 { type mandelbrot { zpower 4; maxiter 3000; }; "
+		"area -0.5 / 0.6 / 4; representation escape; };"},
+	{"z4-1e23",
+		"coord-v1 { type mandelbrot { zpower 4; maxiter 5000; }; "
+		"area -0.6353926671746234193769290505 / 0.5180006441303045544059896043 / 1.121653247e+23; representation escape; };"},
+	{"julia",
+		"coord-v1 { type julia { zpower 2; maxiter 5000; parameter -0.8 / 0.156; }; "
+		"area 0 / 0 / 0.9; representation escape; };"},
+	{"julia-1e20",
+		"coord-v1 { type julia { zpower 2; maxiter 5000; "
+		"parameter -0.1289041118818186338253594537382375946 / 0.9878911075562264274207175294324581466; }; "
+		"area -0.1289041118818186338253594537382375946 / 0.9878911075562264274207175294324581466 / 1e+20; "
+		"representation escape; };"},
+	{NULL, NULL}
+};
+
+/* Short names for the CSV output */
+static const char *const method_keys[] = {"sr", "ms", "bt"};
+static const char *const mode_keys[] = {"fp", "mp", "perturb", "dd", "perturb-fe"};
+
+static gchar *sizes_arg = "320x240,640x480";
+static gchar *threads_arg = "1,2,4";
+static gchar *methods_arg = "sr,ms,bt";
+static gchar *case_arg = NULL;
+static gchar *output_file = NULL;
+static gint repeat = 1;
+static gboolean all_modes = FALSE;
+static gboolean list_cases = FALSE;
+
+static struct bench_size sizes[MAX_SIZES];
+static unsigned size_count;
+static unsigned thread_counts[MAX_THREAD_COUNTS];
+static unsigned thread_count_count;
+static bool methods[RM_MAX];
+
+static GOptionEntry option_entries[] = {
+	{"sizes", 'z', 0, G_OPTION_ARG_STRING, &sizes_arg, "Image sizes (default 320x240,640x480)", "WxH,..."},
+	{"threads", 'T', 0, G_OPTION_ARG_STRING, &threads_arg, "Thread counts (default 1,2,4)", "N,..."},
+	{"methods", 'm', 0, G_OPTION_ARG_STRING, &methods_arg, "Render methods (default sr,ms,bt)", "METHOD,..."},
+	{"case", 'c', 0, G_OPTION_ARG_STRING, &case_arg, "Only run the built-in cases whose name contains STRING", "STRING"},
+	{"all-modes", 'A', 0, G_OPTION_ARG_NONE, &all_modes, "Also run every other compute mode which is precise enough", NULL},
+	{"repeat", 'r', 0, G_OPTION_ARG_INT, &repeat, "Run each test N times and report the fastest", "N"},
+	{"output-file", 'o', 0, G_OPTION_ARG_FILENAME, &output_file, "Output file (default stdout)", "NAME"},
+	{"list", 'l', 0, G_OPTION_ARG_NONE, &list_cases, "List the built-in cases", NULL},
+	{NULL}
+};
+
+
+static bool
+parse_command_line (int *argc, char ***argv)
+{
+	GError *err = NULL;
+	GOptionContext *context = g_option_context_new ("[COORD-FILE...]");
+	g_option_context_add_main_entries (context, option_entries, "fractlab-bench");
+	g_option_context_add_group (context, fp_kernel_get_option_group ());
+	g_option_context_add_group (context, fractal_math_get_option_group ());
+	if (!g_option_context_parse (context, argc, argv, &err)) {
+		fprintf (stderr, "* ERROR: %s\n", err->message);
+		return false;
+	}
+	return parse_sizes (sizes_arg) && parse_thread_counts (threads_arg) && parse_methods (methods_arg);
+}
+
+
+static bool
+parse_sizes (const char *s)
+{
+	size_count = 0;
+	while (*s != '\0') {
+		unsigned w, h;
+		int n;
+		if (size_count >= MAX_SIZES || sscanf (s, "%ux%u%n", &w, &h, &n) != 2 || w == 0 || h == 0) {
+			fprintf (stderr, "* ERROR: Invalid image sizes \"%s\"\n", sizes_arg);
+			return false;
+		}
+		sizes[size_count].w = w;
+		sizes[size_count].h = h;
+		size_count++;
+		s += n;
+		if (*s == ',')
+			s++;
+	}
+	return true;
+}
+
+
+static bool
+parse_thread_counts (const char *s)
+{
+	thread_count_count = 0;
+	while (*s != '\0') {
+		char *end;
+		const long n = strtol (s, &end, 10);
+		if (thread_count_count >= MAX_THREAD_COUNTS || end == s || n < 1 || (*end != ',' && *end != '\0')) {
+			fprintf (stderr, "* ERROR: Invalid thread counts \"%s\"\n", threads_arg);
+			return false;
+		}
+		thread_counts[thread_count_count++] = n;
+		s = *end == ',' ? end + 1 : end;
+	}
+	return true;
+}
+
+
+static bool
+parse_methods (const char *s)
+{
+	memset (methods, 0, sizeof (methods));
+	while (*s != '\0') {
+		const size_t len = strcspn (s, ",");
+		unsigned i;
+		for (i = 0; i < RM_MAX; i++)
+			if (strlen (method_keys[i]) == len && strncmp (s, method_keys[i], len) == 0)
+				break;
+		if (i == RM_MAX) {
+			fprintf (stderr, "* ERROR: Invalid render methods \"%s\", expected sr, ms and/or bt\n", methods_arg);
+			return false;
+		}
+		methods[i] = true;
+		s += len;
+		if (*s == ',')
+			s++;
+	}
+	return true;
+}
+
+
+/* Reads a coordinate file if filename is not NULL, or else parses buf. */
+static bool
+bench_load (const char *name, const char *buf, const char *filename, struct mandeldata *md)
+{
+	char errbuf[256];
+	bool ok;
+	if (filename != NULL)
+		ok = read_mandeldata (filename, md, errbuf, sizeof (errbuf));
+	else
+		ok = sread_mandeldata (buf, md, errbuf, sizeof (errbuf));
+	if (!ok)
+		fprintf (stderr, "* ERROR: %s: cannot read: %s\n", name, errbuf);
+	return ok;
+}
+
+
+/* The decimal logarithm of the magnification, which may be beyond double range. */
+static double
+area_depth (const struct mandel_area *area)
+{
+	long exponent;
+	const double d = mpf_get_d_2exp (&exponent, area->magf);
+	return log10 (d) + exponent * log10 (2.0);
+}
+
+
+/*
+ * Renders one image and writes a line of results. mode is the compute mode
+ * to use, or -1 for the one the renderer chooses. Returns false if the
+ * fractal type doesn't support the mode at this depth.
+ */
+static bool
+bench_run (FILE *f, const char *name, const struct mandeldata *md, render_method_t method, unsigned threads, int mode, const struct bench_size *size)
+{
+	struct mandel_renderer renderer[1];
+	struct mandel_render_stats stats;
+	double best = HUGE_VAL;
+	unsigned bits = 0;
+	compute_mode_t used_mode = COMPUTE_FP;
+	int i;
+
+	memset (&stats, 0, sizeof (stats));
+	for (i = 0; i < MAX (repeat, 1); i++) {
+		GTimer *timer = g_timer_new ();
+		mandel_renderer_init (renderer, md, size->w, size->h, 1);
+		if (mode >= 0 && !mandel_renderer_set_compute_mode (renderer, mode)) {
+			g_timer_destroy (timer);
+			mandel_renderer_clear (renderer);
+			return false;
+		}
+		renderer->render_method = method;
+		renderer->thread_count = threads;
+		mandel_render (renderer);
+		const double t = g_timer_elapsed (timer, NULL);
+		g_timer_destroy (timer);
+		if (t < best) {
+			best = t;
+			stats = renderer->stats;
+			bits = mandel_get_precision (renderer);
+			used_mode = renderer->compute_mode;
+		}
+		mandel_renderer_clear (renderer);
+	}
+
+	const uint64_t pixels = (uint64_t) size->w * size->h;
+	const struct mandel_julia_param *param = md->type_param;
+	fprintf (f, "%s,%s,%u,%.2f,%s,%u,%s,%s,%u,%u,%u,%llu,%llu,%llu,%llu,%.6f,%.0f,%.0f,%.3f\n",
+		name, md->type->name, param->zpower, area_depth (&md->area),
+		method_keys[method], threads, mode_keys[used_mode], fp_kernel_get ()->name,
+		size->w, size->h, bits,
+		(unsigned long long) pixels, (unsigned long long) stats.pixels_computed,
+		(unsigned long long) stats.iterations, (unsigned long long) stats.saved_iterations,
+		best, stats.pixels_computed / best, stats.iterations / best, pixels / best * 1e-6);
+	fflush (f);
+	return true;
+}
+
+
+/* Runs all combinations of the selected sizes, methods, thread counts and modes for md. */
+static void
+bench_case (FILE *f, const char *name, const struct mandeldata *md)
+{
+	unsigned s, m, t;
+	int mode;
+
+	for (s = 0; s < size_count; s++)
+		for (m = 0; m < RM_MAX; m++) {
+			if (!methods[m])
+				continue;
+			for (t = 0; t < thread_count_count; t++) {
+				struct mandel_renderer renderer[1];
+				/* Just to find out which mode the renderer chooses by itself. */
+				mandel_renderer_init (renderer, md, sizes[s].w, sizes[s].h, 1);
+				const compute_mode_t natural = renderer->compute_mode;
+				mandel_renderer_clear (renderer);
+
+				bench_run (f, name, md, m, thread_counts[t], -1, &sizes[s]);
+				if (!all_modes)
+					continue;
+				for (mode = 0; mode < COMPUTE_MAX; mode++)
+					if (mode != natural)
+						bench_run (f, name, md, m, thread_counts[t], mode, &sizes[s]);
+			}
+		}
+}
+
+
+int
+main (int argc, char **argv)
+{
+	g_thread_init (NULL);
+
+	mpf_set_default_prec (1024); /* ! */
+	mpfr_set_default_prec (1024); /* ! */
+
+	if (!parse_command_line (&argc, &argv))
+		return 1;
+
+	if (list_cases) {
+		const struct bench_case *c;
+		for (c = bench_corpus; c->name != NULL; c++)
+			printf ("%s\n", c->name);
+		return 0;
+	}
+
+	FILE *f = stdout;
+	if (output_file != NULL) {
+		f = fopen (output_file, "w");
+		if (f == NULL) {
+			perror (output_file);
+			return 1;
+		}
+	}
+
+	/*
+	 * pixels_per_s is about the computed pixels only, mpix_per_s about the
+	 * whole image, including the pixels inferred by the render method.
+	 */
+	fprintf (f, "case,type,zpower,depth,method,threads,mode,kernel,width,height,bits,pixels,computed,iterations,saved_iterations,seconds,pixels_per_s,iter_per_s,mpix_per_s\n");
+
+	int status = 0;
+	struct mandeldata md;
+	if (argc > 1) {
+		int i;
+		for (i = 1; i < argc; i++) {
+			if (!bench_load (argv[i], NULL, argv[i], &md)) {
+				status = 1;
+				continue;
+			}
+			bench_case (f, argv[i], &md);
+			mandeldata_clear (&md);
+		}
+	} else {
+		const struct bench_case *c;
+		for (c = bench_corpus; c->name != NULL; c++) {
+			if (case_arg != NULL && strstr (c->name, case_arg) == NULL)
+				continue;
+			if (!bench_load (c->name, c->coords, NULL, &md)) {
+				status = 1;
+				continue;
+			}
+			bench_case (f, c->name, &md);
+			mandeldata_clear (&md);
+		}
+	}
+
+	if (f != stdout)
+		fclose (f);
+	return status;
+}
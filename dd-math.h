@@ -0,0 +1,207 @@
+#ifndef _GTKMANDEL_DD_MATH_H
+#define _GTKMANDEL_DD_MATH_H
+
+/*
+ * Double-double arithmetic: numbers are represented as the unevaluated sum
+ * of 2 doubles, which gives about 106 bits of mantissa. This is about twice
+ * as fast as mpn fixed-point math at this precision.
+ *
+ * The algorithms are the ones from Hida, Li and Bailey's QD library.
+ * They rely on strict IEEE double arithmetic, i. e. no excess precision
+ * (x87) and no contraction of a * b + c into FMA.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "fpdefs.h"
+
+typedef struct mandel_dd {
+	mandel_fp_t hi, lo;
+} mandel_dd_t;
+
+
+static inline mandel_fp_t dd_two_sum (mandel_fp_t a, mandel_fp_t b, mandel_fp_t *err);
+static inline mandel_fp_t dd_quick_two_sum (mandel_fp_t a, mandel_fp_t b, mandel_fp_t *err);
+static inline mandel_fp_t dd_two_prod (mandel_fp_t a, mandel_fp_t b, mandel_fp_t *err);
+static inline mandel_dd_t dd_set_d (mandel_fp_t a);
+static inline mandel_dd_t dd_add (mandel_dd_t a, mandel_dd_t b);
+static inline mandel_dd_t dd_sub (mandel_dd_t a, mandel_dd_t b);
+static inline mandel_dd_t dd_mul (mandel_dd_t a, mandel_dd_t b);
+static inline mandel_dd_t dd_mul_d (mandel_dd_t a, mandel_fp_t b);
+static inline mandel_dd_t dd_mul_pwr2 (mandel_dd_t a, mandel_fp_t b);
+static inline mandel_dd_t dd_sqr (mandel_dd_t a);
+static inline bool dd_eq (mandel_dd_t a, mandel_dd_t b);
+static inline void dd_complex_pow (mandel_dd_t xreal, mandel_dd_t ximag, unsigned n, mandel_dd_t *rreal, mandel_dd_t *rimag);
+
+
+/* a + b = result + err exactly */
+static inline mandel_fp_t
+dd_two_sum (mandel_fp_t a, mandel_fp_t b, mandel_fp_t *err)
+{
+	mandel_fp_t s = a + b;
+	mandel_fp_t bb = s - a;
+	*err = (a - (s - bb)) + (b - bb);
+	return s;
+}
+
+
+/* Same as dd_two_sum(), requires |a| >= |b| */
+static inline mandel_fp_t
+dd_quick_two_sum (mandel_fp_t a, mandel_fp_t b, mandel_fp_t *err)
+{
+	mandel_fp_t s = a + b;
+	*err = b - (s - a);
+	return s;
+}
+
+
+/* a * b = result + err exactly */
+static inline mandel_fp_t
+dd_two_prod (mandel_fp_t a, mandel_fp_t b, mandel_fp_t *err)
+{
+	mandel_fp_t p = a * b;
+#ifdef FP_FAST_FMA
+	*err = fma (a, b, -p);
+#else
+	/* Dekker's algorithm */
+	const mandel_fp_t split = 134217729.0; /* 2^27 + 1 */
+	mandel_fp_t t, a_hi, a_lo, b_hi, b_lo;
+	t = split * a;
+	a_hi = t - (t - a);
+	a_lo = a - a_hi;
+	t = split * b;
+	b_hi = t - (t - b);
+	b_lo = b - b_hi;
+	*err = ((a_hi * b_hi - p) + a_hi * b_lo + a_lo * b_hi) + a_lo * b_lo;
+#endif
+	return p;
+}
+
+
+static inline mandel_dd_t
+dd_set_d (mandel_fp_t a)
+{
+	mandel_dd_t r = {a, 0.0};
+	return r;
+}
+
+
+static inline mandel_dd_t
+dd_add (mandel_dd_t a, mandel_dd_t b)
+{
+	mandel_dd_t r;
+	mandel_fp_t s1, s2, t1, t2;
+	s1 = dd_two_sum (a.hi, b.hi, &s2);
+	t1 = dd_two_sum (a.lo, b.lo, &t2);
+	s2 += t1;
+	s1 = dd_quick_two_sum (s1, s2, &s2);
+	s2 += t2;
+	r.hi = dd_quick_two_sum (s1, s2, &r.lo);
+	return r;
+}
+
+
+static inline mandel_dd_t
+dd_sub (mandel_dd_t a, mandel_dd_t b)
+{
+	b.hi = -b.hi;
+	b.lo = -b.lo;
+	return dd_add (a, b);
+}
+
+
+static inline mandel_dd_t
+dd_mul (mandel_dd_t a, mandel_dd_t b)
+{
+	mandel_dd_t r;
+	mandel_fp_t p1, p2;
+	p1 = dd_two_prod (a.hi, b.hi, &p2);
+	p2 += a.hi * b.lo + a.lo * b.hi;
+	r.hi = dd_quick_two_sum (p1, p2, &r.lo);
+	return r;
+}
+
+
+static inline mandel_dd_t
+dd_mul_d (mandel_dd_t a, mandel_fp_t b)
+{
+	mandel_dd_t r;
+	mandel_fp_t p1, p2;
+	p1 = dd_two_prod (a.hi, b, &p2);
+	p2 += a.lo * b;
+	r.hi = dd_quick_two_sum (p1, p2, &r.lo);
+	return r;
+}
+
+
+/* b must be a power of 2, so the result is exact. */
+static inline mandel_dd_t
+dd_mul_pwr2 (mandel_dd_t a, mandel_fp_t b)
+{
+	mandel_dd_t r = {a.hi * b, a.lo * b};
+	return r;
+}
+
+
+static inline mandel_dd_t
+dd_sqr (mandel_dd_t a)
+{
+	mandel_dd_t r;
+	mandel_fp_t p1, p2;
+	p1 = dd_two_prod (a.hi, a.hi, &p2);
+	p2 += 2.0 * a.hi * a.lo;
+	p2 += a.lo * a.lo;
+	r.hi = dd_quick_two_sum (p1, p2, &r.lo);
+	return r;
+}
+
+
+static inline bool
+dd_eq (mandel_dd_t a, mandel_dd_t b)
+{
+	return a.hi == b.hi && a.lo == b.lo;
+}
+
+
+/* Same algorithm as complex_pow_fp() */
+static inline void
+dd_complex_pow (mandel_dd_t xreal, mandel_dd_t ximag, unsigned n, mandel_dd_t *rreal, mandel_dd_t *rimag)
+{
+	if (n == 0) {
+		*rreal = dd_set_d (1.0);
+		*rimag = dd_set_d (0.0);
+		return;
+	}
+
+	uint32_t m = n;
+	unsigned bits = 32;
+	while ((m & (1 << 31)) == 0) {
+		m <<= 1;
+		bits--;
+	}
+	m <<= 1;
+	bits--;
+
+	mandel_dd_t creal = xreal, cimag = ximag, tmp;
+	unsigned i;
+	for (i = 0; i < bits; i++) {
+		tmp = creal;
+		creal = dd_sub (dd_sqr (creal), dd_sqr (cimag));
+		cimag = dd_mul_pwr2 (dd_mul (tmp, cimag), 2.0);
+
+		if ((m & (1 << 31)) != 0) {
+			tmp = creal;
+			creal = dd_sub (dd_mul (creal, xreal), dd_mul (cimag, ximag));
+			cimag = dd_add (dd_mul (tmp, ximag), dd_mul (cimag, xreal));
+		}
+
+		m <<= 1;
+	}
+
+	*rreal = creal;
+	*rimag = cimag;
+}
+
+#endif /* _GTKMANDEL_DD_MATH_H */
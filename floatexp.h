@@ -0,0 +1,188 @@
+#ifndef _GTKMANDEL_FLOATEXP_H
+#define _GTKMANDEL_FLOATEXP_H
+
+/*
+ * "floatexp" numbers: an FP mantissa with a separate 64-bit exponent, i. e.
+ * the value is mant * 2^exp. The precision is the same as FP, but the range
+ * is practically unlimited, which is what perturbation needs for offsets
+ * below about 1e-300.
+ *
+ * The mantissa is kept normalized to 0.5 <= |mant| < 1 (as returned by
+ * frexp()), or it is zero. Within the FP range, all operations round
+ * exactly like their FP counterparts.
+ */
+
+#include <stdint.h>
+#include <float.h>
+#include <math.h>
+
+#include "fpdefs.h"
+
+/* Exponent of zero, any other number has a larger one. */
+#define FE_ZERO_EXP (INT64_MIN / 4)
+/*
+ * When adding numbers whose exponents differ by more than this, the smaller
+ * one is below half an ulp of the larger one.
+ */
+#define FE_ADD_MAX_SHIFT 64
+
+typedef struct mandel_fe {
+	mandel_fp_t mant;
+	int64_t exp;
+} mandel_fe_t;
+
+
+static inline mandel_fe_t fe_set_2exp (mandel_fp_t mant, int64_t exp);
+static inline mandel_fe_t fe_set_d (mandel_fp_t a);
+static inline mandel_fp_t fe_get_d (mandel_fe_t a);
+static inline mandel_fe_t fe_neg (mandel_fe_t a);
+static inline mandel_fe_t fe_add (mandel_fe_t a, mandel_fe_t b);
+static inline mandel_fe_t fe_sub (mandel_fe_t a, mandel_fe_t b);
+static inline mandel_fe_t fe_mul (mandel_fe_t a, mandel_fe_t b);
+static inline mandel_fe_t fe_mul_d (mandel_fe_t a, mandel_fp_t b);
+static inline mandel_fe_t fe_mul_2exp (mandel_fe_t a, int64_t n);
+static inline mandel_fe_t fe_div (mandel_fe_t a, mandel_fe_t b);
+static inline mandel_fp_t fe_log (mandel_fe_t a);
+static inline void fe_complex_add (mandel_fe_t areal, mandel_fe_t aimag, mandel_fe_t breal, mandel_fe_t bimag, mandel_fe_t *rreal, mandel_fe_t *rimag);
+static inline void fe_complex_mul (mandel_fe_t areal, mandel_fe_t aimag, mandel_fe_t breal, mandel_fe_t bimag, mandel_fe_t *rreal, mandel_fe_t *rimag);
+static inline void fe_complex_sqr (mandel_fe_t areal, mandel_fe_t aimag, mandel_fe_t *rreal, mandel_fe_t *rimag);
+static inline mandel_fe_t fe_complex_abs (mandel_fe_t areal, mandel_fe_t aimag);
+
+
+/* mant * 2^exp, mant doesn't have to be normalized */
+static inline mandel_fe_t
+fe_set_2exp (mandel_fp_t mant, int64_t exp)
+{
+	mandel_fe_t r;
+	int e;
+	r.mant = frexp (mant, &e);
+	r.exp = r.mant == 0.0 ? FE_ZERO_EXP : exp + e;
+	return r;
+}
+
+
+static inline mandel_fe_t
+fe_set_d (mandel_fp_t a)
+{
+	return fe_set_2exp (a, 0);
+}
+
+
+/* Underflows to (signed) zero and overflows to infinity. */
+static inline mandel_fp_t
+fe_get_d (mandel_fe_t a)
+{
+	if (a.exp < DBL_MIN_EXP - DBL_MANT_DIG)
+		return a.mant * 0.0;
+	if (a.exp > DBL_MAX_EXP)
+		return a.mant * HUGE_VAL;
+	return ldexp (a.mant, (int) a.exp);
+}
+
+
+static inline mandel_fe_t
+fe_neg (mandel_fe_t a)
+{
+	a.mant = -a.mant;
+	return a;
+}
+
+
+static inline mandel_fe_t
+fe_add (mandel_fe_t a, mandel_fe_t b)
+{
+	if (a.exp < b.exp) {
+		mandel_fe_t t = a;
+		a = b;
+		b = t;
+	}
+	const int64_t shift = a.exp - b.exp;
+	if (shift > FE_ADD_MAX_SHIFT)
+		return a;
+	return fe_set_2exp (a.mant + ldexp (b.mant, (int) -shift), a.exp);
+}
+
+
+static inline mandel_fe_t
+fe_sub (mandel_fe_t a, mandel_fe_t b)
+{
+	return fe_add (a, fe_neg (b));
+}
+
+
+static inline mandel_fe_t
+fe_mul (mandel_fe_t a, mandel_fe_t b)
+{
+	return fe_set_2exp (a.mant * b.mant, a.exp + b.exp);
+}
+
+
+static inline mandel_fe_t
+fe_mul_d (mandel_fe_t a, mandel_fp_t b)
+{
+	return fe_set_2exp (a.mant * b, a.exp);
+}
+
+
+/* a * 2^n, this is exact */
+static inline mandel_fe_t
+fe_mul_2exp (mandel_fe_t a, int64_t n)
+{
+	if (a.mant != 0.0)
+		a.exp += n;
+	return a;
+}
+
+
+static inline mandel_fe_t
+fe_div (mandel_fe_t a, mandel_fe_t b)
+{
+	return fe_set_2exp (a.mant / b.mant, a.exp - b.exp);
+}
+
+
+/* Natural logarithm of |a| */
+static inline mandel_fp_t
+fe_log (mandel_fe_t a)
+{
+	return log (fabs (a.mant)) + (mandel_fp_t) a.exp * M_LN2;
+}
+
+
+static inline void
+fe_complex_add (mandel_fe_t areal, mandel_fe_t aimag, mandel_fe_t breal, mandel_fe_t bimag, mandel_fe_t *rreal, mandel_fe_t *rimag)
+{
+	*rreal = fe_add (areal, breal);
+	*rimag = fe_add (aimag, bimag);
+}
+
+
+static inline void
+fe_complex_mul (mandel_fe_t areal, mandel_fe_t aimag, mandel_fe_t breal, mandel_fe_t bimag, mandel_fe_t *rreal, mandel_fe_t *rimag)
+{
+	*rreal = fe_sub (fe_mul (areal, breal), fe_mul (aimag, bimag));
+	*rimag = fe_add (fe_mul (areal, bimag), fe_mul (aimag, breal));
+}
+
+
+static inline void
+fe_complex_sqr (mandel_fe_t areal, mandel_fe_t aimag, mandel_fe_t *rreal, mandel_fe_t *rimag)
+{
+	*rreal = fe_sub (fe_mul (areal, areal), fe_mul (aimag, aimag));
+	*rimag = fe_mul_2exp (fe_mul (areal, aimag), 1);
+}
+
+
+static inline mandel_fe_t
+fe_complex_abs (mandel_fe_t areal, mandel_fe_t aimag)
+{
+	const int64_t exp = areal.exp > aimag.exp ? areal.exp : aimag.exp;
+	if (exp == FE_ZERO_EXP)
+		return areal;
+	/* The smaller part may underflow, which doesn't matter then. */
+	mandel_fp_t re = areal.exp - exp < DBL_MIN_EXP - DBL_MANT_DIG ? 0.0 : ldexp (areal.mant, (int) (areal.exp - exp));
+	mandel_fp_t im = aimag.exp - exp < DBL_MIN_EXP - DBL_MANT_DIG ? 0.0 : ldexp (aimag.mant, (int) (aimag.exp - exp));
+	return fe_set_2exp (hypot (re, im), exp);
+}
+
+#endif /* _GTKMANDEL_FLOATEXP_H */
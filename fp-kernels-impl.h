@@ -0,0 +1,451 @@
+/*
+ * Template for the vectorised FP kernels. This is included by fp-kernels.c
+ * once for each instruction set, with FP_VEC_LANES (the number of doubles per
+ * vector register) and FP_NAME (name), which gives all symbols a unique
+ * prefix, defined accordingly.
+ *
+ * The kernels must do exactly the same operations in the same order as the
+ * scalar loops in fractal-math.c, to get identical results.
+ */
+
+#define fp_vec_t FP_NAME (vec_t)
+#define fp_mask_t FP_NAME (mask_t)
+#define fp_lanes FP_NAME (lanes)
+#define FP_LANES (FP_VEC_LANES * FP_VECS)
+
+/*
+ * The iteration counters are kept in FP vectors too, because 64 bit integer
+ * compares aren't available before SSE4.2. They're exact up to 2^53.
+ * When a point is found to be inside by periodicity or interior checking
+ * after i iterations, its counter is set to 2 * maxiter - i, so the number
+ * of iterations saved can be recovered when the lane is stored.
+ */
+typedef mandel_fp_t fp_vec_t __attribute__ ((vector_size (FP_VEC_LANES * sizeof (mandel_fp_t))));
+typedef int64_t fp_mask_t __attribute__ ((vector_size (FP_VEC_LANES * sizeof (int64_t))));
+
+struct fp_lanes {
+	mandel_fp_t x[FP_LANES], y[FP_LANES], cx[FP_LANES], cy[FP_LANES];
+	mandel_fp_t cd_x[FP_LANES], cd_y[FP_LANES], dx[FP_LANES], dy[FP_LANES];
+	mandel_fp_t der_x[FP_LANES], der_y[FP_LANES], rho_z[FP_LANES], rho_d[FP_LANES];
+	mandel_fp_t i[FP_LANES], k[FP_LANES], m[FP_LANES];
+	int point[FP_LANES]; /* index of the point in each lane, -1 for duplicates */
+};
+
+
+static inline bool FP_NAME (mask_any) (const fp_mask_t *mask) __attribute__ ((always_inline));
+static inline void FP_NAME (complex_pow) (const fp_vec_t *xreal, const fp_vec_t *ximag, unsigned n, fp_vec_t *rreal, fp_vec_t *rimag) __attribute__ ((always_inline));
+static inline void FP_NAME (lane_store) (struct fp_lanes *lanes, unsigned l, unsigned maxiter, unsigned *iter, mandel_fp_t *distance, uint64_t *saved, const bool distance_est) __attribute__ ((always_inline));
+static inline void FP_NAME (lane_finish) (struct fp_lanes *lanes, unsigned l, unsigned maxiter, unsigned zpower, const bool distance_est, const bool interior) __attribute__ ((always_inline));
+static inline uint64_t FP_NAME (batch) (unsigned maxiter, unsigned zpower, bool julia, mandel_fp_t preal, mandel_fp_t pimag, const mandel_fp_t *x0, const mandel_fp_t *y0, unsigned n, unsigned *iter, mandel_fp_t *distance, const bool z2, const bool distance_est, const bool interior) __attribute__ ((always_inline));
+static uint64_t FP_NAME (z2_batch) (unsigned maxiter, bool julia, bool interior, mandel_fp_t preal, mandel_fp_t pimag, const mandel_fp_t *x0, const mandel_fp_t *y0, unsigned n, unsigned *iter, mandel_fp_t *distance);
+static uint64_t FP_NAME (zpower_batch) (unsigned maxiter, unsigned zpower, bool julia, bool interior, mandel_fp_t preal, mandel_fp_t pimag, const mandel_fp_t *x0, const mandel_fp_t *y0, unsigned n, unsigned *iter, mandel_fp_t *distance);
+
+
+static inline bool
+FP_NAME (mask_any) (const fp_mask_t *mask)
+{
+	int64_t r = 0;
+	unsigned l;
+	for (l = 0; l < FP_VEC_LANES; l++)
+		r |= (*mask)[l];
+	return r != 0;
+}
+
+
+/* Vector version of complex_pow_fp(), n must be the same for all lanes. */
+static inline void
+FP_NAME (complex_pow) (const fp_vec_t *xreal, const fp_vec_t *ximag, unsigned n, fp_vec_t *rreal, fp_vec_t *rimag)
+{
+	const fp_vec_t zero = {0.0};
+	if (n == 0) {
+		*rreal = zero + 1.0;
+		*rimag = zero;
+		return;
+	}
+
+	uint32_t m = n;
+	unsigned bits = 32;
+	while ((m & (1 << 31)) == 0) {
+		m <<= 1;
+		bits--;
+	}
+	m <<= 1;
+	bits--;
+
+	fp_vec_t creal = *xreal, cimag = *ximag, tmp;
+	unsigned i;
+	for (i = 0; i < bits; i++) {
+		tmp = creal;
+		creal = creal * creal - cimag * cimag;
+		/* exact, just like ldexp (x, 1) */
+		cimag = (tmp * cimag) * 2.0;
+
+		if ((m & (1 << 31)) != 0) {
+			tmp = creal;
+			creal = creal * *xreal - cimag * *ximag;
+			cimag = tmp * *ximag + cimag * *xreal;
+		}
+
+		m <<= 1;
+	}
+
+	*rreal = creal;
+	*rimag = cimag;
+}
+
+
+/* Store the result of lane l, if it holds a point of its own. */
+static inline void
+FP_NAME (lane_store) (struct fp_lanes *lanes, unsigned l, unsigned maxiter, unsigned *iter, mandel_fp_t *distance, uint64_t *saved, const bool distance_est)
+{
+	const int p = lanes->point[l];
+	if (p < 0)
+		return;
+	if (lanes->i[l] > maxiter) {
+		*saved += lanes->i[l] - maxiter;
+		lanes->i[l] = maxiter;
+	}
+	iter[p] = lanes->i[l];
+	if (distance_est) {
+		mandel_fp_t zabs = sqrt (lanes->x[l] * lanes->x[l] + lanes->y[l] * lanes->y[l]);
+		mandel_fp_t dzabs = sqrt (lanes->dx[l] * lanes->dx[l] + lanes->dy[l] * lanes->dy[l]);
+		distance[p] = dzabs == 0.0 ? 0.0 : log (zabs * zabs) * zabs / dzabs;
+	}
+	lanes->point[l] = -1;
+}
+
+
+/*
+ * Continue iterating lane l with scalar code until it is done. This is used
+ * for the last few points, a whole vector would be mostly wasted on them.
+ */
+static inline void
+FP_NAME (lane_finish) (struct fp_lanes *lanes, unsigned l, unsigned maxiter, unsigned zpower, const bool distance_est, const bool interior)
+{
+	mandel_fp_t x = lanes->x[l], y = lanes->y[l], cx = lanes->cx[l], cy = lanes->cy[l];
+	mandel_fp_t cd_x = lanes->cd_x[l], cd_y = lanes->cd_y[l], dx = lanes->dx[l], dy = lanes->dy[l];
+	mandel_fp_t der_x = lanes->der_x[l], der_y = lanes->der_y[l], rho_z = lanes->rho_z[l], rho_d = lanes->rho_d[l];
+	mandel_fp_t i = lanes->i[l], k = lanes->k[l], m = lanes->m[l];
+
+	while (i < maxiter && x * x + y * y < 4.0) {
+		if (interior)
+			interior_track (x, y, der_x, der_y, &rho_z, &rho_d);
+		if (zpower == 2) {
+			if (distance_est) {
+				mandel_fp_t dxnew = 2.0 * (dx * x - dy * y) + 1.0;
+				dy = 2.0 * (dx * y + dy * x);
+				dx = dxnew;
+			}
+			if (interior) {
+				mandel_fp_t new_der_x = 2.0 * (der_x * x - der_y * y);
+				der_y = 2.0 * (der_x * y + der_y * x);
+				der_x = new_der_x;
+			}
+			mandel_fp_t xold = x, yold = y;
+			x = x * x - y * y + cx;
+			y = 2 * xold * yold + cy;
+		} else {
+			if (distance_est || interior) {
+				mandel_fp_t treal, timag;
+				complex_pow_fp (x, y, zpower - 1, &treal, &timag);
+				if (distance_est) {
+					mandel_fp_t new_dx = (mandel_fp_t) zpower * (treal * dx - timag * dy) + 1.0;
+					dy = (mandel_fp_t) zpower * (treal * dy + timag * dx);
+					dx = new_dx;
+				}
+				if (interior) {
+					mandel_fp_t new_der_x = (mandel_fp_t) zpower * (treal * der_x - timag * der_y);
+					der_y = (mandel_fp_t) zpower * (treal * der_y + timag * der_x);
+					der_x = new_der_x;
+				}
+				mandel_fp_t new_x = treal * x - timag * y;
+				y = treal * y + timag * x;
+				x = new_x;
+			} else
+				complex_pow_fp (x, y, zpower, &x, &y);
+			x += cx;
+			y += cy;
+		}
+
+		k -= 1.0;
+		if ((x == cd_x && y == cd_y) || (interior && interior_returned (x, y, cd_x, cd_y, der_x, der_y, rho_z, rho_d))) {
+			i = 2.0 * maxiter - i;
+			break;
+		}
+		if (k == 0.0) {
+			k = m += m;
+			cd_x = x;
+			cd_y = y;
+			der_x = 1.0;
+			der_y = 0.0;
+			rho_z = HUGE_VAL;
+			rho_d = 1.0;
+		}
+		i += 1.0;
+	}
+
+	lanes->x[l] = x;
+	lanes->y[l] = y;
+	lanes->dx[l] = dx;
+	lanes->dy[l] = dy;
+	lanes->der_x[l] = der_x;
+	lanes->der_y[l] = der_y;
+	lanes->rho_z[l] = rho_z;
+	lanes->rho_d[l] = rho_d;
+	lanes->i[l] = i;
+}
+
+
+/*
+ * Each lane iterates its own point, when it is done, the next point is
+ * loaded into it. When there are no more points left, the lane duplicates
+ * another one (its results are discarded, of course). Once only a few
+ * points are left, they are finished with scalar code.
+ * If z2 is true, zpower must be 2.
+ */
+static inline uint64_t
+FP_NAME (batch) (unsigned maxiter, unsigned zpower, bool julia, mandel_fp_t preal, mandel_fp_t pimag, const mandel_fp_t *x0, const mandel_fp_t *y0, unsigned n, unsigned *iter, mandel_fp_t *distance, const bool z2, const bool distance_est, const bool interior)
+{
+	const fp_vec_t zero = {0.0};
+	const fp_vec_t maxiter_v = zero + (mandel_fp_t) maxiter;
+	const fp_vec_t maxiter2_v = zero + 2.0 * maxiter;
+	const fp_vec_t zpower_v = zero + (mandel_fp_t) zpower;
+	fp_vec_t x[FP_VECS], y[FP_VECS], cx[FP_VECS], cy[FP_VECS], cd_x[FP_VECS], cd_y[FP_VECS], dx[FP_VECS], dy[FP_VECS], der_x[FP_VECS], der_y[FP_VECS], rho_z[FP_VECS], rho_d[FP_VECS], i[FP_VECS], k[FP_VECS], m[FP_VECS];
+	/*
+	 * The lanes are stored here while points are loaded or finished, so
+	 * the vectors can stay in registers in the inner loop.
+	 */
+	struct fp_lanes lanes;
+	uint64_t saved = 0;
+	unsigned next = 0, l, v;
+
+	/* Initially, all lanes are "done", so they get loaded below. */
+	memset (&lanes, 0, sizeof (lanes));
+	for (l = 0; l < FP_LANES; l++) {
+		lanes.i[l] = maxiter;
+		lanes.point[l] = -1;
+	}
+
+	while (true) {
+		int busy = -1;
+
+		for (l = 0; l < FP_LANES; l++) {
+			if (lanes.i[l] < maxiter && lanes.x[l] * lanes.x[l] + lanes.y[l] * lanes.y[l] < 4.0) {
+				busy = l;
+				continue;
+			}
+			FP_NAME (lane_store) (&lanes, l, maxiter, iter, distance, &saved, distance_est);
+			/* Skip points which are done right away, dz is still 0 for them, so there is no estimate. */
+			while (next < n && !(x0[next] * x0[next] + y0[next] * y0[next] < 4.0 && maxiter > 0)) {
+				if (distance_est)
+					distance[next] = 0.0;
+				iter[next++] = 0;
+			}
+			if (next < n) {
+				lanes.point[l] = next;
+				lanes.x[l] = lanes.cd_x[l] = x0[next];
+				lanes.y[l] = lanes.cd_y[l] = y0[next];
+				lanes.cx[l] = julia ? preal : x0[next];
+				lanes.cy[l] = julia ? pimag : y0[next];
+				lanes.dx[l] = lanes.dy[l] = 0.0;
+				lanes.der_x[l] = 1.0;
+				lanes.der_y[l] = 0.0;
+				lanes.rho_z[l] = HUGE_VAL;
+				lanes.rho_d[l] = 1.0;
+				lanes.i[l] = 0.0;
+				lanes.k[l] = lanes.m[l] = 1.0;
+				busy = l;
+				next++;
+			}
+		}
+		if (busy < 0)
+			break; /* all lanes done, no more points */
+		if (next >= n) {
+			unsigned live = 0;
+			for (l = 0; l < FP_LANES; l++)
+				live += lanes.point[l] >= 0;
+			if (2 * live <= FP_LANES) {
+				for (l = 0; l < FP_LANES; l++)
+					if (lanes.point[l] >= 0) {
+						FP_NAME (lane_finish) (&lanes, l, maxiter, zpower, distance_est, interior);
+						FP_NAME (lane_store) (&lanes, l, maxiter, iter, distance, &saved, distance_est);
+					}
+				break;
+			}
+		}
+		/* Duplicate a busy lane into the ones left over. */
+		for (l = 0; l < FP_LANES; l++)
+			if (lanes.point[l] < 0 && l != busy) {
+				lanes.x[l] = lanes.x[busy];
+				lanes.y[l] = lanes.y[busy];
+				lanes.cx[l] = lanes.cx[busy];
+				lanes.cy[l] = lanes.cy[busy];
+				lanes.cd_x[l] = lanes.cd_x[busy];
+				lanes.cd_y[l] = lanes.cd_y[busy];
+				lanes.dx[l] = lanes.dx[busy];
+				lanes.dy[l] = lanes.dy[busy];
+				lanes.der_x[l] = lanes.der_x[busy];
+				lanes.der_y[l] = lanes.der_y[busy];
+				lanes.rho_z[l] = lanes.rho_z[busy];
+				lanes.rho_d[l] = lanes.rho_d[busy];
+				lanes.i[l] = lanes.i[busy];
+				lanes.k[l] = lanes.k[busy];
+				lanes.m[l] = lanes.m[busy];
+			}
+
+		for (v = 0; v < FP_VECS; v++) {
+			memcpy (&x[v], lanes.x + v * FP_VEC_LANES, sizeof (x[v]));
+			memcpy (&y[v], lanes.y + v * FP_VEC_LANES, sizeof (y[v]));
+			memcpy (&cx[v], lanes.cx + v * FP_VEC_LANES, sizeof (cx[v]));
+			memcpy (&cy[v], lanes.cy + v * FP_VEC_LANES, sizeof (cy[v]));
+			memcpy (&cd_x[v], lanes.cd_x + v * FP_VEC_LANES, sizeof (cd_x[v]));
+			memcpy (&cd_y[v], lanes.cd_y + v * FP_VEC_LANES, sizeof (cd_y[v]));
+			memcpy (&dx[v], lanes.dx + v * FP_VEC_LANES, sizeof (dx[v]));
+			memcpy (&dy[v], lanes.dy + v * FP_VEC_LANES, sizeof (dy[v]));
+			memcpy (&der_x[v], lanes.der_x + v * FP_VEC_LANES, sizeof (der_x[v]));
+			memcpy (&der_y[v], lanes.der_y + v * FP_VEC_LANES, sizeof (der_y[v]));
+			memcpy (&rho_z[v], lanes.rho_z + v * FP_VEC_LANES, sizeof (rho_z[v]));
+			memcpy (&rho_d[v], lanes.rho_d + v * FP_VEC_LANES, sizeof (rho_d[v]));
+			memcpy (&i[v], lanes.i + v * FP_VEC_LANES, sizeof (i[v]));
+			memcpy (&k[v], lanes.k + v * FP_VEC_LANES, sizeof (k[v]));
+			memcpy (&m[v], lanes.m + v * FP_VEC_LANES, sizeof (m[v]));
+		}
+
+		while (true) {
+			fp_vec_t xsqr[FP_VECS], ysqr[FP_VECS];
+			fp_mask_t any = {0};
+			for (v = 0; v < FP_VECS; v++) {
+				xsqr[v] = x[v] * x[v];
+				ysqr[v] = y[v] * y[v];
+				any |= ~(xsqr[v] + ysqr[v] < 4.0) | (i[v] >= maxiter_v);
+			}
+			if (FP_NAME (mask_any) (&any))
+				break;
+
+			for (v = 0; v < FP_VECS; v++) {
+				if (interior) {
+					/* same as interior_track () */
+					fp_vec_t dsqr = der_x[v] * der_x[v] + der_y[v] * der_y[v];
+					fp_mask_t closer = (xsqr[v] + ysqr[v]) * rho_d[v] < rho_z[v] * dsqr;
+					rho_z[v] = FP_BLEND (closer, xsqr[v] + ysqr[v], rho_z[v]);
+					rho_d[v] = FP_BLEND (closer, dsqr, rho_d[v]);
+				}
+				if (z2) {
+					if (distance_est) {
+						fp_vec_t dxnew = 2.0 * (dx[v] * x[v] - dy[v] * y[v]) + 1.0;
+						dy[v] = 2.0 * (dx[v] * y[v] + dy[v] * x[v]);
+						dx[v] = dxnew;
+					}
+					if (interior) {
+						fp_vec_t new_der_x = 2.0 * (der_x[v] * x[v] - der_y[v] * y[v]);
+						der_y[v] = 2.0 * (der_x[v] * y[v] + der_y[v] * x[v]);
+						der_x[v] = new_der_x;
+					}
+					fp_vec_t yold = y[v];
+					y[v] = 2 * x[v] * yold + cy[v];
+					x[v] = xsqr[v] - ysqr[v] + cx[v];
+				} else {
+					if (distance_est || interior) {
+						fp_vec_t treal, timag;
+						FP_NAME (complex_pow) (&x[v], &y[v], zpower - 1, &treal, &timag);
+						if (distance_est) {
+							fp_vec_t new_dx = zpower_v * (treal * dx[v] - timag * dy[v]) + 1.0;
+							dy[v] = zpower_v * (treal * dy[v] + timag * dx[v]);
+							dx[v] = new_dx;
+						}
+						if (interior) {
+							fp_vec_t new_der_x = zpower_v * (treal * der_x[v] - timag * der_y[v]);
+							der_y[v] = zpower_v * (treal * der_y[v] + timag * der_x[v]);
+							der_x[v] = new_der_x;
+						}
+						fp_vec_t new_x = treal * x[v] - timag * y[v];
+						y[v] = treal * y[v] + timag * x[v];
+						x[v] = new_x;
+					} else {
+						fp_vec_t xold = x[v], yold = y[v];
+						FP_NAME (complex_pow) (&xold, &yold, zpower, &x[v], &y[v]);
+					}
+					x[v] += cx[v];
+					y[v] += cy[v];
+				}
+
+				k[v] -= 1.0;
+				fp_mask_t stop = (x[v] == cd_x[v]) & (y[v] == cd_y[v]);
+				if (interior) {
+					/* same as interior_returned () */
+					fp_vec_t ex = x[v] - cd_x[v], ey = y[v] - cd_y[v];
+					stop |= (der_x[v] * der_x[v] + der_y[v] * der_y[v] < INTERIOR_DERIVATIVE_THRESHOLD)
+						& ((ex * ex + ey * ey) * rho_d[v] < INTERIOR_RETURN_TOLERANCE * rho_z[v]);
+				}
+				fp_mask_t reset = k[v] == 0.0;
+				m[v] = FP_BLEND (reset, m[v] + m[v], m[v]);
+				k[v] = FP_BLEND (reset, m[v], k[v]);
+				cd_x[v] = FP_BLEND (reset, x[v], cd_x[v]);
+				cd_y[v] = FP_BLEND (reset, y[v], cd_y[v]);
+				if (interior) {
+					der_x[v] = FP_BLEND (reset, zero + 1.0, der_x[v]);
+					der_y[v] = FP_BLEND (reset, zero, der_y[v]);
+					rho_z[v] = FP_BLEND (reset, zero + HUGE_VAL, rho_z[v]);
+					rho_d[v] = FP_BLEND (reset, zero + 1.0, rho_d[v]);
+				}
+				i[v] = FP_BLEND (stop, maxiter2_v - i[v], i[v] + 1.0);
+			}
+		}
+
+		for (v = 0; v < FP_VECS; v++) {
+			memcpy (lanes.x + v * FP_VEC_LANES, &x[v], sizeof (x[v]));
+			memcpy (lanes.y + v * FP_VEC_LANES, &y[v], sizeof (y[v]));
+			memcpy (lanes.cd_x + v * FP_VEC_LANES, &cd_x[v], sizeof (cd_x[v]));
+			memcpy (lanes.cd_y + v * FP_VEC_LANES, &cd_y[v], sizeof (cd_y[v]));
+			memcpy (lanes.dx + v * FP_VEC_LANES, &dx[v], sizeof (dx[v]));
+			memcpy (lanes.dy + v * FP_VEC_LANES, &dy[v], sizeof (dy[v]));
+			memcpy (lanes.der_x + v * FP_VEC_LANES, &der_x[v], sizeof (der_x[v]));
+			memcpy (lanes.der_y + v * FP_VEC_LANES, &der_y[v], sizeof (der_y[v]));
+			memcpy (lanes.rho_z + v * FP_VEC_LANES, &rho_z[v], sizeof (rho_z[v]));
+			memcpy (lanes.rho_d + v * FP_VEC_LANES, &rho_d[v], sizeof (rho_d[v]));
+			memcpy (lanes.i + v * FP_VEC_LANES, &i[v], sizeof (i[v]));
+			memcpy (lanes.k + v * FP_VEC_LANES, &k[v], sizeof (k[v]));
+			memcpy (lanes.m + v * FP_VEC_LANES, &m[v], sizeof (m[v]));
+		}
+	}
+	return saved;
+}
+
+
+static uint64_t
+FP_NAME (z2_batch) (unsigned maxiter, bool julia, bool interior, mandel_fp_t preal, mandel_fp_t pimag, const mandel_fp_t *x0, const mandel_fp_t *y0, unsigned n, unsigned *iter, mandel_fp_t *distance)
+{
+	if (distance != NULL) {
+		if (interior)
+			return FP_NAME (batch) (maxiter, 2, julia, preal, pimag, x0, y0, n, iter, distance, true, true, true);
+		else
+			return FP_NAME (batch) (maxiter, 2, julia, preal, pimag, x0, y0, n, iter, distance, true, true, false);
+	} else {
+		if (interior)
+			return FP_NAME (batch) (maxiter, 2, julia, preal, pimag, x0, y0, n, iter, NULL, true, false, true);
+		else
+			return FP_NAME (batch) (maxiter, 2, julia, preal, pimag, x0, y0, n, iter, NULL, true, false, false);
+	}
+}
+
+
+static uint64_t
+FP_NAME (zpower_batch) (unsigned maxiter, unsigned zpower, bool julia, bool interior, mandel_fp_t preal, mandel_fp_t pimag, const mandel_fp_t *x0, const mandel_fp_t *y0, unsigned n, unsigned *iter, mandel_fp_t *distance)
+{
+	if (distance != NULL) {
+		if (interior)
+			return FP_NAME (batch) (maxiter, zpower, julia, preal, pimag, x0, y0, n, iter, distance, false, true, true);
+		else
+			return FP_NAME (batch) (maxiter, zpower, julia, preal, pimag, x0, y0, n, iter, distance, false, true, false);
+	} else {
+		if (interior)
+			return FP_NAME (batch) (maxiter, zpower, julia, preal, pimag, x0, y0, n, iter, NULL, false, false, true);
+		else
+			return FP_NAME (batch) (maxiter, zpower, julia, preal, pimag, x0, y0, n, iter, NULL, false, false, false);
+	}
+}
+
+#undef fp_vec_t
+#undef fp_mask_t
+#undef fp_lanes
+#undef FP_LANES
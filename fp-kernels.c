@@ -0,0 +1,233 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <glib.h>
+#include <gmp.h>
+
+#include "fpdefs.h"
+#include "fp-kernels.h"
+#include "misc-math.h"
+
+#if defined (__i386__) || defined (__x86_64__)
+#define FP_KERNELS_X86
+#endif
+
+/*
+ * The kernels must not use fused multiply-add, even where it is available,
+ * as this would change the results compared to the scalar code.
+ */
+#pragma GCC optimize ("fp-contract=off")
+
+/*
+ * Number of independent vectors iterated in an interleaved manner, to hide
+ * the latency of the FP operations.
+ */
+#define FP_VECS 2
+
+/* mask ? a : b, lane by lane */
+#define FP_BLEND(mask, a, b) ((fp_vec_t) (((mask) & (fp_mask_t) (a)) | (~(mask) & (fp_mask_t) (b))))
+
+
+static bool always_supported (void);
+#ifdef __i386__
+static bool cpu_has_sse2 (void);
+#endif
+#ifdef FP_KERNELS_X86
+static bool cpu_has_avx2 (void);
+static bool cpu_has_avx512 (void);
+#endif
+static const struct fp_kernel *fp_kernel_find (const char *name);
+static gboolean fp_kernel_option (const gchar *option_name, const gchar *value, gpointer data, GError **error);
+
+
+/*
+ * The generic kernel uses whatever the compiler target provides for vectors
+ * of two doubles.
+ */
+#define FP_VEC_LANES 2
+#define FP_NAME(name) fp_generic_ ## name
+#include "fp-kernels-impl.h"
+#undef FP_VEC_LANES
+#undef FP_NAME
+
+#ifdef FP_KERNELS_X86
+
+/* On x86-64, SSE2 is the baseline, so the generic kernel already uses it. */
+#ifdef __i386__
+#pragma GCC push_options
+#pragma GCC target ("sse2")
+#define FP_VEC_LANES 2
+#define FP_NAME(name) fp_sse2_ ## name
+#include "fp-kernels-impl.h"
+#undef FP_VEC_LANES
+#undef FP_NAME
+#pragma GCC pop_options
+#endif
+
+#pragma GCC push_options
+#pragma GCC target ("avx2,fma")
+#define FP_VEC_LANES 4
+#define FP_NAME(name) fp_avx2_ ## name
+#include "fp-kernels-impl.h"
+#undef FP_VEC_LANES
+#undef FP_NAME
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target ("avx512f")
+#define FP_VEC_LANES 8
+#define FP_NAME(name) fp_avx512_ ## name
+#include "fp-kernels-impl.h"
+#undef FP_VEC_LANES
+#undef FP_NAME
+#pragma GCC pop_options
+
+#endif /* FP_KERNELS_X86 */
+
+
+const struct fp_kernel fp_kernels[] = {
+#ifdef FP_KERNELS_X86
+	{"avx512", cpu_has_avx512, fp_avx512_z2_batch, fp_avx512_zpower_batch},
+	{"avx2", cpu_has_avx2, fp_avx2_z2_batch, fp_avx2_zpower_batch},
+#endif
+#ifdef __i386__
+	{"sse2", cpu_has_sse2, fp_sse2_z2_batch, fp_sse2_zpower_batch},
+#endif
+	{"generic", always_supported, fp_generic_z2_batch, fp_generic_zpower_batch},
+	{NULL}
+};
+
+static const struct fp_kernel *volatile current_kernel = NULL;
+
+static GOptionEntry option_entries[] = {
+	{"fp-kernel", 'K', 0, G_OPTION_ARG_CALLBACK, fp_kernel_option, "Use FP kernel NAME (avx512, avx2, sse2 on i386, generic) instead of the fastest one supported", "NAME"},
+	{NULL}
+};
+
+
+static bool
+always_supported (void)
+{
+	return true;
+}
+
+
+#ifdef __i386__
+
+static bool
+cpu_has_sse2 (void)
+{
+	__builtin_cpu_init ();
+	return __builtin_cpu_supports ("sse2");
+}
+
+#endif
+
+#ifdef FP_KERNELS_X86
+
+
+/* FMA isn't used, but it comes with all AVX2 CPUs anyway. */
+static bool
+cpu_has_avx2 (void)
+{
+	__builtin_cpu_init ();
+	return __builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma");
+}
+
+
+static bool
+cpu_has_avx512 (void)
+{
+	__builtin_cpu_init ();
+	return __builtin_cpu_supports ("avx512f");
+}
+
+#endif /* FP_KERNELS_X86 */
+
+
+/* "auto" finds the fastest kernel supported. */
+static const struct fp_kernel *
+fp_kernel_find (const char *name)
+{
+	const struct fp_kernel *kernel;
+	bool automatic = strcmp (name, "auto") == 0;
+	for (kernel = fp_kernels; kernel->name != NULL; kernel++)
+		if ((automatic || strcmp (kernel->name, name) == 0) && kernel->supported ())
+			return kernel;
+	return NULL;
+}
+
+
+/*
+ * Returns the kernel to use. Unless one has been selected explicitly, this
+ * is the one named in the environment, or the fastest one supported.
+ */
+const struct fp_kernel *
+fp_kernel_get (void)
+{
+	const struct fp_kernel *kernel = current_kernel;
+	if (kernel != NULL)
+		return kernel;
+
+	const char *name = getenv (FP_KERNEL_ENV);
+	if (name != NULL) {
+		kernel = fp_kernel_find (name);
+		if (kernel == NULL)
+			fprintf (stderr, "* WARNING: FP kernel \"%s\" is unknown or not supported by this CPU, ignoring %s.\n", name, FP_KERNEL_ENV);
+	}
+	if (kernel == NULL)
+		kernel = fp_kernel_find ("auto");
+	/* No need for locking, all threads get the same result anyway. */
+	current_kernel = kernel;
+	return kernel;
+}
+
+
+bool
+fp_kernel_select (const char *name)
+{
+	const struct fp_kernel *kernel = fp_kernel_find (name);
+	if (kernel == NULL)
+		return false;
+	current_kernel = kernel;
+	return true;
+}
+
+
+static gboolean
+fp_kernel_option (const gchar *option_name, const gchar *value, gpointer data, GError **error)
+{
+	if (!fp_kernel_select (value)) {
+		g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "FP kernel \"%s\" is unknown or not supported by this CPU", value);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+
+GOptionGroup *
+fp_kernel_get_option_group (void)
+{
+	GOptionGroup *group = g_option_group_new ("fp", "FP Kernel Options", "FP Kernel Options", NULL, NULL);
+	g_option_group_add_entries (group, option_entries);
+	return group;
+}
+
+
+uint64_t
+mandel_julia_z2_fp_batch (unsigned maxiter, bool julia, bool interior, mandel_fp_t preal, mandel_fp_t pimag, const mandel_fp_t *x0, const mandel_fp_t *y0, unsigned n, unsigned *iter, mandel_fp_t *distance)
+{
+	return fp_kernel_get ()->z2 (maxiter, julia, interior, preal, pimag, x0, y0, n, iter, distance);
+}
+
+
+uint64_t
+mandel_julia_zpower_fp_batch (unsigned maxiter, unsigned zpower, bool julia, bool interior, mandel_fp_t preal, mandel_fp_t pimag, const mandel_fp_t *x0, const mandel_fp_t *y0, unsigned n, unsigned *iter, mandel_fp_t *distance)
+{
+	return fp_kernel_get ()->zpower (maxiter, zpower, julia, interior, preal, pimag, x0, y0, n, iter, distance);
+}
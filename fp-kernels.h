@@ -0,0 +1,89 @@
+#ifndef _GTKMANDEL_FP_KERNELS_H
+#define _GTKMANDEL_FP_KERNELS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "fpdefs.h"
+
+/* Environment variable which can be used to force a specific kernel */
+#define FP_KERNEL_ENV "FRACTLAB_FP_KERNEL"
+
+/*
+ * Interior checking: The derivative of the orbit with respect to z is
+ * tracked from the last periodicity checking point cd on. If the orbit
+ * comes back close to cd with a small derivative, the iterated map takes a
+ * disk around cd into itself, so the orbit is attracted by a cycle.
+ * The size of that disk is limited by the critical point 0, its distance
+ * is estimated from the orbit point closest to 0 relative to the derivative
+ * there (rho_z = |z|^2, rho_d = |derivative|^2 at that point).
+ * The derivative must be below INTERIOR_DERIVATIVE_THRESHOLD and the
+ * distance from cd below INTERIOR_RETURN_TOLERANCE times the estimated
+ * radius, all squared. Just comparing the derivative with respect to the
+ * starting point to a threshold doesn't work near deep minibrots, where
+ * the orbit gets so close to 0 that it is tiny for outside points too.
+ */
+#define INTERIOR_DERIVATIVE_THRESHOLD (1.0 / 16)
+#define INTERIOR_RETURN_TOLERANCE (1.0 / 4096)
+
+/*
+ * Iterate n points z -> z^2 + c (z2) or z -> z^zpower + c (zpower) in FP,
+ * several of them at a time in vector registers. If julia is true, c is
+ * (preal, pimag) for all points, otherwise c is the point itself.
+ * iter[] receives the number of iterations (maxiter for points inside),
+ * distance[] the distance estimate unless it is NULL.
+ * The results are the same as those of the scalar loops, including the
+ * periodicity checking and the interior checking if interior is true.
+ * Returns the number of iterations saved by these checks.
+ */
+struct fp_kernel {
+	const char *name;
+	/* Returns whether the CPU we're running on can execute this kernel */
+	bool (*supported) (void);
+	uint64_t (*z2) (unsigned maxiter, bool julia, bool interior, mandel_fp_t preal, mandel_fp_t pimag, const mandel_fp_t *x0, const mandel_fp_t *y0, unsigned n, unsigned *iter, mandel_fp_t *distance);
+	uint64_t (*zpower) (unsigned maxiter, unsigned zpower, bool julia, bool interior, mandel_fp_t preal, mandel_fp_t pimag, const mandel_fp_t *x0, const mandel_fp_t *y0, unsigned n, unsigned *iter, mandel_fp_t *distance);
+};
+
+/* All kernels, fastest first, terminated by an entry with name == NULL. */
+extern const struct fp_kernel fp_kernels[];
+
+const struct fp_kernel *fp_kernel_get (void);
+bool fp_kernel_select (const char *name);
+GOptionGroup *fp_kernel_get_option_group (void);
+
+uint64_t mandel_julia_z2_fp_batch (unsigned maxiter, bool julia, bool interior, mandel_fp_t preal, mandel_fp_t pimag, const mandel_fp_t *x0, const mandel_fp_t *y0, unsigned n, unsigned *iter, mandel_fp_t *distance);
+uint64_t mandel_julia_zpower_fp_batch (unsigned maxiter, unsigned zpower, bool julia, bool interior, mandel_fp_t preal, mandel_fp_t pimag, const mandel_fp_t *x0, const mandel_fp_t *y0, unsigned n, unsigned *iter, mandel_fp_t *distance);
+
+static inline void interior_track (mandel_fp_t x, mandel_fp_t y, mandel_fp_t der_x, mandel_fp_t der_y, mandel_fp_t *rho_z, mandel_fp_t *rho_d);
+static inline bool interior_returned (mandel_fp_t x, mandel_fp_t y, mandel_fp_t cd_x, mandel_fp_t cd_y, mandel_fp_t der_x, mandel_fp_t der_y, mandel_fp_t rho_z, mandel_fp_t rho_d);
+
+
+/*
+ * Interior checking, see above. These are called with the orbit point
+ * z = (x, y) and the derivative since cd, interior_track() before each
+ * iteration, interior_returned() after it. At cd, the derivative is reset
+ * to 1, rho_z to HUGE_VAL and rho_d to 1.
+ * The vector kernels do the same operations.
+ */
+static inline void
+interior_track (mandel_fp_t x, mandel_fp_t y, mandel_fp_t der_x, mandel_fp_t der_y, mandel_fp_t *rho_z, mandel_fp_t *rho_d)
+{
+	const mandel_fp_t zsqr = x * x + y * y, dsqr = der_x * der_x + der_y * der_y;
+	if (zsqr * *rho_d < *rho_z * dsqr) {
+		*rho_z = zsqr;
+		*rho_d = dsqr;
+	}
+}
+
+
+static inline bool
+interior_returned (mandel_fp_t x, mandel_fp_t y, mandel_fp_t cd_x, mandel_fp_t cd_y, mandel_fp_t der_x, mandel_fp_t der_y, mandel_fp_t rho_z, mandel_fp_t rho_d)
+{
+	const mandel_fp_t ex = x - cd_x, ey = y - cd_y;
+	return der_x * der_x + der_y * der_y < INTERIOR_DERIVATIVE_THRESHOLD
+		&& (ex * ex + ey * ey) * rho_d < INTERIOR_RETURN_TOLERANCE * rho_z;
+}
+
+#endif /* _GTKMANDEL_FP_KERNELS_H */
@@ -3,22 +3,156 @@
 #include <string.h>
 #include <math.h>
 
+#include <glib.h>
+
 #include <gmp.h>
-#include <mpfr.h>
 
 #include "fpdefs.h"
+#include "fp-kernels.h"
+#include "mp-kernels.h"
+#include "dd-math.h"
+#include "floatexp.h"
 #include "misc-math.h"
 #include "fractal-math.h"
 
+/*
+ * A point is considered glitched when the perturbed orbit gets closer to
+ * zero than this fraction (squared) of the magnitude of the reference orbit.
+ */
+#define PERTURB_GLITCH_TOLERANCE 1e-6
+/* Maximum number of secondary reference orbits to keep around. */
+#define PERTURB_MAX_ORBITS 64
+/* Number of secondary reference orbits to try before creating a new one. */
+#define PERTURB_MAX_TRIES 4
+/*
+ * Extra precision for reference orbits. They are calculated only once, and
+ * all errors accumulated in the reference orbit end up in every point.
+ */
+#define PERTURB_GUARD_LIMBS 1
+/*
+ * Floatexp perturbation continues in FP once the offset exceeds 2^this,
+ * unless the derivative is needed for distance estimation, which may still
+ * be beyond the FP range.
+ */
+#define PERTURB_FE_SWITCH_EXP (-960)
+
+/*
+ * Series approximation: The offset from the reference orbit after n
+ * iterations is approximated by a bivariate polynomial in the offsets of
+ * z0 and c, up to this total degree.
+ */
+#define SERIES_ORDER 8
+#define SERIES_TERMS ((SERIES_ORDER + 1) * (SERIES_ORDER + 2) / 2)
+/* Index of the coefficient for dz0^i * dc^j */
+#define SERIES_INDEX(i, j) (((i) + (j)) * ((i) + (j) + 1) / 2 + (j))
+/*
+ * The series is considered valid as long as the terms of the highest
+ * degree are this much smaller than the linear terms.
+ */
+#define SERIES_TOLERANCE 1e-12
+/*
+ * Points closer than this to the boundary of the main cardioid or the
+ * period-2 bulb (roughly, in terms of the test functions) are left to the
+ * iteration. This covers the rounding of the point to FP.
+ */
+#define INTERIOR_MARGIN 1e-12
+
+/*
+ * Periodicity checking compares orbit points for exact equality, which
+ * rarely happens at high precision. Interior checking (see fp-kernels.h)
+ * uses the derivative of the orbit instead. This costs a few FP operations
+ * per iteration, so it is optional.
+ */
+static gboolean interior_check = FALSE;
+/* For comparison, the unrolled MP kernels (see mp-kernels.h) can be turned off. */
+static gboolean generic_mp = FALSE;
+
+static GOptionEntry option_entries[] = {
+	{"interior-check", 0, 0, G_OPTION_ARG_NONE, &interior_check, "Detect interior points by the derivative of their orbit", NULL},
+	{"generic-mp", 0, 0, G_OPTION_ARG_NONE, &generic_mp, "Use the generic MP loop instead of the one unrolled for the precision", NULL},
+	{NULL}
+};
+
+/* The squared escape radius, as the integer part of an MP number */
+static const mp_limb_t mp_four[INT_LIMBS] = {4};
+
 struct mandel_julia_state;
 struct mandelbrot_state;
 struct julia_state;
+struct perturb_point;
+struct perturb_orbit;
+struct perturb_series;
+struct perturb_state;
+struct perturb_interior;
 
 struct mandel_julia_state {
 	unsigned frac_limbs;
 	fractal_type_flags_t flags;
+	bool interior_check;
+	/* Unrolled loop for z^2 at this precision, or NULL */
+	mp_z2_kernel_t mp_z2;
+	/* Iterations saved by periodicity and interior checking, by this state only */
+	uint64_t iter_saved;
+	/*
+	 * Shared with the clones, which have the original state as parent
+	 * (NULL for the original)
+	 */
+	struct perturb_state *perturb;
+	struct mandel_julia_state *parent;
 };
 
+struct perturb_point {
+	mandel_fp_t real, imag, glitch;
+};
+
+struct perturb_orbit {
+	struct perturb_orbit *next;
+	/* Offset of this reference orbit from the primary one. */
+	mandel_fe_t z0_real, z0_imag, c_real, c_imag;
+	/* Index of the last point, this is where the orbit escaped (or maxiter). */
+	unsigned length;
+	struct perturb_point points[];
+};
+
+/*
+ * Coefficients are scaled by radius^(i + j), so the polynomial is evaluated
+ * at offsets with an absolute value <= 1. On top of that, all coefficients
+ * share the exponent exp, i. e. the value of a coefficient is real * 2^exp.
+ * This keeps them in FP range even for radii beyond it. Coefficients which
+ * underflow are negligible compared to the largest one.
+ */
+struct perturb_series {
+	int64_t exp;
+	mandel_fp_t real[SERIES_TERMS], imag[SERIES_TERMS];
+};
+
+struct perturb_state {
+	mpf_t z0_real, z0_imag, c_real, c_imag;
+	unsigned *binomial;
+	struct perturb_orbit *primary;
+	/* Series approximation for the primary orbit, valid up to series_skip */
+	unsigned series_skip;
+	mandel_fe_t series_radius;
+	struct perturb_series series;
+	/* Secondary orbits for glitch correction, newest first. */
+	struct perturb_orbit *volatile orbits;
+	volatile gint orbit_count;
+};
+
+/*
+ * The perturbation loops have no periodicity checking, so they keep their
+ * own checking points for interior checking.
+ */
+struct perturb_interior {
+	mandel_fp_t der_x, der_y, cd_x, cd_y, rho_z, rho_d;
+	unsigned k, m;
+};
+
+typedef enum perturb_result_enum {
+	PERTURB_OK = 0,
+	PERTURB_GLITCH = 1
+} perturb_result_t;
+
 struct mandelbrot_state {
 	struct mandel_julia_state mjstate;
 	const struct mandelbrot_param *param;
@@ -31,40 +165,77 @@ struct julia_state {
 		struct {
 			mandel_fp_t preal_float, pimag_float;
 		} fp;
+		struct {
+			mandel_dd_t preal_dd, pimag_dd;
+		} dd;
 	} mpvars;
+	/* The parameter in fixed point, real and imaginary part */
+	mp_limb_t *param_mp;
 };
 
 
-static bool mandel_julia (struct mandel_julia_state *state, const struct mandel_julia_param *param, mpf_srcptr x0f, mpf_srcptr y0f, mpf_srcptr prealf, mpf_srcptr pimagf, unsigned *iter, mpfr_ptr distance);
-#ifdef MANDELBROT_FP_ASM
-unsigned mandelbrot_fp (mandel_fp_t x0, mandel_fp_t y0, unsigned maxiter);
-#else
-static unsigned mandelbrot_fp (mandel_fp_t x0, mandel_fp_t y0, unsigned maxiter);
-#endif
+static bool mandel_julia (struct mandel_julia_state *state, const struct mandel_julia_param *param, mp_srcptr x0, mp_srcptr y0, mp_srcptr preal, mp_srcptr pimag, unsigned *iter, mandel_fe_t *distance);
 static bool mandel_julia_fp (struct mandel_julia_state *state, const struct mandel_julia_param *param, mandel_fp_t x0, mandel_fp_t y0, mandel_fp_t preal, mandel_fp_t pimag, unsigned *iter, mandel_fp_t *distance);
-static unsigned mandel_julia_z2 (struct mandel_julia_state *state, const struct mandel_julia_param *param, mpf_srcptr x0f, mpf_srcptr y0f, mpf_srcptr prealf, mpf_srcptr pimagf, mpfr_ptr distance);
-static unsigned mandel_julia_zpower (struct mandel_julia_state *state, const struct mandel_julia_param *param, mpf_srcptr x0f, mpf_srcptr y0f, mpf_srcptr prealf, mpf_srcptr pimagf, mpfr_ptr distance);
+static void mandel_julia_fp_batch (struct mandel_julia_state *state, const struct mandel_julia_param *param, bool julia, mandel_fp_t preal, mandel_fp_t pimag, const mandel_fp_t *x0, const mandel_fp_t *y0, unsigned n, unsigned *iter, mandel_fp_t *distance, bool *inside);
+static unsigned mandel_julia_z2 (struct mandel_julia_state *state, const struct mandel_julia_param *param, mp_srcptr x0, mp_srcptr y0, mp_srcptr preal, mp_srcptr pimag, mandel_fe_t *distance);
+static unsigned mandel_julia_zpower (struct mandel_julia_state *state, const struct mandel_julia_param *param, mp_srcptr x0, mp_srcptr y0, mp_srcptr preal, mp_srcptr pimag, mandel_fe_t *distance);
 static unsigned mandel_julia_z2_fp (struct mandel_julia_state *state, const struct mandel_julia_param *param, mandel_fp_t x0, mandel_fp_t y0, mandel_fp_t preal, mandel_fp_t pimag, mandel_fp_t *distance);
 static unsigned mandel_julia_zpower_fp (struct mandel_julia_state *state, const struct mandel_julia_param *param, mandel_fp_t x0, mandel_fp_t y0, mandel_fp_t preal, mandel_fp_t pimag, mandel_fp_t *distance);
+static bool mandel_julia_dd (struct mandel_julia_state *state, const struct mandel_julia_param *param, const mandel_dd_t *x0, const mandel_dd_t *y0, const mandel_dd_t *preal, const mandel_dd_t *pimag, unsigned *iter, mandel_fp_t *distance);
+static unsigned mandel_julia_z2_dd (struct mandel_julia_state *state, const struct mandel_julia_param *param, const mandel_dd_t *x0, const mandel_dd_t *y0, const mandel_dd_t *preal, const mandel_dd_t *pimag, mandel_fp_t *distance);
+static unsigned mandel_julia_zpower_dd (struct mandel_julia_state *state, const struct mandel_julia_param *param, const mandel_dd_t *x0, const mandel_dd_t *y0, const mandel_dd_t *preal, const mandel_dd_t *pimag, mandel_fp_t *distance);
+static mandel_fp_t distance_estimate_fp (mandel_fp_t x, mandel_fp_t y, mandel_fp_t dx, mandel_fp_t dy);
+static unsigned mandel_julia_perturb_reference (struct mandel_julia_state *state, const struct mandel_julia_param *param, mpf_srcptr x0f, mpf_srcptr y0f, mpf_srcptr prealf, mpf_srcptr pimagf, const mandel_fe_t *radius);
+static bool mandel_julia_perturb (struct mandel_julia_state *state, const struct mandel_julia_param *param, mandel_fe_t dx0, mandel_fe_t dy0, mandel_fe_t dpreal, mandel_fe_t dpimag, bool floatexp, unsigned *iter, mandel_fe_t *distance);
+static bool mandel_julia_perturb_fp (struct mandel_julia_state *state, const struct mandel_julia_param *param, mandel_fp_t dx0, mandel_fp_t dy0, mandel_fp_t dpreal, mandel_fp_t dpimag, unsigned *iter, mandel_fp_t *distance);
+static perturb_result_t mandel_julia_perturb_orbit (struct mandel_julia_state *state, const struct mandel_julia_param *param, const struct perturb_orbit *orbit, unsigned i, mandel_fp_t dx, mandel_fp_t dy, mandel_fp_t der_x, mandel_fp_t der_y, mandel_fp_t dpreal, mandel_fp_t dpimag, unsigned *iter, mandel_fp_t *distance);
+static perturb_result_t mandel_julia_perturb_orbit_fe (struct mandel_julia_state *state, const struct mandel_julia_param *param, const struct perturb_orbit *orbit, unsigned i, mandel_fe_t dx, mandel_fe_t dy, mandel_fe_t der_x, mandel_fe_t der_y, mandel_fe_t dpreal, mandel_fe_t dpimag, unsigned *iter, mandel_fe_t *distance);
+static inline bool perturb_interior_step (struct perturb_interior *pint, unsigned zpower, mandel_fp_t x, mandel_fp_t y);
+static perturb_result_t perturb_orbit_iterate (struct mandel_julia_state *state, const struct mandel_julia_param *param, bool floatexp, const struct perturb_orbit *orbit, unsigned i, mandel_fe_t dx, mandel_fe_t dy, mandel_fe_t der_x, mandel_fe_t der_y, mandel_fe_t dpreal, mandel_fe_t dpimag, unsigned *iter, mandel_fe_t *distance);
+static void perturb_series_mul (struct perturb_series *rop, const struct perturb_series *op1, const struct perturb_series *op2);
+static void perturb_series_normalize (struct perturb_series *series);
+static void perturb_series_add (struct perturb_series *series, unsigned idx, mandel_fe_t real, mandel_fe_t imag);
+static unsigned perturb_series_init (struct perturb_state *pstate, const struct mandel_julia_param *param, const mandel_fe_t *radius);
+static void perturb_series_eval (const struct perturb_state *pstate, mandel_fe_t dx0, mandel_fe_t dy0, mandel_fe_t dpreal, mandel_fe_t dpimag, mandel_fe_t *dx, mandel_fe_t *dy, mandel_fe_t *der_x, mandel_fe_t *der_y);
+static struct perturb_orbit *perturb_orbit_new (struct mandel_julia_state *state, const struct mandel_julia_param *param, mandel_fe_t dx0, mandel_fe_t dy0, mandel_fe_t dpreal, mandel_fe_t dpimag);
+static void perturb_state_free (struct perturb_state *pstate);
 
 static void mandel_julia_state_init (struct mandel_julia_state *state, const struct mandel_julia_param *param);
+static void mandel_julia_state_clone (struct mandel_julia_state *clone, struct mandel_julia_state *orig);
 static void mandel_julia_state_clear (struct mandel_julia_state *state);
 
 static void *mandelbrot_param_new (void);
 static void *mandelbrot_param_clone (const void *orig);
 static void mandelbrot_param_free (void *param);
 static void *mandelbrot_state_new (const void *md, fractal_type_flags_t flags, unsigned frac_limbs);
+static void *mandelbrot_state_clone (void *state);
 static void mandelbrot_state_free (void *state);
-static bool mandelbrot_compute (void *state, mpf_srcptr real, mpf_srcptr imag, unsigned *iter, mpfr_ptr distance);
+static bool mandelbrot_compute (void *state, mp_srcptr real, mp_srcptr imag, unsigned *iter, mandel_fe_t *distance);
 static bool mandelbrot_compute_fp (void *state, mandel_fp_t real, mandel_fp_t imag, unsigned *iter, mandel_fp_t *distance);
+static void mandelbrot_compute_fp_batch (void *state, const mandel_fp_t *real, const mandel_fp_t *imag, unsigned n, unsigned *iter, mandel_fp_t *distance, bool *inside);
+static bool mandelbrot_compute_dd (void *state, const mandel_dd_t *real, const mandel_dd_t *imag, unsigned *iter, mandel_fp_t *distance);
+static unsigned mandelbrot_perturb_reference (void *state, mpf_srcptr real, mpf_srcptr imag, const mandel_fe_t *radius);
+static bool mandelbrot_compute_perturb (void *state, mandel_fp_t dreal, mandel_fp_t dimag, unsigned *iter, mandel_fp_t *distance);
+static bool mandelbrot_compute_perturb_fe (void *state, const mandel_fe_t *dreal, const mandel_fe_t *dimag, unsigned *iter, mandel_fe_t *distance);
+static bool mandelbrot_interior (void *state, mandel_fp_t real, mandel_fp_t imag, unsigned *iter);
+static uint64_t mandelbrot_saved_iterations (void *state);
 
 static void *julia_param_new (void);
 static void *julia_param_clone (const void *orig);
 static void julia_param_free (void *param);
+static bool julia_has_interior (const struct julia_param *param);
+static unsigned julia_param_bits (const void *param, unsigned pixel_bits);
 static void *julia_state_new (const void *md, fractal_type_flags_t flags, unsigned frac_limbs);
+static void *julia_state_clone (void *state);
 static void julia_state_free (void *state);
-static bool julia_compute (void *state, mpf_srcptr real, mpf_srcptr imag, unsigned *iter, mpfr_ptr distance);
+static bool julia_compute (void *state, mp_srcptr real, mp_srcptr imag, unsigned *iter, mandel_fe_t *distance);
 static bool julia_compute_fp (void *state, mandel_fp_t real, mandel_fp_t imag, unsigned *iter, mandel_fp_t *distance);
+static void julia_compute_fp_batch (void *state, const mandel_fp_t *real, const mandel_fp_t *imag, unsigned n, unsigned *iter, mandel_fp_t *distance, bool *inside);
+static bool julia_compute_dd (void *state, const mandel_dd_t *real, const mandel_dd_t *imag, unsigned *iter, mandel_fp_t *distance);
+static unsigned julia_perturb_reference (void *state, mpf_srcptr real, mpf_srcptr imag, const mandel_fe_t *radius);
+static bool julia_compute_perturb (void *state, mandel_fp_t dreal, mandel_fp_t dimag, unsigned *iter, mandel_fp_t *distance);
+static bool julia_compute_perturb_fe (void *state, const mandel_fe_t *dreal, const mandel_fe_t *dimag, unsigned *iter, mandel_fe_t *distance);
+static uint64_t julia_saved_iterations (void *state);
 
 
 static const struct fractal_type fractal_types[] = {
@@ -74,10 +245,19 @@ static const struct fractal_type fractal_types[] = {
 		mandelbrot_param_new,
 		mandelbrot_param_clone,
 		mandelbrot_param_free,
+		NULL,
 		mandelbrot_state_new,
+		mandelbrot_state_clone,
 		mandelbrot_state_free,
 		mandelbrot_compute,
-		mandelbrot_compute_fp
+		mandelbrot_compute_fp,
+		mandelbrot_compute_fp_batch,
+		mandelbrot_compute_dd,
+		mandelbrot_perturb_reference,
+		mandelbrot_compute_perturb,
+		mandelbrot_compute_perturb_fe,
+		mandelbrot_interior,
+		mandelbrot_saved_iterations
 	},
 	{
 		FRACTAL_JULIA, "julia", "Julia Set",
@@ -85,99 +265,80 @@ static const struct fractal_type fractal_types[] = {
 		julia_param_new,
 		julia_param_clone,
 		julia_param_free,
+		julia_param_bits,
 		julia_state_new,
+		julia_state_clone,
 		julia_state_free,
 		julia_compute,
-		julia_compute_fp
+		julia_compute_fp,
+		julia_compute_fp_batch,
+		julia_compute_dd,
+		julia_perturb_reference,
+		julia_compute_perturb,
+		julia_compute_perturb_fe,
+		NULL,
+		julia_saved_iterations
 	}
 };
 
 
 static unsigned
-mandel_julia_z2 (struct mandel_julia_state *state, const struct mandel_julia_param *param, mpf_srcptr x0f, mpf_srcptr y0f, mpf_srcptr prealf, mpf_srcptr pimagf, mpfr_ptr distance)
+mandel_julia_z2 (struct mandel_julia_state *state, const struct mandel_julia_param *param, mp_srcptr x0, mp_srcptr y0, mp_srcptr preal, mp_srcptr pimag, mandel_fe_t *distance)
 {
 	const bool distance_est = (state->flags & FRAC_TYPE_DISTANCE) != 0;
 	const unsigned frac_limbs = state->frac_limbs;
 	const unsigned total_limbs = INT_LIMBS + frac_limbs;
 	const unsigned maxiter = param->maxiter;
-	mp_limb_t x0[total_limbs], y0[total_limbs], preal[total_limbs], pimag[total_limbs];
-	bool x0_sign, y0_sign, preal_sign, pimag_sign;
-	mp_limb_t x[total_limbs], y[total_limbs], xsqr[total_limbs], ysqr[total_limbs], sqrsum[total_limbs], four[INT_LIMBS];
+	mp_limb_t x[total_limbs], y[total_limbs], xsqr[total_limbs], ysqr[total_limbs], sqrsum[total_limbs];
 	mp_limb_t cd_x[total_limbs], cd_y[total_limbs];
-	mp_limb_t tmp1[total_limbs];
 	unsigned i;
-	mpf_t dx, dy, xf, yf, ftmp1, ftmp2, ftmp3;
-
-	x0_sign = my_mpf_get_mpn (x0, x0f, frac_limbs);
-	y0_sign = my_mpf_get_mpn (y0, y0f, frac_limbs);
-	preal_sign = my_mpf_get_mpn (preal, prealf, frac_limbs);
-	pimag_sign = my_mpf_get_mpn (pimag, pimagf, frac_limbs);
+	struct mp_derivative dz;
+	mandel_fp_t der_x = 1.0, der_y = 0.0, rho_z = HUGE_VAL, rho_d = 1.0;
 
-	four[0] = 4;
-	for (i = 1; i < INT_LIMBS; i++)
-		four[i] = 0;
+	if (state->mp_z2 != NULL)
+		return state->mp_z2 (maxiter, state->interior_check, x0, y0, preal, pimag, distance_est ? distance : NULL, &state->iter_saved);
 
 	memcpy (x, x0, sizeof (x));
 	memcpy (cd_x, x0, sizeof (cd_x));
 	memcpy (y, y0, sizeof (y));
 	memcpy (cd_y, y0, sizeof (cd_y));
+	mp_derivative_init (&dz);
 
-	if (distance_est) {
-		mpf_init2 (dx, total_limbs * GMP_NUMB_BITS);
-		mpf_init2 (dy, total_limbs * GMP_NUMB_BITS);
-		mpf_init2 (xf, total_limbs * GMP_NUMB_BITS);
-		mpf_init2 (yf, total_limbs * GMP_NUMB_BITS);
-		mpf_init2 (ftmp1, total_limbs * GMP_NUMB_BITS);
-		mpf_init2 (ftmp2, total_limbs * GMP_NUMB_BITS);
-		mpf_init2 (ftmp3, total_limbs * GMP_NUMB_BITS);
-		mpf_set_ui (dx, 0);
-		mpf_set_ui (dy, 0);
-	}
-
-	bool x_sign = x0_sign, y_sign = y0_sign;
+	/*
+	 * z in FP for interior checking and distance estimation, the
+	 * derivatives only need FP precision
+	 */
+	mandel_fp_t xfp = my_mpn_get_fp (x, frac_limbs), yfp = my_mpn_get_fp (y, frac_limbs);
+	mandel_fp_t cd_xfp = xfp, cd_yfp = yfp;
 
 	int k = 1, m = 1;
 	i = 0;
-	my_mpn_mul_fast (xsqr, x, x, frac_limbs);
-	my_mpn_mul_fast (ysqr, y, y, frac_limbs);
+	my_mpn_ssqr_fast (xsqr, x, frac_limbs);
+	my_mpn_ssqr_fast (ysqr, y, frac_limbs);
 	mpn_add_n (sqrsum, xsqr, ysqr, total_limbs);
-	while (i < maxiter && mpn_cmp (sqrsum + frac_limbs, four, INT_LIMBS) < 0) {
-		if (distance_est) {
-			my_mpn_get_mpf (xf, x, x_sign, frac_limbs);
-			my_mpn_get_mpf (yf, y, y_sign, frac_limbs);
-			/* tmp1 = dx * x */
-			mpf_mul (ftmp1, dx, xf);
-			/* tmp2 = dy * y */
-			mpf_mul (ftmp2, dy, yf);
-			/* tmp1 = tmp1 - tmp2 */
-			mpf_sub (ftmp1, ftmp1, ftmp2);
-			/* tmp2 = 2 * tmp1 */
-			mpf_mul_2exp (ftmp2, ftmp1, 1);
-			/* tmp1 = tmp2 + 1 */
-			mpf_add_ui (ftmp1, ftmp2, 1);
-			/* tmp2 = dx * y */
-			mpf_mul (ftmp2, dx, yf);
-			/* tmp3 = x * dy */
-			mpf_mul (ftmp3, xf, dy);
-			/* tmp2 = tmp2 + tmp3 */
-			mpf_add (ftmp2, ftmp2, ftmp3);
-			/* dy = 2 * tmp2 */
-			mpf_mul_2exp (dy, ftmp2, 1);
-			/* dx = tmp1 */
-			mpf_set (dx, ftmp1);
-		}
-
-		my_mpn_mul_fast (tmp1, x, y, frac_limbs);
-		mpn_lshift (y, tmp1, total_limbs, 1);
-		y_sign = my_mpn_add_signed (y, y, x_sign != y_sign, pimag, pimag_sign, frac_limbs);
-		x_sign = my_mpn_add_signed (x, xsqr, false, ysqr, true, frac_limbs);
-		x_sign = my_mpn_add_signed (x, x, x_sign, preal, preal_sign, frac_limbs);
+	while (i < maxiter && mpn_cmp (sqrsum + frac_limbs, mp_four, INT_LIMBS) < 0) {
+		if (state->interior_check) {
+			interior_track (xfp, yfp, der_x, der_y, &rho_z, &rho_d);
+			mandel_fp_t new_der_x = 2.0 * (der_x * xfp - der_y * yfp);
+			der_y = 2.0 * (der_x * yfp + der_y * xfp);
+			der_x = new_der_x;
+		}
+		if (distance_est)
+			mp_derivative_step (&dz, 2.0, xfp, yfp);
+
+		my_mpn_complex_sqr (x, y, x, y, xsqr, ysqr, frac_limbs);
+		mpn_add_n (x, x, preal, total_limbs);
+		mpn_add_n (y, y, pimag, total_limbs);
+		if (state->interior_check || distance_est) {
+			xfp = my_mpn_get_fp (x, frac_limbs);
+			yfp = my_mpn_get_fp (y, frac_limbs);
+		}
 
 		k--;
-		/* FIXME we must compare the signs here! */
-		if (mpn_cmp (x, cd_x, total_limbs) == 0 && mpn_cmp (y, cd_y, total_limbs) == 0) {
+		if ((mpn_cmp (x, cd_x, total_limbs) == 0 && mpn_cmp (y, cd_y, total_limbs) == 0)
+				|| (state->interior_check && interior_returned (xfp, yfp, cd_xfp, cd_yfp, der_x, der_y, rho_z, rho_d))) {
 			//printf ("* Cycle of length %d detected after %u iterations.\n", m - k + 1, i);
-			// XXX iter_saved += maxiter - i;
+			state->iter_saved += maxiter - i;
 			i = maxiter;
 			break;
 		}
@@ -185,144 +346,88 @@ mandel_julia_z2 (struct mandel_julia_state *state, const struct mandel_julia_par
 			k = m <<= 1;
 			memcpy (cd_x, x, sizeof (x));
 			memcpy (cd_y, y, sizeof (y));
+			cd_xfp = xfp;
+			cd_yfp = yfp;
+			der_x = 1.0;
+			der_y = 0.0;
+			rho_z = HUGE_VAL;
+			rho_d = 1.0;
 		}
 
-		my_mpn_mul_fast (xsqr, x, x, frac_limbs);
-		my_mpn_mul_fast (ysqr, y, y, frac_limbs);
+		my_mpn_ssqr_fast (xsqr, x, frac_limbs);
+		my_mpn_ssqr_fast (ysqr, y, frac_limbs);
 		mpn_add_n (sqrsum, xsqr, ysqr, total_limbs);
 
 		i++;
 	}
 
-	if (distance_est) {
-		my_mpn_get_mpf (xf, x, x_sign, frac_limbs);
-		my_mpn_get_mpf (yf, y, y_sign, frac_limbs);
-		mpf_mul (xf, xf, xf);
-		mpf_mul (yf, yf, yf);
-		mpf_add (xf, xf, yf);
-		mpf_sqrt (xf, xf);
-		//double zabs = mpf_get_d (xf);
-		mpfr_t zabs;
-		mpfr_init2 (zabs, 1024); /* XXX */
-		mpfr_set_f (zabs, xf, GMP_RNDN);
-		mpf_mul (dx, dx, dx);
-		mpf_mul (dy, dy, dy);
-		mpf_add (dx, dx, dy);
-		mpf_sqrt (dx, dx);
-		//double dzabs = mpf_get_d (dxf);
-		mpfr_t dzabs;
-		mpfr_init2 (dzabs, 1024); /* XXX */
-		mpfr_set_f (dzabs, dx, GMP_RNDN);
-		//double distance = log (zabs * zabs) * zabs / dzabs;
-		mpfr_sqr (distance, zabs, GMP_RNDN);
-		mpfr_log (distance, distance, GMP_RNDN);
-		mpfr_mul (distance, distance, zabs, GMP_RNDN);
-		mpfr_div (distance, distance, dzabs, GMP_RNDN);
-
-		mpf_clear (xf);
-		mpf_clear (yf);
-		mpf_clear (dx);
-		mpf_clear (dy);
-		mpf_clear (ftmp1);
-		mpf_clear (ftmp2);
-		mpf_clear (ftmp3);
-		mpfr_clear (zabs);
-		mpfr_clear (dzabs);
-	}
+	if (distance_est)
+		mp_derivative_distance (distance, xfp, yfp, &dz);
 
 	return i;
 }
 
 
 static unsigned
-mandel_julia_zpower (struct mandel_julia_state *state, const struct mandel_julia_param *param, mpf_srcptr x0f, mpf_srcptr y0f, mpf_srcptr prealf, mpf_srcptr pimagf, mpfr_ptr distance)
+mandel_julia_zpower (struct mandel_julia_state *state, const struct mandel_julia_param *param, mp_srcptr x0, mp_srcptr y0, mp_srcptr preal, mp_srcptr pimag, mandel_fe_t *distance)
 {
 	const bool distance_est = (state->flags & FRAC_TYPE_DISTANCE) != 0;
 	const unsigned frac_limbs = state->frac_limbs;
 	const unsigned total_limbs = INT_LIMBS + frac_limbs;
 	const unsigned maxiter = param->maxiter;
 	const unsigned zpower = param->zpower;
-	mp_limb_t x0[total_limbs], y0[total_limbs], preal[total_limbs], pimag[total_limbs];
-	bool x0_sign, y0_sign, preal_sign, pimag_sign;
-	mp_limb_t x[total_limbs], y[total_limbs], xsqr[total_limbs], ysqr[total_limbs], sqrsum[total_limbs], four[INT_LIMBS];
+	mp_limb_t x[total_limbs], y[total_limbs], xsqr[total_limbs], ysqr[total_limbs], sqrsum[total_limbs];
 	mp_limb_t cd_x[total_limbs], cd_y[total_limbs];
-	mpf_t dx, dy, new_dx, new_dy, ftmpreal, ftmpimag, ftmp1;
+	struct mp_derivative dz;
+	mandel_fp_t der_x = 1.0, der_y = 0.0, rho_z = HUGE_VAL, rho_d = 1.0;
 	unsigned i;
 
-	if (distance_est) {
-		mpf_init2 (dx, total_limbs * GMP_NUMB_BITS);
-		mpf_init2 (dy, total_limbs * GMP_NUMB_BITS);
-		mpf_init2 (new_dx, total_limbs * GMP_NUMB_BITS);
-		mpf_init2 (new_dy, total_limbs * GMP_NUMB_BITS);
-		mpf_init2 (ftmpreal, total_limbs * GMP_NUMB_BITS);
-		mpf_init2 (ftmpimag, total_limbs * GMP_NUMB_BITS);
-		mpf_init2 (ftmp1, total_limbs * GMP_NUMB_BITS);
-		mpf_set_ui (dx, 0);
-		mpf_set_ui (dy, 0);
-	}
-
-	x0_sign = my_mpf_get_mpn (x0, x0f, frac_limbs);
-	y0_sign = my_mpf_get_mpn (y0, y0f, frac_limbs);
-	preal_sign = my_mpf_get_mpn (preal, prealf, frac_limbs);
-	pimag_sign = my_mpf_get_mpn (pimag, pimagf, frac_limbs);
-
-	/* FIXME we shouldn't have to do this for every call */
-	four[0] = 4;
-	for (i = 1; i < INT_LIMBS; i++)
-		four[i] = 0;
-
 	memcpy (x, x0, sizeof (x));
 	memcpy (cd_x, x0, sizeof (cd_x));
 	memcpy (y, y0, sizeof (y));
 	memcpy (cd_y, y0, sizeof (cd_y));
+	mp_derivative_init (&dz);
 
-	bool x_sign = x0_sign, y_sign = y0_sign;
+	/*
+	 * z in FP for interior checking and distance estimation, the
+	 * derivatives only need FP precision
+	 */
+	mandel_fp_t xfp = my_mpn_get_fp (x, frac_limbs), yfp = my_mpn_get_fp (y, frac_limbs);
+	mandel_fp_t cd_xfp = xfp, cd_yfp = yfp;
 
 	int k = 1, m = 1;
 	i = 0;
-	my_mpn_mul_fast (xsqr, x, x, frac_limbs);
-	my_mpn_mul_fast (ysqr, y, y, frac_limbs);
+	my_mpn_ssqr_fast (xsqr, x, frac_limbs);
+	my_mpn_ssqr_fast (ysqr, y, frac_limbs);
 	mpn_add_n (sqrsum, xsqr, ysqr, total_limbs);
-	while (i < maxiter && mpn_cmp (sqrsum + frac_limbs, four, INT_LIMBS) < 0) {
-		mp_limb_t tmpreal[total_limbs], tmpimag[total_limbs], tmpreal2[total_limbs], tmpimag2[total_limbs], rtmp1[total_limbs];
-		bool tmpreal_sign, tmpimag_sign, tmpreal2_sign, tmpimag2_sign, rtmp1_sign;
-		if (distance_est) {
-			complex_pow (x, x_sign, y, y_sign, zpower - 1, tmpreal2, &tmpreal2_sign, tmpimag2, &tmpimag2_sign, frac_limbs);
-
-			my_mpn_get_mpf (ftmpreal, tmpreal2, tmpreal2_sign, frac_limbs);
-			my_mpn_get_mpf (ftmpimag, tmpimag2, tmpimag2_sign, frac_limbs);
-			mpf_mul (new_dx, ftmpreal, dx);
-			mpf_mul (ftmp1, ftmpimag, dy);
-			mpf_sub (new_dx, new_dx, ftmp1);
-			mpf_mul_ui (new_dx, new_dx, zpower);
-			mpf_add_ui (new_dx, new_dx, 1);
-			mpf_mul (new_dy, ftmpimag, dx);
-			mpf_mul (ftmp1, ftmpreal, dy);
-			mpf_add (new_dy, new_dy, ftmp1);
-			mpf_mul_ui (dy, new_dy, zpower);
-			mpf_set (dx, new_dx);
-
-			my_mpn_mul_fast (tmpreal, tmpreal2, x, frac_limbs);
-			tmpreal_sign = tmpreal2_sign != x_sign;
-			my_mpn_mul_fast (rtmp1, tmpimag2, y, frac_limbs);
-			rtmp1_sign = tmpimag2_sign != y_sign;
-			tmpreal_sign = my_mpn_add_signed (tmpreal, tmpreal, tmpreal_sign, rtmp1, !rtmp1_sign, frac_limbs);
-			my_mpn_mul_fast (tmpimag, tmpimag2, x, frac_limbs);
-			tmpimag_sign = tmpimag2_sign != x_sign;
-			my_mpn_mul_fast (rtmp1, tmpreal2, y, frac_limbs);
-			rtmp1_sign = tmpreal2_sign != y_sign;
-			tmpimag_sign = my_mpn_add_signed (tmpimag, tmpimag, tmpimag_sign, rtmp1, rtmp1_sign, frac_limbs);
-		} else
-			complex_pow (x, x_sign, y, y_sign, zpower, tmpreal, &tmpreal_sign, tmpimag, &tmpimag_sign, frac_limbs);
+	while (i < maxiter && mpn_cmp (sqrsum + frac_limbs, mp_four, INT_LIMBS) < 0) {
+		mp_limb_t tmpreal[total_limbs], tmpimag[total_limbs];
+		if (state->interior_check || distance_est) {
+			mandel_fp_t treal, timag;
+			complex_pow_fp (xfp, yfp, zpower - 1, &treal, &timag);
+			if (state->interior_check) {
+				interior_track (xfp, yfp, der_x, der_y, &rho_z, &rho_d);
+				mandel_fp_t new_der_x = (mandel_fp_t) zpower * (treal * der_x - timag * der_y);
+				der_y = (mandel_fp_t) zpower * (treal * der_y + timag * der_x);
+				der_x = new_der_x;
+			}
+			if (distance_est)
+				mp_derivative_step (&dz, (mandel_fp_t) zpower, treal, timag);
+		}
 
-		x_sign = my_mpn_add_signed (x, tmpreal, tmpreal_sign, preal, preal_sign, frac_limbs);
-		y_sign = my_mpn_add_signed (y, tmpimag, tmpimag_sign, pimag, pimag_sign, frac_limbs);
+		complex_pow (x, y, xsqr, ysqr, zpower, tmpreal, tmpimag, frac_limbs);
+		mpn_add_n (x, tmpreal, preal, total_limbs);
+		mpn_add_n (y, tmpimag, pimag, total_limbs);
+		if (state->interior_check || distance_est) {
+			xfp = my_mpn_get_fp (x, frac_limbs);
+			yfp = my_mpn_get_fp (y, frac_limbs);
+		}
 
 		k--;
-		/* FIXME we must compare the signs here! */
-		if (mpn_cmp (x, cd_x, total_limbs) == 0 && mpn_cmp (y, cd_y, total_limbs) == 0) {
+		if ((mpn_cmp (x, cd_x, total_limbs) == 0 && mpn_cmp (y, cd_y, total_limbs) == 0)
+				|| (state->interior_check && interior_returned (xfp, yfp, cd_xfp, cd_yfp, der_x, der_y, rho_z, rho_d))) {
 			//printf ("* Cycle of length %d detected after %u iterations.\n", m - k + 1, i);
-			// XXX iter_saved += maxiter - i;
+			state->iter_saved += maxiter - i;
 			i = maxiter;
 			break;
 		}
@@ -330,54 +435,22 @@ mandel_julia_zpower (struct mandel_julia_state *state, const struct mandel_julia
 			k = m <<= 1;
 			memcpy (cd_x, x, sizeof (x));
 			memcpy (cd_y, y, sizeof (y));
+			cd_xfp = xfp;
+			cd_yfp = yfp;
+			der_x = 1.0;
+			der_y = 0.0;
+			rho_z = HUGE_VAL;
+			rho_d = 1.0;
 		}
 
-		my_mpn_mul_fast (xsqr, x, x, frac_limbs);
-		my_mpn_mul_fast (ysqr, y, y, frac_limbs);
+		my_mpn_ssqr_fast (xsqr, x, frac_limbs);
+		my_mpn_ssqr_fast (ysqr, y, frac_limbs);
 		mpn_add_n (sqrsum, xsqr, ysqr, total_limbs);
 
 		i++;
 	}
-	if (distance_est) {
-		mpf_t xf, yf;
-		mpf_init2 (xf, total_limbs * GMP_NUMB_BITS);
-		mpf_init2 (yf, total_limbs * GMP_NUMB_BITS);
-		my_mpn_get_mpf (xf, x, x_sign, frac_limbs);
-		my_mpn_get_mpf (yf, y, y_sign, frac_limbs);
-		mpf_mul (xf, xf, xf);
-		mpf_mul (yf, yf, yf);
-		mpf_add (xf, xf, yf);
-		mpf_sqrt (xf, xf);
-		//double zabs = mpf_get_d (xf);
-		mpfr_t zabs;
-		mpfr_init2 (zabs, 1024); /* XXX */
-		mpfr_set_f (zabs, xf, GMP_RNDN);
-		mpf_mul (dx, dx, dx);
-		mpf_mul (dy, dy, dy);
-		mpf_add (dx, dx, dy);
-		mpf_sqrt (dx, dx);
-		//double dzabs = mpf_get_d (dxf);
-		mpfr_t dzabs;
-		mpfr_init2 (dzabs, 1024); /* XXX */
-		mpfr_set_f (dzabs, dx, GMP_RNDN);
-		//double distance = log (zabs * zabs) * zabs / dzabs;
-		mpfr_sqr (distance, zabs, GMP_RNDN);
-		mpfr_log (distance, distance, GMP_RNDN);
-		mpfr_mul (distance, distance, zabs, GMP_RNDN);
-		mpfr_div (distance, distance, dzabs, GMP_RNDN);
-
-		mpf_clear (xf);
-		mpf_clear (yf);
-		mpf_clear (dx);
-		mpf_clear (dy);
-		mpf_clear (new_dx);
-		mpf_clear (new_dy);
-		mpf_clear (ftmpreal);
-		mpf_clear (ftmpimag);
-		mpf_clear (ftmp1);
-		mpfr_clear (zabs);
-		mpfr_clear (dzabs);
-	}
+	if (distance_est)
+		mp_derivative_distance (distance, xfp, yfp, &dz);
 	return i;
 }
 
@@ -386,22 +459,29 @@ static unsigned
 mandel_julia_z2_fp (struct mandel_julia_state *state, const struct mandel_julia_param *param, mandel_fp_t x0, mandel_fp_t y0, mandel_fp_t preal, mandel_fp_t pimag, mandel_fp_t *distance)
 {
 	const bool distance_est = (state->flags & FRAC_TYPE_DISTANCE) != 0;
+	const bool interior = state->interior_check;
 	const unsigned maxiter = param->maxiter;
 	unsigned i = 0, k = 1, m = 1;
-	mandel_fp_t x = x0, y = y0, cd_x = x, cd_y = y, dx = 0.0, dy = 0.0;
+	mandel_fp_t x = x0, y = y0, cd_x = x, cd_y = y, dx = 0.0, dy = 0.0, der_x = 1.0, der_y = 0.0, rho_z = HUGE_VAL, rho_d = 1.0;
 	while (i < maxiter && x * x + y * y < 4.0) {
 		if (distance_est) {
 			mandel_fp_t dxnew = 2.0 * (dx * x - dy * y) + 1.0;
 			dy = 2.0 * (dx * y + dy * x);
 			dx = dxnew;
 		}
+		if (interior) {
+			interior_track (x, y, der_x, der_y, &rho_z, &rho_d);
+			mandel_fp_t new_der_x = 2.0 * (der_x * x - der_y * y);
+			der_y = 2.0 * (der_x * y + der_y * x);
+			der_x = new_der_x;
+		}
 		mandel_fp_t xold = x, yold = y;
 		x = x * x - y * y + preal;
 		y = 2 * xold * yold + pimag;
 
 		k--;
-		if (x == cd_x && y == cd_y) {
-			// XXX iter_saved += maxiter - i;
+		if ((x == cd_x && y == cd_y) || (interior && interior_returned (x, y, cd_x, cd_y, der_x, der_y, rho_z, rho_d))) {
+			state->iter_saved += maxiter - i;
 			i = maxiter;
 			break;
 		}
@@ -410,14 +490,16 @@ mandel_julia_z2_fp (struct mandel_julia_state *state, const struct mandel_julia_
 			k = m <<= 1;
 			cd_x = x;
 			cd_y = y;
+			der_x = 1.0;
+			der_y = 0.0;
+			rho_z = HUGE_VAL;
+			rho_d = 1.0;
 		}
 
 		i++;
 	}
 	if (distance_est) {
-		mandel_fp_t zabs = sqrt (x * x + y * y);
-		mandel_fp_t dzabs = sqrt (dx * dx + dy * dy);
-		*distance = log (zabs * zabs) * zabs / dzabs;
+		*distance = distance_estimate_fp (x, y, dx, dy);
 #if 0
 		const mandel_fp_t kk = 12.353265; /* 256.0 / log (1e9) */
 		int idx = ((int) round (-kk * log (fabs (distance)))) % 256;
@@ -435,17 +517,26 @@ static unsigned
 mandel_julia_zpower_fp (struct mandel_julia_state *state, const struct mandel_julia_param *param, mandel_fp_t x0, mandel_fp_t y0, mandel_fp_t preal, mandel_fp_t pimag, mandel_fp_t *distance)
 {
 	const bool distance_est = (state->flags & FRAC_TYPE_DISTANCE) != 0;
+	const bool interior = state->interior_check;
 	const unsigned maxiter = param->maxiter;
 	const unsigned zpower = param->zpower;
 	unsigned i = 0, k = 1, m = 1;
-	mandel_fp_t x = x0, y = y0, cd_x = x, cd_y = y, dx = 0.0, dy = 0.0;
+	mandel_fp_t x = x0, y = y0, cd_x = x, cd_y = y, dx = 0.0, dy = 0.0, der_x = 1.0, der_y = 0.0, rho_z = HUGE_VAL, rho_d = 1.0;
 	while (i < maxiter && x * x + y * y < 4.0) {
-		if (distance_est) {
+		if (distance_est || interior) {
 			mandel_fp_t treal, timag;
 			complex_pow_fp (x, y, zpower - 1, &treal, &timag);
-			mandel_fp_t new_dx = (mandel_fp_t) zpower * (treal * dx - timag * dy) + 1.0;
-			dy = (mandel_fp_t) zpower * (treal * dy + timag * dx);
-			dx = new_dx;
+			if (distance_est) {
+				mandel_fp_t new_dx = (mandel_fp_t) zpower * (treal * dx - timag * dy) + 1.0;
+				dy = (mandel_fp_t) zpower * (treal * dy + timag * dx);
+				dx = new_dx;
+			}
+			if (interior) {
+				interior_track (x, y, der_x, der_y, &rho_z, &rho_d);
+				mandel_fp_t new_der_x = (mandel_fp_t) zpower * (treal * der_x - timag * der_y);
+				der_y = (mandel_fp_t) zpower * (treal * der_y + timag * der_x);
+				der_x = new_der_x;
+			}
 			mandel_fp_t new_x = treal * x - timag * y;
 			y = treal * y + timag * x;
 			x = new_x;
@@ -456,8 +547,8 @@ mandel_julia_zpower_fp (struct mandel_julia_state *state, const struct mandel_ju
 		y += pimag;
 
 		k--;
-		if (x == cd_x && y == cd_y) {
-			// XXX iter_saved += maxiter - i;
+		if ((x == cd_x && y == cd_y) || (interior && interior_returned (x, y, cd_x, cd_y, der_x, der_y, rho_z, rho_d))) {
+			state->iter_saved += maxiter - i;
 			i = maxiter;
 			break;
 		}
@@ -466,29 +557,171 @@ mandel_julia_zpower_fp (struct mandel_julia_state *state, const struct mandel_ju
 			k = m <<= 1;
 			cd_x = x;
 			cd_y = y;
+			der_x = 1.0;
+			der_y = 0.0;
+			rho_z = HUGE_VAL;
+			rho_d = 1.0;
 		}
 
 		i++;
 	}
 	if (distance_est) {
-		mandel_fp_t zabs = sqrt (x * x + y * y);
-		mandel_fp_t dzabs = sqrt (dx * dx + dy * dy);
-		*distance = log (zabs * zabs) * zabs / dzabs;
+		*distance = distance_estimate_fp (x, y, dx, dy);
+	}
+	return i;
+}
+
+
+/*
+ * Points which escape right away still have dz = 0, so there is no
+ * estimate for them. They get a distance of 0 instead of a division by 0.
+ */
+static mandel_fp_t
+distance_estimate_fp (mandel_fp_t x, mandel_fp_t y, mandel_fp_t dx, mandel_fp_t dy)
+{
+	mandel_fp_t zabs = sqrt (x * x + y * y);
+	mandel_fp_t dzabs = sqrt (dx * dx + dy * dy);
+	if (dzabs == 0.0)
+		return 0.0;
+	return log (zabs * zabs) * zabs / dzabs;
+}
+
+
+/*
+ * Double-double versions of mandel_julia_z2_fp() and
+ * mandel_julia_zpower_fp(). The derivative for distance estimation is
+ * calculated in FP only, as it doesn't need more than that.
+ */
+static unsigned
+mandel_julia_z2_dd (struct mandel_julia_state *state, const struct mandel_julia_param *param, const mandel_dd_t *x0, const mandel_dd_t *y0, const mandel_dd_t *preal, const mandel_dd_t *pimag, mandel_fp_t *distance)
+{
+	const bool distance_est = (state->flags & FRAC_TYPE_DISTANCE) != 0;
+	const bool interior = state->interior_check;
+	const unsigned maxiter = param->maxiter;
+	unsigned i = 0, k = 1, m = 1;
+	mandel_dd_t x = *x0, y = *y0, cd_x = x, cd_y = y, xsqr, ysqr;
+	mandel_fp_t dx = 0.0, dy = 0.0, der_x = 1.0, der_y = 0.0, rho_z = HUGE_VAL, rho_d = 1.0;
+	while (i < maxiter && (xsqr = dd_sqr (x)).hi + (ysqr = dd_sqr (y)).hi < 4.0) {
+		if (distance_est) {
+			mandel_fp_t dxnew = 2.0 * (dx * x.hi - dy * y.hi) + 1.0;
+			dy = 2.0 * (dx * y.hi + dy * x.hi);
+			dx = dxnew;
+		}
+		if (interior) {
+			interior_track (x.hi, y.hi, der_x, der_y, &rho_z, &rho_d);
+			mandel_fp_t new_der_x = 2.0 * (der_x * x.hi - der_y * y.hi);
+			der_y = 2.0 * (der_x * y.hi + der_y * x.hi);
+			der_x = new_der_x;
+		}
+		y = dd_add (dd_mul_pwr2 (dd_mul (x, y), 2.0), *pimag);
+		x = dd_add (dd_sub (xsqr, ysqr), *preal);
+
+		k--;
+		if ((dd_eq (x, cd_x) && dd_eq (y, cd_y)) || (interior && interior_returned (x.hi, y.hi, cd_x.hi, cd_y.hi, der_x, der_y, rho_z, rho_d))) {
+			state->iter_saved += maxiter - i;
+			i = maxiter;
+			break;
+		}
+
+		if (k == 0) {
+			k = m <<= 1;
+			cd_x = x;
+			cd_y = y;
+			der_x = 1.0;
+			der_y = 0.0;
+			rho_z = HUGE_VAL;
+			rho_d = 1.0;
+		}
+
+		i++;
 	}
+	if (distance_est)
+		*distance = distance_estimate_fp (x.hi, y.hi, dx, dy);
+	return i;
+}
+
+
+static unsigned
+mandel_julia_zpower_dd (struct mandel_julia_state *state, const struct mandel_julia_param *param, const mandel_dd_t *x0, const mandel_dd_t *y0, const mandel_dd_t *preal, const mandel_dd_t *pimag, mandel_fp_t *distance)
+{
+	const bool distance_est = (state->flags & FRAC_TYPE_DISTANCE) != 0;
+	const bool interior = state->interior_check;
+	const unsigned maxiter = param->maxiter;
+	const unsigned zpower = param->zpower;
+	unsigned i = 0, k = 1, m = 1;
+	mandel_dd_t x = *x0, y = *y0, cd_x = x, cd_y = y;
+	mandel_fp_t dx = 0.0, dy = 0.0, der_x = 1.0, der_y = 0.0, rho_z = HUGE_VAL, rho_d = 1.0;
+	while (i < maxiter && x.hi * x.hi + y.hi * y.hi < 4.0) {
+		if (distance_est || interior) {
+			mandel_dd_t treal, timag;
+			dd_complex_pow (x, y, zpower - 1, &treal, &timag);
+			if (distance_est) {
+				mandel_fp_t new_dx = (mandel_fp_t) zpower * (treal.hi * dx - timag.hi * dy) + 1.0;
+				dy = (mandel_fp_t) zpower * (treal.hi * dy + timag.hi * dx);
+				dx = new_dx;
+			}
+			if (interior) {
+				interior_track (x.hi, y.hi, der_x, der_y, &rho_z, &rho_d);
+				mandel_fp_t new_der_x = (mandel_fp_t) zpower * (treal.hi * der_x - timag.hi * der_y);
+				der_y = (mandel_fp_t) zpower * (treal.hi * der_y + timag.hi * der_x);
+				der_x = new_der_x;
+			}
+			mandel_dd_t new_x = dd_sub (dd_mul (treal, x), dd_mul (timag, y));
+			y = dd_add (dd_mul (treal, y), dd_mul (timag, x));
+			x = new_x;
+		} else
+			dd_complex_pow (x, y, zpower, &x, &y);
+
+		x = dd_add (x, *preal);
+		y = dd_add (y, *pimag);
+
+		k--;
+		if ((dd_eq (x, cd_x) && dd_eq (y, cd_y)) || (interior && interior_returned (x.hi, y.hi, cd_x.hi, cd_y.hi, der_x, der_y, rho_z, rho_d))) {
+			state->iter_saved += maxiter - i;
+			i = maxiter;
+			break;
+		}
+
+		if (k == 0) {
+			k = m <<= 1;
+			cd_x = x;
+			cd_y = y;
+			der_x = 1.0;
+			der_y = 0.0;
+			rho_z = HUGE_VAL;
+			rho_d = 1.0;
+		}
+
+		i++;
+	}
+	if (distance_est)
+		*distance = distance_estimate_fp (x.hi, y.hi, dx, dy);
 	return i;
 }
 
 
 static bool
-mandel_julia (struct mandel_julia_state *state, const struct mandel_julia_param *param, mpf_srcptr x0f, mpf_srcptr y0f, mpf_srcptr prealf, mpf_srcptr pimagf, unsigned *iter, mpfr_ptr distance)
+mandel_julia_dd (struct mandel_julia_state *state, const struct mandel_julia_param *param, const mandel_dd_t *x0, const mandel_dd_t *y0, const mandel_dd_t *preal, const mandel_dd_t *pimag, unsigned *iter, mandel_fp_t *distance)
 {
 	unsigned my_iter = 0;
 	if (param->zpower == 2)
-		my_iter = mandel_julia_z2 (state, param, x0f, y0f, prealf, pimagf, distance);
+		my_iter = mandel_julia_z2_dd (state, param, x0, y0, preal, pimag, distance);
 	else
-		my_iter = mandel_julia_zpower (state, param, x0f, y0f, prealf, pimagf, distance);
-	if (state->flags & FRAC_TYPE_ESCAPE_ITER)
-		*iter = my_iter;
+		my_iter = mandel_julia_zpower_dd (state, param, x0, y0, preal, pimag, distance);
+	*iter = my_iter;
+	return my_iter == param->maxiter;
+}
+
+
+static bool
+mandel_julia (struct mandel_julia_state *state, const struct mandel_julia_param *param, mp_srcptr x0, mp_srcptr y0, mp_srcptr preal, mp_srcptr pimag, unsigned *iter, mandel_fe_t *distance)
+{
+	unsigned my_iter = 0;
+	if (param->zpower == 2)
+		my_iter = mandel_julia_z2 (state, param, x0, y0, preal, pimag, distance);
+	else
+		my_iter = mandel_julia_zpower (state, param, x0, y0, preal, pimag, distance);
+	*iter = my_iter;
 	return my_iter == param->maxiter;
 }
 
@@ -501,12 +734,611 @@ mandel_julia_fp (struct mandel_julia_state *state, const struct mandel_julia_par
 		my_iter = mandel_julia_z2_fp (state, param, x0, y0, preal, pimag, distance);
 	else
 		my_iter = mandel_julia_zpower_fp (state, param, x0, y0, preal, pimag, distance);
-	if (state->flags & FRAC_TYPE_ESCAPE_ITER)
-		*iter = my_iter;
+	*iter = my_iter;
 	return my_iter == param->maxiter;
 }
 
 
+static void
+mandel_julia_fp_batch (struct mandel_julia_state *state, const struct mandel_julia_param *param, bool julia, mandel_fp_t preal, mandel_fp_t pimag, const mandel_fp_t *x0, const mandel_fp_t *y0, unsigned n, unsigned *iter, mandel_fp_t *distance, bool *inside)
+{
+	const bool distance_est = (state->flags & FRAC_TYPE_DISTANCE) != 0;
+	uint64_t saved;
+	unsigned i;
+	if (param->zpower == 2)
+		saved = mandel_julia_z2_fp_batch (param->maxiter, julia, state->interior_check, preal, pimag, x0, y0, n, iter, distance_est ? distance : NULL);
+	else
+		saved = mandel_julia_zpower_fp_batch (param->maxiter, param->zpower, julia, state->interior_check, preal, pimag, x0, y0, n, iter, distance_est ? distance : NULL);
+	state->iter_saved += saved;
+	for (i = 0; i < n; i++)
+		inside[i] = iter[i] == param->maxiter;
+}
+
+
+/*
+ * Calculate a reference orbit with full precision, starting at the primary
+ * reference point plus the given offsets. The orbit is stored in FP, which
+ * is all we need for perturbation.
+ */
+static struct perturb_orbit *
+perturb_orbit_new (struct mandel_julia_state *state, const struct mandel_julia_param *param, mandel_fe_t dx0, mandel_fe_t dy0, mandel_fe_t dpreal, mandel_fe_t dpimag)
+{
+	const struct perturb_state *pstate = state->perturb;
+	const unsigned frac_limbs = state->frac_limbs + PERTURB_GUARD_LIMBS;
+	const unsigned total_limbs = INT_LIMBS + frac_limbs;
+	const unsigned maxiter = param->maxiter;
+	const unsigned zpower = param->zpower;
+	mp_limb_t x[total_limbs], y[total_limbs], preal[total_limbs], pimag[total_limbs];
+	mp_limb_t xsqr[total_limbs], ysqr[total_limbs], sqrsum[total_limbs];
+	mp_limb_t tmpreal[total_limbs], tmpimag[total_limbs];
+	struct perturb_orbit *orbit;
+	mpf_t ftmp;
+	unsigned i;
+
+	orbit = malloc (sizeof (*orbit) + (maxiter + 1) * sizeof (orbit->points[0]));
+	orbit->next = NULL;
+	orbit->z0_real = dx0;
+	orbit->z0_imag = dy0;
+	orbit->c_real = dpreal;
+	orbit->c_imag = dpimag;
+
+	mpf_init2 (ftmp, total_limbs * GMP_NUMB_BITS);
+	mpf_set_fe (ftmp, &dx0);
+	mpf_add (ftmp, ftmp, pstate->z0_real);
+	my_mpf_get_mpn (x, ftmp, frac_limbs);
+	mpf_set_fe (ftmp, &dy0);
+	mpf_add (ftmp, ftmp, pstate->z0_imag);
+	my_mpf_get_mpn (y, ftmp, frac_limbs);
+	mpf_set_fe (ftmp, &dpreal);
+	mpf_add (ftmp, ftmp, pstate->c_real);
+	my_mpf_get_mpn (preal, ftmp, frac_limbs);
+	mpf_set_fe (ftmp, &dpimag);
+	mpf_add (ftmp, ftmp, pstate->c_imag);
+	my_mpf_get_mpn (pimag, ftmp, frac_limbs);
+	mpf_clear (ftmp);
+
+	/*
+	 * No cycle detection here: The points of the orbit are needed
+	 * up to maxiter for interior points.
+	 */
+	i = 0;
+	while (true) {
+		struct perturb_point *point = &orbit->points[i];
+		my_mpn_ssqr_fast (xsqr, x, frac_limbs);
+		my_mpn_ssqr_fast (ysqr, y, frac_limbs);
+		mpn_add_n (sqrsum, xsqr, ysqr, total_limbs);
+		point->real = my_mpn_get_fp (x, frac_limbs);
+		point->imag = my_mpn_get_fp (y, frac_limbs);
+		point->glitch = PERTURB_GLITCH_TOLERANCE * (point->real * point->real + point->imag * point->imag);
+		if (i == maxiter || mpn_cmp (sqrsum + frac_limbs, mp_four, INT_LIMBS) >= 0)
+			break;
+
+		complex_pow (x, y, xsqr, ysqr, zpower, tmpreal, tmpimag, frac_limbs);
+		mpn_add_n (x, tmpreal, preal, total_limbs);
+		mpn_add_n (y, tmpimag, pimag, total_limbs);
+		i++;
+	}
+	orbit->length = i;
+
+	return realloc (orbit, sizeof (*orbit) + (i + 1) * sizeof (orbit->points[0]));
+}
+
+
+/*
+ * Iterate the offset (dx, dy) from the given reference orbit, starting at
+ * iteration i:
+ * delta' = (Z + delta)^zpower - Z^zpower + dc
+ * This only works as long as the reference orbit is "close enough" to the
+ * point, otherwise PERTURB_GLITCH is returned and *iter is not touched.
+ * Interior checking starts at iteration i, the orbit before that is not
+ * known point by point.
+ */
+static perturb_result_t
+mandel_julia_perturb_orbit (struct mandel_julia_state *state, const struct mandel_julia_param *param, const struct perturb_orbit *orbit, unsigned i, mandel_fp_t dx, mandel_fp_t dy, mandel_fp_t der_x, mandel_fp_t der_y, mandel_fp_t dpreal, mandel_fp_t dpimag, unsigned *iter, mandel_fp_t *distance)
+{
+	const bool distance_est = (state->flags & FRAC_TYPE_DISTANCE) != 0;
+	const unsigned maxiter = param->maxiter;
+	const unsigned zpower = param->zpower;
+	const unsigned *binomial = state->perturb->binomial;
+	const unsigned length = orbit->length;
+	const struct perturb_point *points = orbit->points;
+	struct perturb_interior pint = {1.0, 0.0, 0.0, 0.0, HUGE_VAL, 1.0, 1, 1};
+	mandel_fp_t x = 0.0, y = 0.0;
+
+	while (i < maxiter) {
+		const struct perturb_point *point = &points[i];
+		x = point->real + dx;
+		y = point->imag + dy;
+		const mandel_fp_t sqrsum = x * x + y * y;
+		if (sqrsum >= 4.0)
+			break;
+		if (i == length || sqrsum < point->glitch)
+			return PERTURB_GLITCH;
+
+		if (state->interior_check && perturb_interior_step (&pint, zpower, x, y)) {
+			state->iter_saved += maxiter - i;
+			*iter = maxiter;
+			return PERTURB_OK;
+		}
+
+		if (zpower == 2) {
+			if (distance_est) {
+				mandel_fp_t new_der_x = 2.0 * (der_x * x - der_y * y) + 1.0;
+				der_y = 2.0 * (der_x * y + der_y * x);
+				der_x = new_der_x;
+			}
+			/* delta' = (2 * Z + delta) * delta + dc */
+			const mandel_fp_t treal = 2.0 * point->real + dx, timag = 2.0 * point->imag + dy;
+			const mandel_fp_t new_dx = treal * dx - timag * dy + dpreal;
+			dy = treal * dy + timag * dx + dpimag;
+			dx = new_dx;
+		} else {
+			if (distance_est) {
+				mandel_fp_t treal, timag;
+				complex_pow_fp (x, y, zpower - 1, &treal, &timag);
+				mandel_fp_t new_der_x = (mandel_fp_t) zpower * (treal * der_x - timag * der_y) + 1.0;
+				der_y = (mandel_fp_t) zpower * (treal * der_y + timag * der_x);
+				der_x = new_der_x;
+			}
+			/*
+			 * Binomial expansion, sum (k = 1 .. zpower) of
+			 * binomial(zpower, k) * Z^(zpower - k) * delta^k,
+			 * evaluated by Horner's scheme in delta.
+			 */
+			mandel_fp_t accreal = 1.0, accimag = 0.0, zpreal = point->real, zpimag = point->imag;
+			unsigned k;
+			for (k = zpower - 1; k >= 1; k--) {
+				const mandel_fp_t new_accreal = accreal * dx - accimag * dy + binomial[k] * zpreal;
+				accimag = accreal * dy + accimag * dx + binomial[k] * zpimag;
+				accreal = new_accreal;
+				const mandel_fp_t new_zpreal = zpreal * point->real - zpimag * point->imag;
+				zpimag = zpreal * point->imag + zpimag * point->real;
+				zpreal = new_zpreal;
+			}
+			const mandel_fp_t new_dx = accreal * dx - accimag * dy + dpreal;
+			dy = accreal * dy + accimag * dx + dpimag;
+			dx = new_dx;
+		}
+		i++;
+	}
+
+	if (distance_est) {
+		if (i == maxiter) {
+			x = points[i].real + dx;
+			y = points[i].imag + dy;
+		}
+		*distance = distance_estimate_fp (x, y, der_x, der_y);
+	}
+	*iter = i;
+	return PERTURB_OK;
+}
+
+
+/*
+ * Same as mandel_julia_perturb_orbit(), with floatexp offsets. The reference
+ * orbit itself is well within FP range, so only the offsets (and the
+ * derivative) need floatexp.
+ */
+static perturb_result_t
+mandel_julia_perturb_orbit_fe (struct mandel_julia_state *state, const struct mandel_julia_param *param, const struct perturb_orbit *orbit, unsigned i, mandel_fe_t dx, mandel_fe_t dy, mandel_fe_t der_x, mandel_fe_t der_y, mandel_fe_t dpreal, mandel_fe_t dpimag, unsigned *iter, mandel_fe_t *distance)
+{
+	const bool distance_est = (state->flags & FRAC_TYPE_DISTANCE) != 0;
+	const unsigned maxiter = param->maxiter;
+	const unsigned zpower = param->zpower;
+	const unsigned *binomial = state->perturb->binomial;
+	const unsigned length = orbit->length;
+	const struct perturb_point *points = orbit->points;
+	const mandel_fe_t one = fe_set_d (1.0);
+	struct perturb_interior pint = {1.0, 0.0, 0.0, 0.0, HUGE_VAL, 1.0, 1, 1};
+	mandel_fp_t x = 0.0, y = 0.0;
+
+	while (i < maxiter) {
+		const struct perturb_point *point = &points[i];
+		x = point->real + fe_get_d (dx);
+		y = point->imag + fe_get_d (dy);
+		const mandel_fp_t sqrsum = x * x + y * y;
+		if (sqrsum >= 4.0)
+			break;
+		if (i == length || sqrsum < point->glitch)
+			return PERTURB_GLITCH;
+
+		/* The orbit itself is in FP range, so interior checking works in FP. */
+		if (state->interior_check && perturb_interior_step (&pint, zpower, x, y)) {
+			state->iter_saved += maxiter - i;
+			*iter = maxiter;
+			return PERTURB_OK;
+		}
+
+		/* Offsets back in FP range, the rest can be done in FP. */
+		if (!distance_est && (dx.exp > PERTURB_FE_SWITCH_EXP || dy.exp > PERTURB_FE_SWITCH_EXP))
+			return mandel_julia_perturb_orbit (state, param, orbit, i, fe_get_d (dx), fe_get_d (dy), 0.0, 0.0, fe_get_d (dpreal), fe_get_d (dpimag), iter, NULL);
+
+		mandel_fe_t new_dx, new_dy;
+		if (zpower == 2) {
+			if (distance_est) {
+				fe_complex_mul (der_x, der_y, fe_set_d (x), fe_set_d (y), &der_x, &der_y);
+				der_x = fe_add (fe_mul_2exp (der_x, 1), one);
+				der_y = fe_mul_2exp (der_y, 1);
+			}
+			/* delta' = (2 * Z + delta) * delta + dc */
+			const mandel_fe_t treal = fe_add (fe_set_d (2.0 * point->real), dx);
+			const mandel_fe_t timag = fe_add (fe_set_d (2.0 * point->imag), dy);
+			fe_complex_mul (treal, timag, dx, dy, &new_dx, &new_dy);
+		} else {
+			if (distance_est) {
+				mandel_fp_t treal, timag;
+				complex_pow_fp (x, y, zpower - 1, &treal, &timag);
+				fe_complex_mul (der_x, der_y, fe_set_d (treal), fe_set_d (timag), &der_x, &der_y);
+				der_x = fe_add (fe_mul_d (der_x, (mandel_fp_t) zpower), one);
+				der_y = fe_mul_d (der_y, (mandel_fp_t) zpower);
+			}
+			/* Same binomial expansion as in mandel_julia_perturb_orbit() */
+			mandel_fe_t accreal = one, accimag = fe_set_d (0.0);
+			mandel_fp_t zpreal = point->real, zpimag = point->imag;
+			unsigned k;
+			for (k = zpower - 1; k >= 1; k--) {
+				fe_complex_mul (accreal, accimag, dx, dy, &accreal, &accimag);
+				fe_complex_add (accreal, accimag, fe_set_d (binomial[k] * zpreal), fe_set_d (binomial[k] * zpimag), &accreal, &accimag);
+				const mandel_fp_t new_zpreal = zpreal * point->real - zpimag * point->imag;
+				zpimag = zpreal * point->imag + zpimag * point->real;
+				zpreal = new_zpreal;
+			}
+			fe_complex_mul (accreal, accimag, dx, dy, &new_dx, &new_dy);
+		}
+		fe_complex_add (new_dx, new_dy, dpreal, dpimag, &dx, &dy);
+		i++;
+	}
+
+	if (distance_est) {
+		if (i == maxiter) {
+			x = points[i].real + fe_get_d (dx);
+			y = points[i].imag + fe_get_d (dy);
+		}
+		mandel_fp_t zabs = sqrt (x * x + y * y);
+		const mandel_fe_t dzabs = fe_complex_abs (der_x, der_y);
+		*distance = dzabs.mant == 0.0 ? fe_set_d (0.0) : fe_div (fe_set_d (log (zabs * zabs) * zabs), dzabs);
+	}
+	*iter = i;
+	return PERTURB_OK;
+}
+
+
+/*
+ * Interior checking for the orbit point z = (x, y), before it is iterated.
+ * Returns true if the point is considered inside.
+ */
+static inline bool
+perturb_interior_step (struct perturb_interior *pint, unsigned zpower, mandel_fp_t x, mandel_fp_t y)
+{
+	if (interior_returned (x, y, pint->cd_x, pint->cd_y, pint->der_x, pint->der_y, pint->rho_z, pint->rho_d))
+		return true;
+	if (--pint->k == 0) {
+		pint->k = pint->m <<= 1;
+		pint->cd_x = x;
+		pint->cd_y = y;
+		pint->der_x = 1.0;
+		pint->der_y = 0.0;
+		pint->rho_z = HUGE_VAL;
+		pint->rho_d = 1.0;
+	}
+	interior_track (x, y, pint->der_x, pint->der_y, &pint->rho_z, &pint->rho_d);
+
+	mandel_fp_t treal = x, timag = y;
+	if (zpower != 2)
+		complex_pow_fp (x, y, zpower - 1, &treal, &timag);
+	const mandel_fp_t new_der_x = (mandel_fp_t) zpower * (treal * pint->der_x - timag * pint->der_y);
+	pint->der_y = (mandel_fp_t) zpower * (treal * pint->der_y + timag * pint->der_x);
+	pint->der_x = new_der_x;
+	return false;
+}
+
+
+/* Iterate along the orbit in FP or floatexp, as requested. */
+static perturb_result_t
+perturb_orbit_iterate (struct mandel_julia_state *state, const struct mandel_julia_param *param, bool floatexp, const struct perturb_orbit *orbit, unsigned i, mandel_fe_t dx, mandel_fe_t dy, mandel_fe_t der_x, mandel_fe_t der_y, mandel_fe_t dpreal, mandel_fe_t dpimag, unsigned *iter, mandel_fe_t *distance)
+{
+	mandel_fp_t fp_distance;
+	perturb_result_t r;
+	if (floatexp)
+		return mandel_julia_perturb_orbit_fe (state, param, orbit, i, dx, dy, der_x, der_y, dpreal, dpimag, iter, distance);
+	r = mandel_julia_perturb_orbit (state, param, orbit, i, fe_get_d (dx), fe_get_d (dy), fe_get_d (der_x), fe_get_d (der_y), fe_get_d (dpreal), fe_get_d (dpimag), iter, &fp_distance);
+	if (r == PERTURB_OK && (state->flags & FRAC_TYPE_DISTANCE))
+		*distance = fe_set_d (fp_distance);
+	return r;
+}
+
+
+static unsigned
+mandel_julia_perturb_reference (struct mandel_julia_state *state, const struct mandel_julia_param *param, mpf_srcptr x0f, mpf_srcptr y0f, mpf_srcptr prealf, mpf_srcptr pimagf, const mandel_fe_t *radius)
+{
+	const unsigned prec = (INT_LIMBS + state->frac_limbs + PERTURB_GUARD_LIMBS) * GMP_NUMB_BITS;
+	const mandel_fe_t zero = fe_set_d (0.0);
+	struct perturb_state *pstate;
+
+	perturb_state_free (state->perturb);
+	pstate = malloc (sizeof (*pstate));
+	memset (pstate, 0, sizeof (*pstate));
+	mpf_init2 (pstate->z0_real, prec);
+	mpf_init2 (pstate->z0_imag, prec);
+	mpf_init2 (pstate->c_real, prec);
+	mpf_init2 (pstate->c_imag, prec);
+	mpf_set (pstate->z0_real, x0f);
+	mpf_set (pstate->z0_imag, y0f);
+	mpf_set (pstate->c_real, prealf);
+	mpf_set (pstate->c_imag, pimagf);
+	pstate->binomial = pascal_triangle (param->zpower);
+	state->perturb = pstate;
+	pstate->primary = perturb_orbit_new (state, param, zero, zero, zero, zero);
+	return perturb_series_init (pstate, param, radius);
+}
+
+
+/*
+ * The offsets are given in floatexp. If floatexp is false, they are within
+ * FP range, and the iteration is done in FP.
+ */
+static bool
+mandel_julia_perturb (struct mandel_julia_state *state, const struct mandel_julia_param *param, mandel_fe_t dx0, mandel_fe_t dy0, mandel_fe_t dpreal, mandel_fe_t dpimag, bool floatexp, unsigned *iter, mandel_fe_t *distance)
+{
+	struct perturb_state *pstate = state->perturb;
+	const mandel_fe_t zero = fe_set_d (0.0);
+	struct perturb_orbit *orbit;
+	unsigned my_iter = 0, tries;
+	perturb_result_t r;
+
+	if (pstate->series_skip > 0) {
+		mandel_fe_t dx, dy, der_x, der_y;
+		perturb_series_eval (pstate, dx0, dy0, dpreal, dpimag, &dx, &dy, &der_x, &der_y);
+		r = perturb_orbit_iterate (state, param, floatexp, pstate->primary, pstate->series_skip, dx, dy, der_x, der_y, dpreal, dpimag, &my_iter, distance);
+	} else
+		r = perturb_orbit_iterate (state, param, floatexp, pstate->primary, 0, dx0, dy0, zero, zero, dpreal, dpimag, &my_iter, distance);
+
+	/* Glitch: Try again with the reference orbits we already have. */
+	orbit = g_atomic_pointer_get (&pstate->orbits);
+	for (tries = 0; r == PERTURB_GLITCH && orbit != NULL && tries < PERTURB_MAX_TRIES; tries++, orbit = orbit->next)
+		r = perturb_orbit_iterate (state, param, floatexp, orbit, 0, fe_sub (dx0, orbit->z0_real), fe_sub (dy0, orbit->z0_imag), zero, zero, fe_sub (dpreal, orbit->c_real), fe_sub (dpimag, orbit->c_imag), &my_iter, distance);
+
+	if (r == PERTURB_GLITCH) {
+		/*
+		 * Still no luck, use this point as a new reference.
+		 * The result for this point is exact then.
+		 */
+		orbit = perturb_orbit_new (state, param, dx0, dy0, dpreal, dpimag);
+		perturb_orbit_iterate (state, param, floatexp, orbit, 0, zero, zero, zero, zero, zero, zero, &my_iter, distance);
+		if (g_atomic_int_exchange_and_add (&pstate->orbit_count, 1) < PERTURB_MAX_ORBITS) {
+			do
+				orbit->next = g_atomic_pointer_get (&pstate->orbits);
+			while (!g_atomic_pointer_compare_and_exchange (&pstate->orbits, orbit->next, orbit));
+		} else
+			free (orbit);
+	}
+
+	*iter = my_iter;
+	return my_iter == param->maxiter;
+}
+
+
+static bool
+mandel_julia_perturb_fp (struct mandel_julia_state *state, const struct mandel_julia_param *param, mandel_fp_t dx0, mandel_fp_t dy0, mandel_fp_t dpreal, mandel_fp_t dpimag, unsigned *iter, mandel_fp_t *distance)
+{
+	mandel_fe_t fe_distance = fe_set_d (0.0);
+	bool inside = mandel_julia_perturb (state, param, fe_set_d (dx0), fe_set_d (dy0), fe_set_d (dpreal), fe_set_d (dpimag), false, iter, &fe_distance);
+	if (state->flags & FRAC_TYPE_DISTANCE)
+		*distance = fe_get_d (fe_distance);
+	return inside;
+}
+
+
+/* rop = op1 * op2, truncated to SERIES_ORDER. rop must not alias op1 or op2. */
+static void
+perturb_series_mul (struct perturb_series *rop, const struct perturb_series *op1, const struct perturb_series *op2)
+{
+	unsigned d1, i1, d2, i2;
+	memset (rop, 0, sizeof (*rop));
+	rop->exp = op1->exp + op2->exp;
+	for (d1 = 0; d1 <= SERIES_ORDER; d1++)
+		for (i1 = 0; i1 <= d1; i1++) {
+			const unsigned idx1 = SERIES_INDEX (i1, d1 - i1);
+			const mandel_fp_t re1 = op1->real[idx1], im1 = op1->imag[idx1];
+			if (re1 == 0.0 && im1 == 0.0)
+				continue;
+			for (d2 = 0; d1 + d2 <= SERIES_ORDER; d2++)
+				for (i2 = 0; i2 <= d2; i2++) {
+					const unsigned idx2 = SERIES_INDEX (i2, d2 - i2);
+					const unsigned idx = SERIES_INDEX (i1 + i2, d1 - i1 + d2 - i2);
+					rop->real[idx] += re1 * op2->real[idx2] - im1 * op2->imag[idx2];
+					rop->imag[idx] += re1 * op2->imag[idx2] + im1 * op2->real[idx2];
+				}
+		}
+	perturb_series_normalize (rop);
+}
+
+
+/* Scale the coefficients so the largest one is in [0.5, 1), this is exact. */
+static void
+perturb_series_normalize (struct perturb_series *series)
+{
+	mandel_fp_t max = 0.0;
+	unsigned k;
+	int shift;
+	for (k = 0; k < SERIES_TERMS; k++) {
+		max = fmax (max, fabs (series->real[k]));
+		max = fmax (max, fabs (series->imag[k]));
+	}
+	if (max == 0.0) {
+		series->exp = FE_ZERO_EXP;
+		return;
+	}
+	frexp (max, &shift);
+	if (shift == 0)
+		return;
+	for (k = 0; k < SERIES_TERMS; k++) {
+		series->real[k] = ldexp (series->real[k], -shift);
+		series->imag[k] = ldexp (series->imag[k], -shift);
+	}
+	series->exp += shift;
+}
+
+
+/* Add real + i * imag to the coefficient idx. */
+static void
+perturb_series_add (struct perturb_series *series, unsigned idx, mandel_fe_t real, mandel_fe_t imag)
+{
+	const int64_t exp = real.exp > imag.exp ? real.exp : imag.exp;
+	unsigned k;
+	if (exp > series->exp) {
+		/* Rescale to the exponent of the summand first. */
+		for (k = 0; k < SERIES_TERMS; k++) {
+			series->real[k] = fe_get_d (fe_set_2exp (series->real[k], series->exp - exp));
+			series->imag[k] = fe_get_d (fe_set_2exp (series->imag[k], series->exp - exp));
+		}
+		series->exp = exp;
+	}
+	series->real[idx] += fe_get_d (fe_mul_2exp (real, -series->exp));
+	series->imag[idx] += fe_get_d (fe_mul_2exp (imag, -series->exp));
+}
+
+
+/*
+ * Iterate the series along the primary orbit as long as it is accurate
+ * for all points within the given radius. Returns the number of iterations
+ * which can be skipped.
+ */
+static unsigned
+perturb_series_init (struct perturb_state *pstate, const struct mandel_julia_param *param, const mandel_fe_t *radius)
+{
+	const struct perturb_orbit *orbit = pstate->primary;
+	const unsigned zpower = param->zpower;
+	const unsigned *binomial = pstate->binomial;
+	struct perturb_series delta, next, acc, tmp;
+	unsigned n, k;
+
+	pstate->series_skip = 0;
+	pstate->series_radius = *radius;
+	if (!(radius->mant > 0.0))
+		return 0;
+
+	/* delta_0 = dz0 */
+	memset (&delta, 0, sizeof (delta));
+	delta.exp = radius->exp;
+	delta.real[SERIES_INDEX (1, 0)] = radius->mant;
+
+	for (n = 0; n < orbit->length && n < param->maxiter; n++) {
+		const struct perturb_point *point = &orbit->points[n];
+		mandel_fp_t zpreal = point->real, zpimag = point->imag;
+
+		/*
+		 * Same binomial expansion as in mandel_julia_perturb_orbit(),
+		 * with polynomials instead of numbers.
+		 */
+		memset (&acc, 0, sizeof (acc));
+		acc.real[0] = 1.0;
+		for (k = zpower - 1; k >= 1; k--) {
+			perturb_series_mul (&tmp, &acc, &delta);
+			perturb_series_add (&tmp, 0, fe_set_d (binomial[k] * zpreal), fe_set_d (binomial[k] * zpimag));
+			acc = tmp;
+			const mandel_fp_t new_zpreal = zpreal * point->real - zpimag * point->imag;
+			zpimag = zpreal * point->imag + zpimag * point->real;
+			zpreal = new_zpreal;
+		}
+		perturb_series_mul (&next, &acc, &delta);
+		perturb_series_add (&next, SERIES_INDEX (0, 1), *radius, fe_set_d (0.0));
+
+		/* Check the series for iteration n + 1. */
+		const struct perturb_point *next_point = &orbit->points[n + 1];
+		mandel_fp_t linear = 0.0, highest = 0.0, total = 0.0;
+		for (k = 0; k < SERIES_TERMS; k++) {
+			const mandel_fp_t a = hypot (next.real[k], next.imag[k]);
+			if (k >= SERIES_INDEX (1, 0) && k <= SERIES_INDEX (0, 1))
+				linear += a;
+			if (k >= SERIES_INDEX (SERIES_ORDER, 0))
+				highest += a;
+			total += a;
+		}
+		if (!(highest <= SERIES_TOLERANCE * linear))
+			break;
+		/* No point must escape during the skipped iterations. */
+		if (!(hypot (next_point->real, next_point->imag) + fe_get_d (fe_set_2exp (total, next.exp)) < 2.0))
+			break;
+
+		delta = next;
+	}
+
+	pstate->series = delta;
+	pstate->series_skip = n;
+	return n;
+}
+
+
+/*
+ * Evaluate the series for the given offsets, and its derivative with
+ * respect to dc, the latter being what the distance estimation uses.
+ * The offsets are scaled by 2^-exp of the radius, which makes no difference
+ * for the ratios below, but keeps them in FP range.
+ */
+static void
+perturb_series_eval (const struct perturb_state *pstate, mandel_fe_t dx0_fe, mandel_fe_t dy0_fe, mandel_fe_t dpreal_fe, mandel_fe_t dpimag_fe, mandel_fe_t *dx, mandel_fe_t *dy, mandel_fe_t *der_x, mandel_fe_t *der_y)
+{
+	const int64_t exp = pstate->series_radius.exp;
+	const mandel_fp_t radius = pstate->series_radius.mant;
+	const mandel_fp_t dx0 = fe_get_d (fe_mul_2exp (dx0_fe, -exp));
+	const mandel_fp_t dy0 = fe_get_d (fe_mul_2exp (dy0_fe, -exp));
+	const mandel_fp_t dpreal = fe_get_d (fe_mul_2exp (dpreal_fe, -exp));
+	const mandel_fp_t dpimag = fe_get_d (fe_mul_2exp (dpimag_fe, -exp));
+	const struct perturb_series *series = &pstate->series;
+	mandel_fp_t ureal[SERIES_ORDER + 1], uimag[SERIES_ORDER + 1], vreal[SERIES_ORDER + 1], vimag[SERIES_ORDER + 1];
+	mandel_fp_t rreal = 0.0, rimag = 0.0, drreal = 0.0, drimag = 0.0;
+	unsigned i, j;
+
+	ureal[0] = vreal[0] = 1.0;
+	uimag[0] = vimag[0] = 0.0;
+	for (i = 1; i <= SERIES_ORDER; i++) {
+		ureal[i] = (ureal[i - 1] * dx0 - uimag[i - 1] * dy0) / radius;
+		uimag[i] = (ureal[i - 1] * dy0 + uimag[i - 1] * dx0) / radius;
+		vreal[i] = (vreal[i - 1] * dpreal - vimag[i - 1] * dpimag) / radius;
+		vimag[i] = (vreal[i - 1] * dpimag + vimag[i - 1] * dpreal) / radius;
+	}
+
+	for (i = 0; i <= SERIES_ORDER; i++)
+		for (j = 0; i + j <= SERIES_ORDER; j++) {
+			const unsigned idx = SERIES_INDEX (i, j);
+			const mandel_fp_t treal = series->real[idx] * ureal[i] - series->imag[idx] * uimag[i];
+			const mandel_fp_t timag = series->real[idx] * uimag[i] + series->imag[idx] * ureal[i];
+			rreal += treal * vreal[j] - timag * vimag[j];
+			rimag += treal * vimag[j] + timag * vreal[j];
+			if (j > 0) {
+				drreal += j * (treal * vreal[j - 1] - timag * vimag[j - 1]);
+				drimag += j * (treal * vimag[j - 1] + timag * vreal[j - 1]);
+			}
+		}
+
+	*dx = fe_set_2exp (rreal, series->exp);
+	*dy = fe_set_2exp (rimag, series->exp);
+	*der_x = fe_set_2exp (drreal / radius, series->exp - exp);
+	*der_y = fe_set_2exp (drimag / radius, series->exp - exp);
+}
+
+
+static void
+perturb_state_free (struct perturb_state *pstate)
+{
+	struct perturb_orbit *orbit, *next;
+	if (pstate == NULL)
+		return;
+	mpf_clear (pstate->z0_real);
+	mpf_clear (pstate->z0_imag);
+	mpf_clear (pstate->c_real);
+	mpf_clear (pstate->c_imag);
+	free (pstate->binomial);
+	free (pstate->primary);
+	for (orbit = pstate->orbits; orbit != NULL; orbit = next) {
+		next = orbit->next;
+		free (orbit);
+	}
+	free (pstate);
+}
+
+
 void
 mandel_point_init (struct mandel_point *point)
 {
@@ -578,6 +1410,17 @@ mandelbrot_state_new (const void *param_, fractal_type_flags_t flags, unsigned f
 }
 
 
+static void *
+mandelbrot_state_clone (void *state_)
+{
+	struct mandelbrot_state *state = (struct mandelbrot_state *) state_;
+	struct mandelbrot_state *clone = malloc (sizeof (*clone));
+	*clone = *state;
+	mandel_julia_state_clone (&clone->mjstate, &state->mjstate);
+	return (void *) clone;
+}
+
+
 static void
 mandelbrot_state_free (void *state_)
 {
@@ -588,10 +1431,13 @@ mandelbrot_state_free (void *state_)
 
 
 static bool
-mandelbrot_compute (void *state_, mpf_srcptr real, mpf_srcptr imag, unsigned *iter, mpfr_ptr distance)
+mandelbrot_compute (void *state_, mp_srcptr real, mp_srcptr imag, unsigned *iter, mandel_fe_t *distance)
 {
 	struct mandelbrot_state *state = (struct mandelbrot_state *) state_;
 	const struct mandelbrot_param *param = state->param;
+	const unsigned frac_limbs = state->mjstate.frac_limbs;
+	if (mandelbrot_interior (state, my_mpn_get_fp (real, frac_limbs), my_mpn_get_fp (imag, frac_limbs), iter))
+		return true;
 	return mandel_julia (&state->mjstate, &param->mjparam, real, imag, real, imag, iter, distance);
 }
 
@@ -601,10 +1447,124 @@ mandelbrot_compute_fp (void *state_, mandel_fp_t real, mandel_fp_t imag, unsigne
 {
 	struct mandelbrot_state *state = (struct mandelbrot_state *) state_;
 	const struct mandelbrot_param *param = state->param;
+	if (mandelbrot_interior (state, real, imag, iter))
+		return true;
 	return mandel_julia_fp (&state->mjstate, &param->mjparam, real, imag, real, imag, iter, distance);
 }
 
 
+static void
+mandelbrot_compute_fp_batch (void *state_, const mandel_fp_t *real, const mandel_fp_t *imag, unsigned n, unsigned *iter, mandel_fp_t *distance, bool *inside)
+{
+	struct mandelbrot_state *state = (struct mandelbrot_state *) state_;
+	const struct mandelbrot_param *param = state->param;
+	mandel_fp_t rest_real[n], rest_imag[n], rest_distance[n];
+	unsigned rest_iter[n], idx[n];
+	bool rest_inside[n];
+	unsigned i, count = 0;
+
+	/* Only the points which are not known to be inside are iterated. */
+	for (i = 0; i < n; i++) {
+		if (mandelbrot_interior (state, real[i], imag[i], &iter[i])) {
+			iter[i] = param->mjparam.maxiter;
+			inside[i] = true;
+		} else {
+			rest_real[count] = real[i];
+			rest_imag[count] = imag[i];
+			idx[count++] = i;
+		}
+	}
+	if (count == 0)
+		return;
+
+	mandel_julia_fp_batch (&state->mjstate, &param->mjparam, false, 0.0, 0.0, rest_real, rest_imag, count, rest_iter, rest_distance, rest_inside);
+
+	for (i = 0; i < count; i++) {
+		iter[idx[i]] = rest_iter[i];
+		inside[idx[i]] = rest_inside[i];
+		if (distance != NULL)
+			distance[idx[i]] = rest_distance[i];
+	}
+}
+
+
+static bool
+mandelbrot_compute_dd (void *state_, const mandel_dd_t *real, const mandel_dd_t *imag, unsigned *iter, mandel_fp_t *distance)
+{
+	struct mandelbrot_state *state = (struct mandelbrot_state *) state_;
+	const struct mandelbrot_param *param = state->param;
+	if (mandelbrot_interior (state, real->hi, imag->hi, iter))
+		return true;
+	return mandel_julia_dd (&state->mjstate, &param->mjparam, real, imag, real, imag, iter, distance);
+}
+
+
+static unsigned
+mandelbrot_perturb_reference (void *state_, mpf_srcptr real, mpf_srcptr imag, const mandel_fe_t *radius)
+{
+	struct mandelbrot_state *state = (struct mandelbrot_state *) state_;
+	const struct mandelbrot_param *param = state->param;
+	return mandel_julia_perturb_reference (&state->mjstate, &param->mjparam, real, imag, real, imag, radius);
+}
+
+
+static bool
+mandelbrot_compute_perturb (void *state_, mandel_fp_t dreal, mandel_fp_t dimag, unsigned *iter, mandel_fp_t *distance)
+{
+	struct mandelbrot_state *state = (struct mandelbrot_state *) state_;
+	const struct mandelbrot_param *param = state->param;
+	return mandel_julia_perturb_fp (&state->mjstate, &param->mjparam, dreal, dimag, dreal, dimag, iter, distance);
+}
+
+
+static bool
+mandelbrot_compute_perturb_fe (void *state_, const mandel_fe_t *dreal, const mandel_fe_t *dimag, unsigned *iter, mandel_fe_t *distance)
+{
+	struct mandelbrot_state *state = (struct mandelbrot_state *) state_;
+	const struct mandelbrot_param *param = state->param;
+	return mandel_julia_perturb (&state->mjstate, &param->mjparam, *dreal, *dimag, *dreal, *dimag, true, iter, distance);
+}
+
+
+/*
+ * The main cardioid and the period-2 bulb make up most of the interior of
+ * the (quadratic) Mandelbrot set, and both have simple closed forms.
+ */
+static bool
+mandelbrot_interior (void *state_, mandel_fp_t real, mandel_fp_t imag, unsigned *iter)
+{
+	struct mandelbrot_state *state = (struct mandelbrot_state *) state_;
+	const struct mandelbrot_param *param = state->param;
+	bool inside;
+
+	if (param->mjparam.zpower != 2)
+		return false;
+
+	/* Period-2 bulb: the disk with radius 1/4 around -1 */
+	const mandel_fp_t xb = real + 1.0;
+	inside = xb * xb + imag * imag < 0.0625 - INTERIOR_MARGIN;
+
+	/* Main cardioid */
+	if (!inside) {
+		const mandel_fp_t xc = real - 0.25;
+		const mandel_fp_t q = xc * xc + imag * imag;
+		inside = q * (q + xc) < 0.25 * imag * imag - INTERIOR_MARGIN;
+	}
+
+	if (inside)
+		*iter = param->mjparam.maxiter;
+	return inside;
+}
+
+
+static uint64_t
+mandelbrot_saved_iterations (void *state_)
+{
+	struct mandelbrot_state *state = (struct mandelbrot_state *) state_;
+	return state->mjstate.iter_saved;
+}
+
+
 static void *
 julia_param_new (void)
 {
@@ -641,39 +1601,130 @@ julia_param_free (void *param_)
 }
 
 
+/*
+ * Whether the orbit of the critical point 0 stays bounded, i. e. the Julia
+ * set is connected and may have an interior. If it doesn't, there are no
+ * interior points, but orbits which pass through 0 (or very close to it)
+ * would look attracted to interior checking.
+ */
+static bool
+julia_has_interior (const struct julia_param *param)
+{
+	const mandel_fp_t preal = mpf_get_mandel_fp (param->param.real);
+	const mandel_fp_t pimag = mpf_get_mandel_fp (param->param.imag);
+	mandel_fp_t x = 0.0, y = 0.0;
+	unsigned i;
+	for (i = 0; i < param->mjparam.maxiter && x * x + y * y < 4.0; i++) {
+		complex_pow_fp (x, y, param->mjparam.zpower, &x, &y);
+		x += preal;
+		y += pimag;
+	}
+	return x * x + y * y < 4.0;
+}
+
+
+/*
+ * Rounding c moves the Julia set by about the rounding error times
+ * |dz/dc| / |dz/dz1| along the orbit of the critical value z1 = c, that
+ * is |1 + sum of 1 / (dz_k/dz1)|, which is only large for c close to a
+ * parabolic parameter. To keep that below the pixel spacing, c needs the
+ * bits of the spacing plus log2 of it, but no more than it actually has
+ * (there is no rounding for e.g. 0.5 + 1i). With an attracting cycle the
+ * critical orbit stays in the interior, which doesn't tell how the
+ * boundary moves, and c needs no more bits than the spacing.
+ */
+static unsigned
+julia_param_bits (const void *param_, unsigned pixel_bits)
+{
+	const struct julia_param *param = (const struct julia_param *) param_;
+	const unsigned zpower = param->mjparam.zpower;
+	const mandel_fp_t preal = mpf_get_mandel_fp (param->param.real);
+	const mandel_fp_t pimag = mpf_get_mandel_fp (param->param.imag);
+	const unsigned max_bits = MAX (my_mpf_frac_bits (param->param.real), my_mpf_frac_bits (param->param.imag));
+	mandel_fp_t x = preal, y = pimag, der_x = 1.0, der_y = 0.0, sum_x = 1.0, sum_y = 0.0;
+	unsigned i;
+
+	if (max_bits <= pixel_bits)
+		return max_bits;
+
+	for (i = 1; i < param->mjparam.maxiter && x * x + y * y < 4.0; i++) {
+		mandel_fp_t treal, timag;
+		complex_pow_fp (x, y, zpower - 1, &treal, &timag);
+		const mandel_fp_t new_der_x = (mandel_fp_t) zpower * (treal * der_x - timag * der_y);
+		der_y = (mandel_fp_t) zpower * (treal * der_y + timag * der_x);
+		der_x = new_der_x;
+		const mandel_fp_t der_sqr = der_x * der_x + der_y * der_y;
+		if (der_sqr == 0.0 || isinf (der_sqr))
+			break;
+		sum_x += der_x / der_sqr;
+		sum_y -= der_y / der_sqr;
+		complex_pow_fp (x, y, zpower, &x, &y);
+		x += preal;
+		y += pimag;
+	}
+
+	const mandel_fp_t sum = hypot (sum_x, sum_y);
+	if ((x * x + y * y < 4.0 && der_x * der_x + der_y * der_y < 1.0) || !isfinite (sum) || sum <= 1.0)
+		return pixel_bits;
+	return MIN (pixel_bits + ilogb (sum) + 1, max_bits);
+}
+
+
 static void *
 julia_state_new (const void *param_, fractal_type_flags_t flags, unsigned frac_limbs)
 {
 	const struct julia_param *param = (struct julia_param *) param_;
 	struct julia_state *state = malloc (sizeof (*state));
+	memset (state, 0, sizeof (*state));
 	state->mjstate.flags = flags;
 	state->mjstate.frac_limbs = frac_limbs;
-	memset (state, 0, sizeof (*state));
 	state->param = param;
 	mandel_julia_state_init (&state->mjstate, &param->mjparam);
+	if (state->mjstate.interior_check)
+		state->mjstate.interior_check = julia_has_interior (param);
 	if (frac_limbs == 0) {
 		state->mpvars.fp.preal_float = mpf_get_mandel_fp (param->param.real);
 		state->mpvars.fp.pimag_float = mpf_get_mandel_fp (param->param.imag);
+	} else {
+		mpf_get_dd (&state->mpvars.dd.preal_dd, param->param.real);
+		mpf_get_dd (&state->mpvars.dd.pimag_dd, param->param.imag);
 	}
+	state->param_mp = malloc (2 * (INT_LIMBS + frac_limbs) * sizeof (*state->param_mp));
+	my_mpf_get_mpn (state->param_mp, param->param.real, frac_limbs);
+	my_mpf_get_mpn (state->param_mp + INT_LIMBS + frac_limbs, param->param.imag, frac_limbs);
 	return (void *) state;
 }
 
 
+static void *
+julia_state_clone (void *state_)
+{
+	struct julia_state *state = (struct julia_state *) state_;
+	struct julia_state *clone = malloc (sizeof (*clone));
+	*clone = *state;
+	mandel_julia_state_clone (&clone->mjstate, &state->mjstate);
+	return (void *) clone;
+}
+
+
 static void
 julia_state_free (void *state_)
 {
 	struct julia_state *state = (struct julia_state *) state_;
+	if (state->mjstate.parent == NULL)
+		free (state->param_mp);
 	mandel_julia_state_clear (&state->mjstate);
 	free (state);
 }
 
 
 static bool
-julia_compute (void *state_, mpf_srcptr real, mpf_srcptr imag, unsigned *iter, mpfr_ptr distance)
+julia_compute (void *state_, mp_srcptr real, mp_srcptr imag, unsigned *iter, mandel_fe_t *distance)
 {
 	struct julia_state *state = (struct julia_state *) state_;
 	const struct julia_param *param = state->param;
-	return mandel_julia (&state->mjstate, &param->mjparam, real, imag, param->param.real, param->param.imag, iter, distance);
+	const mp_limb_t *preal = state->param_mp, *pimag = preal + INT_LIMBS + state->mjstate.frac_limbs;
+	return mandel_julia (&state->mjstate, &param->mjparam, real, imag, preal, pimag, iter, distance);
 }
 
 
@@ -686,17 +1737,84 @@ julia_compute_fp (void *state_, mandel_fp_t real, mandel_fp_t imag, unsigned *it
 }
 
 
+static void
+julia_compute_fp_batch (void *state_, const mandel_fp_t *real, const mandel_fp_t *imag, unsigned n, unsigned *iter, mandel_fp_t *distance, bool *inside)
+{
+	struct julia_state *state = (struct julia_state *) state_;
+	const struct julia_param *param = state->param;
+	mandel_julia_fp_batch (&state->mjstate, &param->mjparam, true, state->mpvars.fp.preal_float, state->mpvars.fp.pimag_float, real, imag, n, iter, distance, inside);
+}
+
+
+static bool
+julia_compute_dd (void *state_, const mandel_dd_t *real, const mandel_dd_t *imag, unsigned *iter, mandel_fp_t *distance)
+{
+	struct julia_state *state = (struct julia_state *) state_;
+	const struct julia_param *param = state->param;
+	return mandel_julia_dd (&state->mjstate, &param->mjparam, real, imag, &state->mpvars.dd.preal_dd, &state->mpvars.dd.pimag_dd, iter, distance);
+}
+
+
+static unsigned
+julia_perturb_reference (void *state_, mpf_srcptr real, mpf_srcptr imag, const mandel_fe_t *radius)
+{
+	struct julia_state *state = (struct julia_state *) state_;
+	const struct julia_param *param = state->param;
+	return mandel_julia_perturb_reference (&state->mjstate, &param->mjparam, real, imag, param->param.real, param->param.imag, radius);
+}
+
+
+static bool
+julia_compute_perturb (void *state_, mandel_fp_t dreal, mandel_fp_t dimag, unsigned *iter, mandel_fp_t *distance)
+{
+	struct julia_state *state = (struct julia_state *) state_;
+	const struct julia_param *param = state->param;
+	/* The Julia parameter is the same for all points, no offset there. */
+	return mandel_julia_perturb_fp (&state->mjstate, &param->mjparam, dreal, dimag, 0.0, 0.0, iter, distance);
+}
+
+
+static bool
+julia_compute_perturb_fe (void *state_, const mandel_fe_t *dreal, const mandel_fe_t *dimag, unsigned *iter, mandel_fe_t *distance)
+{
+	struct julia_state *state = (struct julia_state *) state_;
+	const struct julia_param *param = state->param;
+	const mandel_fe_t zero = fe_set_d (0.0);
+	return mandel_julia_perturb (&state->mjstate, &param->mjparam, *dreal, *dimag, zero, zero, true, iter, distance);
+}
+
+
+static uint64_t
+julia_saved_iterations (void *state_)
+{
+	struct julia_state *state = (struct julia_state *) state_;
+	return state->mjstate.iter_saved;
+}
+
+
 static void
 mandel_julia_state_init (struct mandel_julia_state *state, const struct mandel_julia_param *param)
 {
-	/* Nothing to do. */
+	state->interior_check = interior_check;
+	state->mp_z2 = generic_mp ? NULL : mp_z2_kernel_get (state->frac_limbs);
+	state->iter_saved = 0;
+}
+
+
+/* The clone must have been copied from the original already. */
+static void
+mandel_julia_state_clone (struct mandel_julia_state *clone, struct mandel_julia_state *orig)
+{
+	clone->parent = orig->parent != NULL ? orig->parent : orig;
+	clone->iter_saved = 0;
 }
 
 
 static void
 mandel_julia_state_clear (struct mandel_julia_state *state)
 {
-	/* Nothing to do. */
+	if (state->parent == NULL)
+		perturb_state_free (state->perturb);
 }
 
 
@@ -718,3 +1836,10 @@ fractal_type_by_name (const char *name)
 }
 
 
+GOptionGroup *
+fractal_math_get_option_group (void)
+{
+	GOptionGroup *group = g_option_group_new ("math", "Iteration Options", "Iteration Options", NULL, NULL);
+	g_option_group_add_entries (group, option_entries);
+	return group;
+}
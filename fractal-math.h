@@ -18,6 +18,8 @@ struct fractal_type;
 struct mandel_julia_param;
 struct mandelbrot_param;
 struct julia_param;
+struct mandel_dd;
+struct mandel_fe;
 
 struct mandel_point {
 	mpf_t real, imag;
@@ -36,10 +38,68 @@ struct fractal_type {
 	void *(*param_new) (void);
 	void *(*param_clone) (const void *orig);
 	void (*param_free) (void *param);
+	/*
+	 * Optional: the precision in bits (of the fraction) which the
+	 * parameters of the fractal need so that their rounding error stays
+	 * below the pixel spacing, which needs pixel_bits. May be NULL if
+	 * they need no more than that.
+	 */
+	unsigned (*param_bits) (const void *param, unsigned pixel_bits);
 	void *(*state_new) (const void *param, fractal_type_flags_t flags, unsigned frac_limbs);
+	/*
+	 * A state must only be used by one thread at a time, state_clone()
+	 * makes another one for each further thread. Clones share what is
+	 * read-only after perturb_reference() with the original, which has to
+	 * outlive them. Each clone counts only its own saved iterations. May
+	 * be NULL if a state can be shared by threads.
+	 */
+	void *(*state_clone) (void *state);
 	void (*state_free) (void *state);
-	bool (*compute) (void *state, mpf_srcptr real, mpf_srcptr imag, unsigned *iter, mpfr_ptr distance);
+	/*
+	 * Computes a point in MP precision. real and imag are in fixed point
+	 * (see misc-math.h) with the frac_limbs given to state_new(), the
+	 * distance estimate only needs floatexp. All the compute functions
+	 * set *iter, with any flags.
+	 */
+	bool (*compute) (void *state, mp_srcptr real, mp_srcptr imag, unsigned *iter, struct mandel_fe *distance);
 	bool (*compute_fp) (void *state, mandel_fp_t real, mandel_fp_t imag, unsigned *iter, mandel_fp_t *distance);
+	/*
+	 * Same as compute_fp, for n points at a time. iter[] and inside[] are
+	 * always set, distance[] only if distance estimation was requested.
+	 */
+	void (*compute_fp_batch) (void *state, const mandel_fp_t *real, const mandel_fp_t *imag, unsigned n, unsigned *iter, mandel_fp_t *distance, bool *inside);
+	/*
+	 * Same as compute_fp, in double-double precision (about 106 bits).
+	 * The distance estimate only needs FP precision.
+	 */
+	bool (*compute_dd) (void *state, const struct mandel_dd *real, const struct mandel_dd *imag, unsigned *iter, mandel_fp_t *distance);
+	/*
+	 * Perturbation: perturb_reference() calculates a high-precision
+	 * reference orbit at the given point, compute_perturb() then calculates
+	 * points by their (FP) offset from that reference point.
+	 * All points are expected within radius of the reference point,
+	 * perturb_reference() returns the number of iterations that can be
+	 * skipped for them by series approximation.
+	 * compute_perturb_fe() is the same as compute_perturb() with floatexp
+	 * offsets, for radii below the FP range.
+	 */
+	unsigned (*perturb_reference) (void *state, mpf_srcptr real, mpf_srcptr imag, const struct mandel_fe *radius);
+	bool (*compute_perturb) (void *state, mandel_fp_t dreal, mandel_fp_t dimag, unsigned *iter, mandel_fp_t *distance);
+	bool (*compute_perturb_fe) (void *state, const struct mandel_fe *dreal, const struct mandel_fe *dimag, unsigned *iter, struct mandel_fe *distance);
+	/*
+	 * Optional quick test whether a point is in the interior of the set,
+	 * without iterating. It must only return true for points which are
+	 * certainly inside, even though the point has been rounded to FP. In
+	 * that case, iter is set the way compute() would set it.
+	 * May be NULL if there is no such test.
+	 */
+	bool (*interior) (void *state, mandel_fp_t real, mandel_fp_t imag, unsigned *iter);
+	/*
+	 * Number of iterations saved so far by recognizing points as inside
+	 * before maxiter (periodicity and interior checking), with this state
+	 * only, not its clones. May be NULL.
+	 */
+	uint64_t (*saved_iterations) (void *state);
 };
 
 struct mandel_julia_param {
@@ -65,4 +125,6 @@ void mandel_point_clear (struct mandel_point *point);
 void mandel_area_init (struct mandel_area *area);
 void mandel_area_clear (struct mandel_area *area);
 
+GOptionGroup *fractal_math_get_option_group (void);
+
 #endif /* _GTKMANDEL_FRACTAL_MATH_H */
@@ -5,51 +5,77 @@
 #include <assert.h>
 
 #include <gmp.h>
-#include <mpfr.h>
 
 #include "defs.h"
 #include "fractal-render.h"
 #include "util.h"
+#include "dd-math.h"
 #include "misc-math.h"
 #include "fractal-math.h"
+#include "thread-pool.h"
+#include "pixel-bitmap.h"
 
 
-struct sr_state {
-	struct mandel_renderer *renderer;
-	int y, chunk_size;
-	GMutex *mutex;
+/* Lets ms_do_work() push new rectangles onto the deque of its worker. */
+struct ms_worker {
+	struct thread_pool_job *job;
+	unsigned worker;
 };
 
 
-struct ms_state {
-	struct mandel_renderer *renderer;
-	GMutex *mutex;
-	GQueue *queue;
-	GCond *cond;
-	volatile int idle_threads;
+struct btrace_q_entry {
+	int x, y, xstep, ystep;
 };
 
-struct ms_q_entry {
-	int x0, y0, x1, y1;
+
+/*
+ * The conversion from pixels to points, precalculated for the frame in
+ * each precision, so that computing a pixel needs no GMP allocation or
+ * mpf math.
+ */
+struct mandel_coords {
+	/* FP: x * xrange / w + xmin, rounded the same way as ever */
+	mandel_fp_t xmin, ymax, xrange, yrange;
+	/* Double-double: xmin + x * xstep */
+	mandel_dd_t xmin_dd, ymax_dd, xstep_dd, ystep_dd;
+	/*
+	 * MP: xmin, ymax, xstep and ystep in fixed point, one after the
+	 * other, with COORD_GUARD_LIMBS more fractional limbs than the
+	 * renderer. This keeps the error of x * xstep below the last limb.
+	 */
+	unsigned frac_limbs;
+	mp_limb_t mp[];
 };
 
+#define COORD_GUARD_LIMBS 1
 
-struct btrace_q_entry {
-	int x, y, xstep, ystep;
+
+/*
+ * A rectangle traced by the boundary tracer, edges included. The tracer
+ * treats the edges like the edges of the image, so tiles can be traced
+ * independently of each other.
+ */
+struct btrace_tile {
+	int x0, y0, x1, y1;
+	struct pixel_bitmap flags; /* pixels which have been filled */
 };
 
 
-static void calc_sr_row (struct mandel_renderer *mandel, int y, int chunk_size);
+static void calc_sr_row (struct mandel_renderer *mandel, struct mandel_worker *worker, int y, int chunk_size);
 static void calc_sr_mt_pass (struct mandel_renderer *mandel, int chunk_size);
-static gpointer sr_mt_thread_func (gpointer data);
+static void sr_mt_task (struct thread_pool_job *job, unsigned worker, void *data, const int *args);
 static void calc_ms_mt (struct mandel_renderer *mandel);
-static gpointer ms_mt_thread_func (gpointer data);
-static void ms_queue_push (struct ms_state *state, int x0, int y0, int x1, int y1);
-static void ms_do_work (struct mandel_renderer *md, int x0, int y0, int x1, int y1, void (*enqueue) (int, int, int, int, void *), void *data);
+static void ms_mt_task (struct thread_pool_job *job, unsigned worker, void *data, const int *args);
+static void ms_do_work (struct mandel_renderer *md, struct mandel_worker *worker, int x0, int y0, int x1, int y1, void (*enqueue) (int, int, int, int, void *), void *data);
 static void ms_enqueue (int x0, int y0, int x1, int y1, void *data);
 static void ms_mt_enqueue (int x0, int y0, int x1, int y1, void *data);
-static void render_btrace (struct mandel_renderer *md, int x0, int y0, unsigned char *flags, bool fill_mode);
-static void render_btrace_test (struct mandel_renderer *md, int x0, int y0, int xstep0, int ystep0, GQueue *queue, unsigned char *flags, bool fill_mode);
+static void calc_btrace_tile (struct mandel_renderer *md, struct mandel_worker *worker, int x0, int y0, int x1, int y1);
+static int btrace_tile_size (unsigned w, unsigned h);
+static void calc_btrace_mt (struct mandel_renderer *mandel);
+static void btrace_edge_task (struct thread_pool_job *job, unsigned worker, void *data, const int *args);
+static void btrace_tile_task (struct thread_pool_job *job, unsigned worker, void *data, const int *args);
+static void render_btrace (struct mandel_renderer *md, struct mandel_worker *worker, struct btrace_tile *tile, int x0, int y0, bool fill_mode);
+static void render_btrace_test (struct mandel_renderer *md, struct mandel_worker *worker, struct btrace_tile *tile, int x0, int y0, int xstep0, int ystep0, GQueue *queue, bool fill_mode);
 static void bt_turn_right (int xs, int ys, int *xsn, int *ysn);
 static void bt_turn_left (int xs, int ys, int *xsn, int *ysn);
 static void mandeldata_init_mpvars (struct mandeldata *md);
@@ -58,6 +84,21 @@ static void btrace_queue_pop (GQueue *queue, int *x, int *y, int *xstep, int *ys
 static bool mandel_all_neighbors_same (const struct mandel_renderer *mandel, unsigned x, unsigned y, unsigned d);
 static void calcpart (struct mandel_renderer *md, int x0, int y0, int x1, int y1);
 static void notify_update (struct mandel_renderer *mandel, int x, int y, int w, int h);
+static int distance_to_color_fp (mandel_fp_t distance);
+static int distance_to_color_log (mandel_fp_t log_distance);
+static int mandel_repres_value (const struct mandel_renderer *mandel, unsigned i);
+static void mandel_render_pixel_batch (struct mandel_renderer *mandel, struct mandel_worker *worker, const int *x, const int *y, unsigned n);
+static void mandel_renderer_init_rows (struct mandel_renderer *renderer, const struct mandeldata *md, unsigned w, unsigned h, unsigned aa_level, unsigned rows);
+static void mandel_renderer_alloc_data (struct mandel_renderer *renderer);
+static void mandel_renderer_init_perturb (struct mandel_renderer *renderer);
+static void mandel_renderer_init_perturb_offsets (struct mandel_renderer *renderer);
+static void mandel_renderer_init_coords (struct mandel_renderer *renderer);
+static void mandel_pixel_mpn (const struct mandel_renderer *mandel, int x, int y, mp_ptr real, mp_ptr imag);
+static bool perturb_interior (const struct mandel_renderer *mandel, void *state, mandel_fp_t dx, mandel_fp_t dy, unsigned *iter);
+static int mandel_pixel_value_iter (const struct mandel_renderer *mandel, void *state, int x, int y, unsigned *iter);
+static void worker_count_pixels (struct mandel_worker *worker, compute_mode_t mode, unsigned n, uint64_t iterations);
+static void mandel_render_pass_done (struct mandel_renderer *mandel);
+static double render_clock (void);
 
 
 
@@ -68,6 +109,15 @@ const char *const render_method_names[] = {
 };
 
 
+const char *const compute_mode_names[] = {
+	"FP",
+	"MP",
+	"Perturbation",
+	"Double-double",
+	"Perturbation (floatexp)"
+};
+
+
 void
 mandel_convert_x_f (const struct mandel_renderer *mandel, mpf_ptr rop, unsigned op, bool aa_subpixel)
 {
@@ -85,10 +135,12 @@ void
 mandel_convert_y_f (const struct mandel_renderer *mandel, mpf_ptr rop, unsigned op, bool aa_subpixel)
 {
 	mpf_sub (rop, mandel->ymin_f, mandel->ymax_f);
-	mpf_mul_ui (rop, rop, op);
-	unsigned h = mandel->h;
-	if (!aa_subpixel)
+	unsigned h = mandel->frame_h, offset = mandel->y_offset;
+	if (!aa_subpixel) {
 		h /= mandel->aa_level;
+		offset /= mandel->aa_level;
+	}
+	mpf_mul_ui (rop, rop, op + offset);
 	mpf_div_ui (rop, rop, h);
 	mpf_add (rop, rop, mandel->ymax_f);
 }
@@ -117,7 +169,7 @@ notify_update (struct mandel_renderer *mandel, int x, int y, int w, int h)
 void
 mandel_set_point (struct mandel_renderer *mandel, int x, int y, unsigned iter)
 {
-	volatile int *px = mandel->data + x * mandel->h + y;
+	volatile int *px = mandel->data + mandel_data_index (mandel, x, y);
 	if (*px < 0)
 		g_atomic_int_inc (&mandel->pixels_done);
 	*px = iter;
@@ -135,18 +187,23 @@ mandel_put_point (struct mandel_renderer *mandel, unsigned x, unsigned y, unsign
 int
 mandel_get_point (const struct mandel_renderer *mandel, int x, int y)
 {
-	return mandel->data[x * mandel->h + y];
+	return mandel->data[mandel_data_index (mandel, x, y)];
 }
 
 
 void
 mandel_get_pixel (const struct mandel_renderer *mandel, int x, int y, struct color *px)
 {
+	const unsigned aa = mandel->aa_level;
+	const unsigned sx = x * aa;
+	/* Whether the subpixels of each row are consecutive in the buffer */
+	const bool in_tile = (sx & MANDEL_TILE_MASK) + aa <= MANDEL_TILE_SIZE;
 	uint32_t r = 0, g = 0, b = 0;
 
-	for (unsigned xi = 0; xi < mandel->aa_level; xi++) {
-		for (unsigned yi = 0; yi < mandel->aa_level; yi++) {
-			int pval = mandel_get_point (mandel, x * mandel->aa_level + xi, y * mandel->aa_level + yi);
+	for (unsigned yi = 0; yi < aa; yi++) {
+		const int *row = mandel->data + mandel_data_index (mandel, sx, y * aa + yi);
+		for (unsigned xi = 0; xi < aa; xi++) {
+			int pval = in_tile ? row[xi] : mandel_get_point (mandel, sx + xi, y * aa + yi);
 			if (pval < 0)
 				continue;
 			struct color *color = &mandel->palette[pval % mandel->palette_size];
@@ -164,6 +221,63 @@ mandel_get_pixel (const struct mandel_renderer *mandel, int x, int y, struct col
 }
 
 
+/* Gets a whole row of output pixels, row must have room for the image width. */
+void
+mandel_get_pixel_row (const struct mandel_renderer *mandel, int y, struct color *row)
+{
+	const int w = mandel->w / mandel->aa_level;
+	int x;
+	for (x = 0; x < w; x++)
+		mandel_get_pixel (mandel, x, y, &row[x]);
+}
+
+
+void
+mandel_tile_iter_init (struct mandel_tile_iter *iter, const struct mandel_renderer *mandel, int x, int y, int w, int h)
+{
+	iter->mandel = mandel;
+	iter->x0 = x;
+	iter->y0 = y;
+	iter->x1 = x + w;
+	iter->y1 = y + h;
+	iter->x = x;
+	iter->y = y;
+}
+
+
+/*
+ * Returns the next piece of the rectangle in x, y, w and h, or false if
+ * there is none left. A piece contains all output pixels within the
+ * rectangle whose first subpixel is in the same buffer tile.
+ */
+bool
+mandel_tile_iter_next (struct mandel_tile_iter *iter, int *x, int *y, int *w, int *h)
+{
+	const int aa = iter->mandel->aa_level;
+	if (iter->x >= iter->x1 || iter->y >= iter->y1)
+		return false;
+
+	/* First output pixel beyond the tile containing (iter->x, iter->y) */
+	int xe = (((iter->x * aa) | MANDEL_TILE_MASK) + aa) / aa;
+	int ye = (((iter->y * aa) | MANDEL_TILE_MASK) + aa) / aa;
+	xe = MIN (xe, iter->x1);
+	ye = MIN (ye, iter->y1);
+
+	*x = iter->x;
+	*y = iter->y;
+	*w = xe - iter->x;
+	*h = ye - iter->y;
+
+	if (xe < iter->x1) {
+		iter->x = xe;
+	} else {
+		iter->x = iter->x0;
+		iter->y = ye;
+	}
+	return true;
+}
+
+
 static bool
 mandel_all_neighbors_same (const struct mandel_renderer *mandel, unsigned x, unsigned y, unsigned d)
 {
@@ -190,62 +304,124 @@ mandel_all_neighbors_same (const struct mandel_renderer *mandel, unsigned x, uns
 }
 
 
+static int
+distance_to_color_fp (mandel_fp_t distance)
+{
+	return distance_to_color_log (log (fabs (distance)));
+}
+
+
+static int
+distance_to_color_log (mandel_fp_t log_distance)
+{
+	/* XXX colors and "target" magf shouldn't be hardwired */
+	const mandel_fp_t kk = (mandel_fp_t) COLORS / log (1e9); 
+	/* Points without an estimate have a distance of 0. */
+	if (!isfinite (log_distance))
+		return 0;
+	int idx = ((int) round (-kk * log_distance)) % COLORS;
+	if (idx < 0)
+		idx += COLORS;
+	return idx;
+}
+
+
+/*
+ * The perturbation functions only get offsets, so the interior test of the
+ * fractal type is done here, with the offsets added to the reference point.
+ * The other compute functions do it themselves.
+ */
+static bool
+perturb_interior (const struct mandel_renderer *mandel, void *state, mandel_fp_t dx, mandel_fp_t dy, unsigned *iter)
+{
+	if (mandel->md->type->interior == NULL)
+		return false;
+	return mandel->md->type->interior (state, mandel->perturb.center_real + dx, mandel->perturb.center_imag + dy, iter);
+}
+
+
 int
 mandel_pixel_value (const struct mandel_renderer *mandel, int x, int y)
 {
-	unsigned i = 0; /* might end up uninitialized */
+	unsigned iter;
+	return mandel_pixel_value_iter (mandel, mandel->fractal_state, x, y, &iter);
+}
+
+
+/*
+ * Also returns the number of iterations in *iter. state is
+ * the fractal state of the calling thread.
+ */
+static int
+mandel_pixel_value_iter (const struct mandel_renderer *mandel, void *state, int x, int y, unsigned *iter)
+{
+	unsigned i = 0;
 	bool inside = false;
-	if (mandel->frac_limbs == 0) {
+	if (mandel->compute_mode == COMPUTE_FP) {
 		// FP
+		const struct mandel_coords *coords = mandel->coords;
 		mandel_fp_t distance;
-		/* FIXME we shouldn't do this for every pixel */
-		mandel_fp_t xmin = mpf_get_mandel_fp (mandel->xmin_f);
-		mandel_fp_t xmax = mpf_get_mandel_fp (mandel->xmax_f);
-		mandel_fp_t ymin = mpf_get_mandel_fp (mandel->ymin_f);
-		mandel_fp_t ymax = mpf_get_mandel_fp (mandel->ymax_f);
-		mandel_fp_t xf = x * (xmax - xmin) / mandel->w + xmin;
-		mandel_fp_t yf = y * (ymin - ymax) / mandel->h + ymax;
-		inside = mandel->md->type->compute_fp (mandel->fractal_state, xf, yf, &i, &distance);
-		if (!inside && mandel->md->repres.repres == REPRES_DISTANCE) {
-			/* XXX colors and "target" magf shouldn't be hardwired */
-			const mandel_fp_t kk = (mandel_fp_t) COLORS / log (1e9); 
-			int idx = ((int) round (-kk * log (fabs (distance)))) % COLORS;
-			if (idx < 0)
-				idx += COLORS;
-			i = idx;
-		}
+		mandel_fp_t xf = x * coords->xrange / mandel->w + coords->xmin;
+		mandel_fp_t yf = (y + mandel->y_offset) * coords->yrange / mandel->frame_h + coords->ymax;
+		inside = mandel->md->type->compute_fp (state, xf, yf, &i, &distance);
+		*iter = i;
+		if (!inside && mandel->md->repres.repres == REPRES_DISTANCE)
+			i = distance_to_color_fp (distance);
+	} else if (mandel->compute_mode == COMPUTE_PERTURB) {
+		// Perturbation, FP offsets from the MP reference point
+		mandel_fp_t distance;
+		mandel_fp_t dx = x * fe_get_d (mandel->perturb.xstep) + fe_get_d (mandel->perturb.xmin);
+		mandel_fp_t dy = (y + mandel->y_offset) * fe_get_d (mandel->perturb.ystep) + fe_get_d (mandel->perturb.ymax);
+		if (perturb_interior (mandel, state, dx, dy, &i))
+			inside = true;
+		else
+			inside = mandel->md->type->compute_perturb (state, dx, dy, &i, &distance);
+		*iter = i;
+		if (!inside && mandel->md->repres.repres == REPRES_DISTANCE)
+			i = distance_to_color_fp (distance);
+	} else if (mandel->compute_mode == COMPUTE_PERTURB_FE) {
+		// Perturbation, floatexp offsets
+		mandel_fe_t distance;
+		mandel_fe_t dx = fe_add (fe_mul_d (mandel->perturb.xstep, x), mandel->perturb.xmin);
+		mandel_fe_t dy = fe_add (fe_mul_d (mandel->perturb.ystep, y + mandel->y_offset), mandel->perturb.ymax);
+		if (perturb_interior (mandel, state, fe_get_d (dx), fe_get_d (dy), &i))
+			inside = true;
+		else
+			inside = mandel->md->type->compute_perturb_fe (state, &dx, &dy, &i, &distance);
+		*iter = i;
+		if (!inside && mandel->md->repres.repres == REPRES_DISTANCE)
+			i = distance_to_color_log (fe_log (distance));
+	} else if (mandel->compute_mode == COMPUTE_DD) {
+		// Double-double
+		const struct mandel_coords *coords = mandel->coords;
+		mandel_fp_t distance;
+		mandel_dd_t xd = dd_add (coords->xmin_dd, dd_mul_d (coords->xstep_dd, x));
+		mandel_dd_t yd = dd_add (coords->ymax_dd, dd_mul_d (coords->ystep_dd, y + mandel->y_offset));
+		inside = mandel->md->type->compute_dd (state, &xd, &yd, &i, &distance);
+		*iter = i;
+		if (!inside && mandel->md->repres.repres == REPRES_DISTANCE)
+			i = distance_to_color_fp (distance);
 	} else {
 		// MP
-		unsigned total_limbs = INT_LIMBS + mandel->frac_limbs;
-		mpf_t x0, y0;
-		mpfr_t distance;
-		mpf_init2 (x0, total_limbs * GMP_NUMB_BITS);
-		mpf_init2 (y0, total_limbs * GMP_NUMB_BITS);
-		if (mandel->md->repres.repres == REPRES_DISTANCE)
-			mpfr_init2 (distance, total_limbs * GMP_NUMB_BITS);
-
-		mandel_convert_x_f (mandel, x0, x, true);
-		mandel_convert_y_f (mandel, y0, y, true);
-
-		inside = mandel->md->type->compute (mandel->fractal_state, x0, y0, &i, distance);
-		mpf_clear (x0);
-		mpf_clear (y0);
-
-		if (!inside && mandel->md->repres.repres == REPRES_DISTANCE) {
-			if (true) {
-				mpfr_abs (distance, distance, GMP_RNDN);
-				mpfr_log (distance, distance, GMP_RNDN);
-				mpfr_mul (distance, distance, mandel->rep_state.distance_est_k, GMP_RNDN);
-
-				//int idx = ((int) round (-kk * log (fabs (distance)))) % 256;
-				int idx = ((int) round (mpfr_get_d (distance, GMP_RNDN))) % 256;
-				if (idx < 0)
-					idx += COLORS;
-				i = idx;
-			}
-			mpfr_clear (distance);
-		}
+		const unsigned total_limbs = INT_LIMBS + mandel->frac_limbs;
+		mp_limb_t x0[total_limbs], y0[total_limbs];
+		mandel_fe_t distance;
+		mandel_pixel_mpn (mandel, x, y, x0, y0);
+		inside = mandel->md->type->compute (state, x0, y0, &i, &distance);
+		*iter = i;
+		if (!inside && mandel->md->repres.repres == REPRES_DISTANCE)
+			i = distance_to_color_log (fe_log (distance));
 	}
+	/* Like in mandel_render_pixel_batch(), the inside has color 0 */
+	if (inside && mandel->md->repres.repres == REPRES_DISTANCE)
+		i = 0;
+	return mandel_repres_value (mandel, i);
+}
+
+
+static int
+mandel_repres_value (const struct mandel_renderer *mandel, unsigned i)
+{
 	switch (mandel->md->repres.repres) {
 		case REPRES_ESCAPE:
 			break;
@@ -263,17 +439,94 @@ mandel_pixel_value (const struct mandel_renderer *mandel, int x, int y)
 
 
 int
-mandel_render_pixel (struct mandel_renderer *mandel, int x, int y)
+mandel_render_pixel (struct mandel_renderer *mandel, struct mandel_worker *worker, int x, int y)
 {
 	int i = mandel_get_point (mandel, x, y);
 	if (i >= 0)
 		return i; /* pixel has been rendered previously */
-	i = mandel_pixel_value (mandel, x, y);
+	unsigned iter;
+	i = mandel_pixel_value_iter (mandel, worker->fractal_state, x, y, &iter);
 	mandel_put_point (mandel, x, y, i);
+	worker_count_pixels (worker, mandel->compute_mode, 1, iter);
 	return i;
 }
 
 
+static void
+worker_count_pixels (struct mandel_worker *worker, compute_mode_t mode, unsigned n, uint64_t iterations)
+{
+	worker->stats.pixels_computed += n;
+	worker->stats.pixels_by_mode[mode] += n;
+	worker->stats.iterations += iterations;
+}
+
+
+/*
+ * Render the given pixels (unless they have been rendered previously).
+ * In FP mode, they are calculated as one batch, so the fractal type can
+ * iterate several of them in parallel.
+ */
+static void
+mandel_render_pixel_batch (struct mandel_renderer *mandel, struct mandel_worker *worker, const int *x, const int *y, unsigned n)
+{
+	const fractal_repres_t repres = mandel->md->repres.repres;
+	mandel_fp_t real[n], imag[n], distance[n];
+	unsigned iter[n], idx[n];
+	bool inside[n];
+	unsigned i, count = 0;
+
+	if (mandel->compute_mode != COMPUTE_FP || mandel->md->type->compute_fp_batch == NULL) {
+		for (i = 0; i < n && !mandel->terminate; i++)
+			mandel_render_pixel (mandel, worker, x[i], y[i]);
+		return;
+	}
+
+	/* Same conversion as in mandel_pixel_value(), to get the same results. */
+	const struct mandel_coords *coords = mandel->coords;
+	for (i = 0; i < n; i++)
+		if (mandel_get_point (mandel, x[i], y[i]) < 0) {
+			real[count] = x[i] * coords->xrange / mandel->w + coords->xmin;
+			imag[count] = (y[i] + mandel->y_offset) * coords->yrange / mandel->frame_h + coords->ymax;
+			idx[count++] = i;
+		}
+	if (count == 0)
+		return;
+
+	mandel->md->type->compute_fp_batch (worker->fractal_state, real, imag, count, iter, distance, inside);
+
+	uint64_t iterations = 0;
+	for (i = 0; i < count; i++) {
+		unsigned value;
+		iterations += iter[i];
+		if (repres == REPRES_DISTANCE)
+			value = inside[i] ? 0 : distance_to_color_fp (distance[i]);
+		else
+			value = iter[i];
+		mandel_put_point (mandel, x[idx[i]], y[idx[i]], mandel_repres_value (mandel, value));
+	}
+	worker_count_pixels (worker, COMPUTE_FP, count, iterations);
+}
+
+
+/* Render n pixels in a line, starting at (x, y). */
+void
+mandel_render_pixel_line (struct mandel_renderer *mandel, struct mandel_worker *worker, int x, int y, int xstep, int ystep, int n)
+{
+	int xs[PIXEL_BATCH_SIZE], ys[PIXEL_BATCH_SIZE];
+	while (n > 0 && !mandel->terminate) {
+		int i, count = MIN (n, PIXEL_BATCH_SIZE);
+		for (i = 0; i < count; i++) {
+			xs[i] = x;
+			ys[i] = y;
+			x += xstep;
+			y += ystep;
+		}
+		mandel_render_pixel_batch (mandel, worker, xs, ys, count);
+		n -= count;
+	}
+}
+
+
 
 void
 mandel_display_rect (struct mandel_renderer *mandel, int x, int y, int w, int h, unsigned iter)
@@ -286,8 +539,8 @@ void
 mandel_put_rect (struct mandel_renderer *mandel, int x, int y, int w, int h, unsigned iter)
 {
 	int xc, yc;
-	for (xc = x; xc < x + w; xc++)
-		for (yc = y; yc < y + h; yc++)
+	for (yc = y; yc < y + h; yc++)
+		for (xc = x; xc < x + w; xc++)
 			mandel_set_point (mandel, xc, yc, iter);
 	mandel_display_rect (mandel, x, y, w, h, iter);
 }
@@ -295,6 +548,100 @@ mandel_put_rect (struct mandel_renderer *mandel, int x, int y, int w, int h, uns
 
 void
 mandel_renderer_init (struct mandel_renderer *renderer, const struct mandeldata *md, unsigned w, unsigned h, unsigned aa_level)
+{
+	mandel_renderer_init_rows (renderer, md, w, h, aa_level, h);
+}
+
+
+/*
+ * Sets up the renderer for a w x h frame like mandel_renderer_init(), but
+ * with a buffer for only the given number of rows. The frame is rendered
+ * in horizontal strips of at most that many rows, choosing each one with
+ * mandel_renderer_set_strip() before mandel_render(). The strips share the
+ * precision, compute mode and perturbation reference of the frame. With
+ * RM_BOUNDARY_TRACE, they have the same pixels as the whole frame rendered
+ * at once, except within mandel_render_strip_margin() rows of their ends
+ * (unless these are the ends of the frame). The other render methods lay
+ * out their work per strip, so there is no such guarantee for them.
+ */
+void
+mandel_renderer_init_strips (struct mandel_renderer *renderer, const struct mandeldata *md, unsigned w, unsigned h, unsigned aa_level, unsigned rows)
+{
+	mandel_renderer_init_rows (renderer, md, w, h, aa_level, MIN (rows, h));
+}
+
+
+/*
+ * Sets up preview for a quick look at the frame of renderer, with 1/scale
+ * of its width and height and no anti-aliasing. The preview covers exactly
+ * the same area and shares the precision, compute mode and perturbation
+ * reference of renderer, so it only costs its own pixels. It has to be
+ * cleared before renderer, which must not be changed in the meantime.
+ */
+void
+mandel_renderer_init_preview (struct mandel_renderer *preview, const struct mandel_renderer *renderer, unsigned scale)
+{
+	const struct fractal_type *type = renderer->md->type;
+
+	memset (preview, 0, sizeof (*preview));
+	preview->data = NULL;
+	preview->terminate = false;
+	preview->notify_update = NULL;
+	mpf_init_set (preview->xmin_f, renderer->xmin_f);
+	mpf_init_set (preview->xmax_f, renderer->xmax_f);
+	mpf_init_set (preview->ymin_f, renderer->ymin_f);
+	mpf_init_set (preview->ymax_f, renderer->ymax_f);
+
+	preview->md = renderer->md;
+	preview->w = MAX (renderer->w / renderer->aa_level / scale, 1);
+	preview->h = MAX (renderer->frame_h / renderer->aa_level / scale, 1);
+	preview->frame_h = preview->h;
+	preview->y_offset = 0;
+	g_atomic_int_set (&preview->pixels_done, 0);
+	preview->aa_level = 1;
+	preview->aspect = renderer->aspect;
+	preview->required_bits = renderer->required_bits;
+	preview->frac_limbs = renderer->frac_limbs;
+	preview->compute_mode = renderer->compute_mode;
+	preview->rep_state = renderer->rep_state;
+
+	mandel_renderer_alloc_data (preview);
+
+	preview->palette = renderer->palette;
+	preview->palette_size = renderer->palette_size;
+
+	mandel_renderer_init_coords (preview);
+	if (type->state_clone != NULL) {
+		/* The clone shares the reference orbit, and its series approximation is valid for the same area. */
+		preview->fractal_state = type->state_clone (renderer->fractal_state);
+		if (preview->compute_mode == COMPUTE_PERTURB || preview->compute_mode == COMPUTE_PERTURB_FE) {
+			mandel_renderer_init_perturb_offsets (preview);
+			preview->perturb.skipped_iter = renderer->perturb.skipped_iter;
+		}
+	} else {
+		const fractal_type_flags_t flags = preview->md->repres.repres == REPRES_DISTANCE ? FRAC_TYPE_DISTANCE : FRAC_TYPE_ESCAPE_ITER;
+
+		preview->fractal_state = type->state_new (preview->md->type_param, flags, preview->frac_limbs);
+		if (preview->compute_mode == COMPUTE_PERTURB || preview->compute_mode == COMPUTE_PERTURB_FE)
+			mandel_renderer_init_perturb (preview);
+	}
+}
+
+
+/* Selects rows y0 to y0 + rows - 1 of the frame, in output pixels. */
+void
+mandel_renderer_set_strip (struct mandel_renderer *renderer, unsigned y0, unsigned rows)
+{
+	assert ((y0 + rows) * renderer->aa_level <= renderer->frame_h);
+	renderer->y_offset = y0 * renderer->aa_level;
+	renderer->h = rows * renderer->aa_level;
+	g_atomic_int_set (&renderer->pixels_done, 0);
+	mandel_renderer_alloc_data (renderer);
+}
+
+
+static void
+mandel_renderer_init_rows (struct mandel_renderer *renderer, const struct mandeldata *md, unsigned w, unsigned h, unsigned aa_level, unsigned rows)
 {
 	memset (renderer, 0, sizeof (*renderer)); /* just to be safe... */
 	renderer->data = NULL;
@@ -307,11 +654,13 @@ mandel_renderer_init (struct mandel_renderer *renderer, const struct mandeldata
 
 	renderer->md = md;
 	renderer->w = w * aa_level;
-	renderer->h = h * aa_level;
+	renderer->h = rows * aa_level;
+	renderer->frame_h = h * aa_level;
+	renderer->y_offset = 0;
 	g_atomic_int_set (&renderer->pixels_done, 0);
 	renderer->aa_level = aa_level;
 
-	renderer->aspect = (double) renderer->w / renderer->h;
+	renderer->aspect = (double) renderer->w / renderer->frame_h;
 	center_to_corners (renderer->xmin_f, renderer->xmax_f, renderer->ymin_f, renderer->ymax_f, renderer->md->area.center.real, renderer->md->area.center.imag, renderer->md->area.magf, renderer->aspect);
 
 	// Determine the required precision.
@@ -331,6 +680,9 @@ mandel_renderer_init (struct mandel_renderer *renderer, const struct mandeldata
 
 	// We add a minimum of 4 extra bits of precision, that should do.
 	int required_bits = 4 - exponent;
+	if (md->type->param_bits != NULL)
+		required_bits = MAX (required_bits, (int) md->type->param_bits (md->type_param, required_bits));
+	renderer->required_bits = required_bits;
 
 	if (required_bits < MP_THRESHOLD)
 		renderer->frac_limbs = 0;
@@ -338,9 +690,8 @@ mandel_renderer_init (struct mandel_renderer *renderer, const struct mandeldata
 		renderer->frac_limbs = (required_bits + mp_bits_per_limb - 1) / mp_bits_per_limb;
 
 	const unsigned frac_limbs = renderer->frac_limbs;
-	const unsigned total_limbs = frac_limbs + INT_LIMBS;
 
-	renderer->data = malloc (renderer->w * renderer->h * sizeof (*renderer->data));
+	mandel_renderer_alloc_data (renderer);
 
 	renderer->palette = mandel_get_default_palette ();
 	renderer->palette_size = COLORS;
@@ -356,17 +707,212 @@ mandel_renderer_init (struct mandel_renderer *renderer, const struct mandeldata
 			break;
 		case REPRES_DISTANCE:
 			flags = FRAC_TYPE_DISTANCE;
-			mpfr_init2 (renderer->rep_state.distance_est_k, total_limbs * GMP_NUMB_BITS);
-			//const double kk = 12.353265; /* 256.0 / log (1e9) */
-			/* XXX */
-			mpfr_set_str (renderer->rep_state.distance_est_k, "-12.353265", 10, GMP_RNDN);
-			//mpfr_set_str (renderer->distance_est_k, "-3.7059796", 10, GMP_RNDN);
 			break;
 		default:
 			fprintf (stderr, "* ERROR: Invalid representation type %d in %s line %d\n", (int) renderer->md->repres.repres, __FILE__, __LINE__);
 			break;
 	}
 	renderer->fractal_state = renderer->md->type->state_new (renderer->md->type_param, flags, frac_limbs);
+	mandel_renderer_init_coords (renderer);
+
+	/*
+	 * Perturbation is much faster than double-double (which is still
+	 * about twice as fast as MP), so double-double is only used for
+	 * fractal types without perturbation support.
+	 */
+	if (frac_limbs == 0)
+		renderer->compute_mode = COMPUTE_FP;
+	else if (required_bits > FE_THRESHOLD && renderer->md->type->compute_perturb_fe != NULL)
+		renderer->compute_mode = COMPUTE_PERTURB_FE;
+	else if (required_bits <= FE_THRESHOLD && renderer->md->type->compute_perturb != NULL)
+		renderer->compute_mode = COMPUTE_PERTURB;
+	else if (required_bits <= DD_THRESHOLD && renderer->md->type->compute_dd != NULL)
+		renderer->compute_mode = COMPUTE_DD;
+	else
+		renderer->compute_mode = COMPUTE_MP;
+
+	if (renderer->compute_mode == COMPUTE_PERTURB || renderer->compute_mode == COMPUTE_PERTURB_FE)
+		mandel_renderer_init_perturb (renderer);
+}
+
+
+/*
+ * Overrides the compute mode chosen by mandel_renderer_init(), e. g. for
+ * comparing the engines. Returns false if the fractal type doesn't support
+ * the mode, or if it isn't precise enough for the pixel spacing. All modes
+ * except FP need at least one limb of fraction, so the state is made again
+ * with more precision if necessary.
+ */
+bool
+mandel_renderer_set_compute_mode (struct mandel_renderer *renderer, compute_mode_t mode)
+{
+	const struct fractal_type *type = renderer->md->type;
+	const unsigned required_bits = renderer->required_bits;
+	bool supported;
+
+	switch (mode) {
+		case COMPUTE_FP:
+			supported = type->compute_fp != NULL && required_bits < MP_THRESHOLD;
+			break;
+		case COMPUTE_MP:
+			supported = type->compute != NULL;
+			break;
+		case COMPUTE_PERTURB:
+			supported = type->compute_perturb != NULL && required_bits <= FE_THRESHOLD;
+			break;
+		case COMPUTE_DD:
+			supported = type->compute_dd != NULL && required_bits <= DD_THRESHOLD;
+			break;
+		case COMPUTE_PERTURB_FE:
+			supported = type->compute_perturb_fe != NULL;
+			break;
+		default:
+			supported = false;
+			break;
+	}
+	if (!supported)
+		return false;
+
+	renderer->compute_mode = mode;
+	if (mode != COMPUTE_FP && renderer->frac_limbs == 0)
+		mandel_renderer_add_precision (renderer, 1);
+	else if (mode == COMPUTE_PERTURB || mode == COMPUTE_PERTURB_FE)
+		mandel_renderer_init_perturb (renderer);
+	return true;
+}
+
+
+/*
+ * Adds limbs to the precision which mandel_renderer_init() has chosen, for
+ * the reference results of the MP engine, which would otherwise lose a few
+ * bits in deep zooms with many iterations.
+ */
+void
+mandel_renderer_add_precision (struct mandel_renderer *renderer, unsigned limbs)
+{
+	const struct fractal_type *type = renderer->md->type;
+	const fractal_type_flags_t flags = renderer->md->repres.repres == REPRES_DISTANCE ? FRAC_TYPE_DISTANCE : FRAC_TYPE_ESCAPE_ITER;
+
+	type->state_free (renderer->fractal_state);
+	renderer->frac_limbs += limbs;
+	renderer->fractal_state = type->state_new (renderer->md->type_param, flags, renderer->frac_limbs);
+	mandel_renderer_init_coords (renderer);
+	if (renderer->compute_mode == COMPUTE_PERTURB || renderer->compute_mode == COMPUTE_PERTURB_FE)
+		mandel_renderer_init_perturb (renderer);
+}
+
+
+/* (Re)allocates data for the current size, the contents are not kept. */
+static void
+mandel_renderer_alloc_data (struct mandel_renderer *renderer)
+{
+	renderer->tiles_x = (renderer->w + MANDEL_TILE_MASK) >> MANDEL_TILE_SHIFT;
+	renderer->tiles_y = (renderer->h + MANDEL_TILE_MASK) >> MANDEL_TILE_SHIFT;
+	free_not_null (renderer->data);
+	renderer->data = malloc (((size_t) renderer->tiles_x * renderer->tiles_y << (2 * MANDEL_TILE_SHIFT)) * sizeof (*renderer->data));
+}
+
+
+/* Use the center as the reference point and calculate its orbit. */
+static void
+mandel_renderer_init_perturb (struct mandel_renderer *renderer)
+{
+	const struct mandel_point *center = &renderer->md->area.center;
+
+	mandel_renderer_init_perturb_offsets (renderer);
+
+	/* The center is the reference point, so all points are within half the diagonal. */
+	const mandel_fe_t radius = fe_complex_abs (renderer->perturb.xmin, renderer->perturb.ymax);
+	renderer->perturb.skipped_iter = renderer->md->type->perturb_reference (renderer->fractal_state, center->real, center->imag, &radius);
+}
+
+
+/*
+ * Precalculate the pixel offsets relative to the center. These are small
+ * enough for FP even in deep zooms, or for floatexp in extremely deep ones.
+ */
+static void
+mandel_renderer_init_perturb_offsets (struct mandel_renderer *renderer)
+{
+	const struct mandel_point *center = &renderer->md->area.center;
+	const unsigned total_limbs = renderer->frac_limbs + INT_LIMBS;
+	mpf_t tmp;
+
+	mpf_init2 (tmp, total_limbs * GMP_NUMB_BITS);
+	mpf_sub (tmp, renderer->xmin_f, center->real);
+	mpf_get_fe (&renderer->perturb.xmin, tmp);
+	mpf_sub (tmp, renderer->ymax_f, center->imag);
+	mpf_get_fe (&renderer->perturb.ymax, tmp);
+	mpf_sub (tmp, renderer->xmax_f, renderer->xmin_f);
+	mpf_div_ui (tmp, tmp, renderer->w);
+	mpf_get_fe (&renderer->perturb.xstep, tmp);
+	mpf_sub (tmp, renderer->ymin_f, renderer->ymax_f);
+	mpf_div_ui (tmp, tmp, renderer->frame_h);
+	mpf_get_fe (&renderer->perturb.ystep, tmp);
+	mpf_clear (tmp);
+
+	renderer->perturb.center_real = mpf_get_mandel_fp (center->real);
+	renderer->perturb.center_imag = mpf_get_mandel_fp (center->imag);
+}
+
+
+/*
+ * Precalculates the conversion from pixels to points for the current
+ * precision, see struct mandel_coords.
+ */
+static void
+mandel_renderer_init_coords (struct mandel_renderer *renderer)
+{
+	const unsigned frac_limbs = renderer->frac_limbs + COORD_GUARD_LIMBS;
+	const unsigned total_limbs = INT_LIMBS + frac_limbs;
+	struct mandel_coords *coords;
+	mpf_t tmp;
+
+	free_not_null (renderer->coords);
+	coords = malloc (sizeof (*coords) + 4 * total_limbs * sizeof (*coords->mp));
+	renderer->coords = coords;
+	coords->frac_limbs = renderer->frac_limbs;
+
+	coords->xmin = mpf_get_mandel_fp (renderer->xmin_f);
+	coords->ymax = mpf_get_mandel_fp (renderer->ymax_f);
+	coords->xrange = mpf_get_mandel_fp (renderer->xmax_f) - coords->xmin;
+	coords->yrange = mpf_get_mandel_fp (renderer->ymin_f) - coords->ymax;
+
+	mpf_get_dd (&coords->xmin_dd, renderer->xmin_f);
+	mpf_get_dd (&coords->ymax_dd, renderer->ymax_f);
+	my_mpf_get_mpn (coords->mp, renderer->xmin_f, frac_limbs);
+	my_mpf_get_mpn (coords->mp + total_limbs, renderer->ymax_f, frac_limbs);
+
+	mpf_init2 (tmp, total_limbs * GMP_NUMB_BITS);
+	mpf_sub (tmp, renderer->xmax_f, renderer->xmin_f);
+	mpf_div_ui (tmp, tmp, renderer->w);
+	mpf_get_dd (&coords->xstep_dd, tmp);
+	my_mpf_get_mpn (coords->mp + 2 * total_limbs, tmp, frac_limbs);
+	mpf_sub (tmp, renderer->ymin_f, renderer->ymax_f);
+	mpf_div_ui (tmp, tmp, renderer->frame_h);
+	mpf_get_dd (&coords->ystep_dd, tmp);
+	my_mpf_get_mpn (coords->mp + 3 * total_limbs, tmp, frac_limbs);
+	mpf_clear (tmp);
+}
+
+
+/* The point of pixel (x, y) in fixed point, with the renderer's precision. */
+static void
+mandel_pixel_mpn (const struct mandel_renderer *mandel, int x, int y, mp_ptr real, mp_ptr imag)
+{
+	const struct mandel_coords *coords = mandel->coords;
+	const unsigned total_limbs = INT_LIMBS + coords->frac_limbs + COORD_GUARD_LIMBS;
+	const mp_limb_t *xmin = coords->mp, *ymax = xmin + total_limbs;
+	const mp_limb_t *xstep = ymax + total_limbs, *ystep = xstep + total_limbs;
+	mp_limb_t tmp[total_limbs];
+
+	/* Negative steps work as well, in two's complement modulo the size. */
+	mpn_mul_1 (tmp, xstep, total_limbs, x);
+	mpn_add_n (tmp, tmp, xmin, total_limbs);
+	memcpy (real, tmp + COORD_GUARD_LIMBS, (total_limbs - COORD_GUARD_LIMBS) * sizeof (*real));
+	mpn_mul_1 (tmp, ystep, total_limbs, y + mandel->y_offset);
+	mpn_add_n (tmp, tmp, ymax, total_limbs);
+	memcpy (imag, tmp + COORD_GUARD_LIMBS, (total_limbs - COORD_GUARD_LIMBS) * sizeof (*imag));
 }
 
 
@@ -408,31 +954,43 @@ mandel_renderer_clear (struct mandel_renderer *renderer)
 	mpf_clear (renderer->xmax_f);
 	mpf_clear (renderer->ymin_f);
 	mpf_clear (renderer->ymax_f);
-	if (renderer->md->repres.repres == REPRES_DISTANCE)
-		mpfr_clear (renderer->rep_state.distance_est_k);
+	free_not_null (renderer->coords);
 }
 
 
 void
 mandel_render (struct mandel_renderer *mandel)
 {
-	int i;
-	for (i = 0; i < mandel->w * mandel->h; i++)
+	const size_t size = (size_t) mandel->tiles_x * mandel->tiles_y << (2 * MANDEL_TILE_SHIFT);
+	const unsigned nworkers = MAX (mandel->thread_count, 1);
+	const uint64_t saved_before = mandel_get_saved_iterations (mandel);
+	const struct fractal_type *type = mandel->md->type;
+	size_t i;
+	for (i = 0; i < size; i++)
 		mandel->data[i] = -1;
 
+	memset (&mandel->stats, 0, sizeof (mandel->stats));
+	mandel->workers = calloc (nworkers, sizeof (*mandel->workers));
+	if (mandel->workers == NULL) {
+		fprintf (stderr, "* ERROR: Out of memory for %u render threads.\n", nworkers);
+		mandel->terminate = true;
+		return;
+	}
+	/* The first worker is the only one using the renderer's own state. */
+	for (i = 0; i < nworkers; i++)
+		if (i == 0 || type->state_clone == NULL)
+			mandel->workers[i].fractal_state = mandel->fractal_state;
+		else
+			mandel->workers[i].fractal_state = type->state_clone (mandel->fractal_state);
+	mandel->pass_start = render_clock ();
+
 	switch (mandel->render_method) {
 		case RM_MARIANI_SILVER: {
-			int x, y;
-
-			for (x = 0; !mandel->terminate && x < mandel->w; x++) {
-				mandel_render_pixel (mandel, x, 0);
-				mandel_render_pixel (mandel, x, mandel->h - 1);
-			}
-
-			for (y = 1; !mandel->terminate && y < mandel->h - 1; y++) {
-				mandel_render_pixel (mandel, 0, y);
-				mandel_render_pixel (mandel, mandel->w - 1, y);
-			}
+			mandel_render_pixel_line (mandel, &mandel->workers[0], 0, 0, 1, 0, mandel->w);
+			mandel_render_pixel_line (mandel, &mandel->workers[0], 0, mandel->h - 1, 1, 0, mandel->w);
+			mandel_render_pixel_line (mandel, &mandel->workers[0], 0, 1, 0, 1, (int) mandel->h - 2);
+			mandel_render_pixel_line (mandel, &mandel->workers[0], mandel->w - 1, 1, 0, 1, (int) mandel->h - 2);
+			mandel_render_pass_done (mandel);
 
 			if (mandel->terminate)
 				break;
@@ -441,6 +999,7 @@ mandel_render (struct mandel_renderer *mandel)
 				calc_ms_mt (mandel);
 			else
 				calcpart (mandel, 0, 0, mandel->w - 1, mandel->h - 1);
+			mandel_render_pass_done (mandel);
 
 			break;
 		}
@@ -453,7 +1012,8 @@ mandel_render (struct mandel_renderer *mandel)
 					calc_sr_mt_pass (mandel, chunk_size);
 				else
 					for (y = 0; !mandel->terminate && y < mandel->h; y += chunk_size)
-						calc_sr_row (mandel, y, chunk_size);
+						calc_sr_row (mandel, &mandel->workers[0], y, chunk_size);
+				mandel_render_pass_done (mandel);
 				chunk_size >>= 1;
 			}
 
@@ -461,25 +1021,8 @@ mandel_render (struct mandel_renderer *mandel)
 		}
 
 		case RM_BOUNDARY_TRACE: {
-			unsigned char flags[mandel->w * mandel->h];
-			memset (flags, 0, sizeof (flags));
-			int x, y;
-			for (y = 0; !mandel->terminate && y < mandel->h; y++)
-				for (x = 0; !mandel->terminate && x < mandel->w; x++)
-					if (!flags[x * mandel->h + y]) {
-						render_btrace (mandel, x, y, flags, false);
-						render_btrace (mandel, x, y, flags, true);
-					}
-			/*GQueue *queue = g_queue_new ();
-			btrace_queue_push (queue, 0, 0, 0, -1);
-			while (!g_queue_is_empty (queue)) {
-				int x, y, xstep, ystep;
-				btrace_queue_pop (queue, &x, &y, &xstep, &ystep);
-				if (!flags[x * mandel->h + y]) {
-					render_btrace_test (mandel, x, y, xstep, ystep, queue, flags, false);
-					render_btrace_test (mandel, x, y, xstep, ystep, queue, flags, true);
-				}
-			}*/
+			/* Tiled even with one thread, so the result doesn't depend on the thread count. */
+			calc_btrace_mt (mandel);
 			break;
 		}
 
@@ -488,6 +1031,57 @@ mandel_render (struct mandel_renderer *mandel)
 			break;
 		}
 	}
+
+	/* Merge the statistics of the threads. */
+	uint64_t saved = mandel_get_saved_iterations (mandel) - saved_before;
+	for (i = 0; i < nworkers; i++) {
+		mandel_render_stats_add (&mandel->stats, &mandel->workers[i].stats);
+		if (mandel->workers[i].fractal_state != mandel->fractal_state) {
+			if (type->saved_iterations != NULL)
+				saved += type->saved_iterations (mandel->workers[i].fractal_state);
+			type->state_free (mandel->workers[i].fractal_state);
+		}
+	}
+	free (mandel->workers);
+	mandel->workers = NULL;
+	const uint64_t done = g_atomic_int_get (&mandel->pixels_done);
+	if (done > mandel->stats.pixels_computed)
+		mandel->stats.pixels_inferred = done - mandel->stats.pixels_computed;
+	mandel->stats.saved_iterations = saved;
+}
+
+
+/* Records the time since the end of the previous pass. */
+static void
+mandel_render_pass_done (struct mandel_renderer *mandel)
+{
+	const double now = render_clock ();
+	if (mandel->stats.passes < MANDEL_MAX_PASSES)
+		mandel->stats.pass_time[mandel->stats.passes++] = now - mandel->pass_start;
+	mandel->pass_start = now;
+}
+
+
+static double
+render_clock (void)
+{
+	GTimeVal t;
+	g_get_current_time (&t);
+	return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+
+/*
+ * When a w x h frame is rendered in strips, each strip has to be extended
+ * by this many rows on either side, so that the boundary tracer traces
+ * whole tiles for all rows of the strip. The tiles cut by the ends of the
+ * extended strip are not the same as in the frame.
+ */
+unsigned
+mandel_render_strip_margin (unsigned w, unsigned h, unsigned aa_level)
+{
+	const unsigned ts = btrace_tile_size (w * aa_level, h * aa_level);
+	return (ts + aa_level - 1) / aa_level;
 }
 
 
@@ -496,14 +1090,15 @@ calcpart (struct mandel_renderer *md, int x0, int y0, int x1, int y1)
 {
 	if (md->terminate)
 		return;
-	ms_do_work (md, x0, y0, x1, y1, ms_enqueue, md);
+	ms_do_work (md, &md->workers[0], x0, y0, x1, y1, ms_enqueue, md);
 }
 
 
 static void
-calc_sr_row (struct mandel_renderer *mandel, int y, int chunk_size)
+calc_sr_row (struct mandel_renderer *mandel, struct mandel_worker *worker, int y, int chunk_size)
 {
-	int x;
+	int x, eval_x[PIXEL_BATCH_SIZE], eval_y[PIXEL_BATCH_SIZE];
+	unsigned i, eval_count = 0;
 
 	for (x = 0; x < mandel->w && !mandel->terminate; x += chunk_size) {
 		unsigned parent_x, parent_y;
@@ -527,11 +1122,19 @@ calc_sr_row (struct mandel_renderer *mandel, int y, int chunk_size)
 			do_eval = true;
 
 		if (do_eval) {
-			mandel_render_pixel (mandel, x, y);
-			mandel_display_rect (mandel, x, y, MIN (chunk_size, mandel->w - x), MIN (chunk_size, mandel->h - y), mandel_get_point (mandel, x, y));
+			/* Collect the pixels to evaluate, they are rendered in batches. */
+			eval_x[eval_count] = x;
+			eval_y[eval_count++] = y;
 		} else {
 			mandel_put_point (mandel, x, y, mandel_get_point (mandel, parent_x, parent_y));
 		}
+
+		if (eval_count == PIXEL_BATCH_SIZE || (eval_count > 0 && x + chunk_size >= mandel->w)) {
+			mandel_render_pixel_batch (mandel, worker, eval_x, eval_y, eval_count);
+			for (i = 0; i < eval_count; i++)
+				mandel_display_rect (mandel, eval_x[i], y, MIN (chunk_size, mandel->w - eval_x[i]), MIN (chunk_size, mandel->h - y), mandel_get_point (mandel, eval_x[i], y));
+			eval_count = 0;
+		}
 	}
 }
 
@@ -539,106 +1142,45 @@ calc_sr_row (struct mandel_renderer *mandel, int y, int chunk_size)
 static void
 calc_sr_mt_pass (struct mandel_renderer *mandel, int chunk_size)
 {
-	struct sr_state state = {mandel, 0, chunk_size, g_mutex_new ()};
-	GThread *threads[mandel->thread_count];
-	int i;
-
-	for (i = 0; i < mandel->thread_count; i++)
-		threads[i] = g_thread_create (sr_mt_thread_func, &state, TRUE, NULL);
-	for (i = 0; i < mandel->thread_count; i++)
-		g_thread_join (threads[i]);
+	struct thread_pool_job *job = thread_pool_job_new (sr_mt_task, mandel, mandel->thread_count);
+	int y;
 
-	g_mutex_free (state.mutex);
+	for (y = 0; y < mandel->h; y += chunk_size)
+		thread_pool_job_add (job, y, chunk_size, 0, 0);
+	thread_pool_job_run (job);
 }
 
 
-static gpointer
-sr_mt_thread_func (gpointer data)
+static void
+sr_mt_task (struct thread_pool_job *job, unsigned worker, void *data, const int *args)
 {
-	struct sr_state *state = (struct sr_state *) data;
-	while (!state->renderer->terminate) {
-		int y;
-		g_mutex_lock (state->mutex);
-		y = state->y;
-		state->y += state->chunk_size;
-		g_mutex_unlock (state->mutex);
-		if (y >= state->renderer->h)
-			break; /* done */
-		calc_sr_row (state->renderer, y, state->chunk_size);
-	}
-	return NULL;
+	struct mandel_renderer *mandel = (struct mandel_renderer *) data;
+	if (!mandel->terminate)
+		calc_sr_row (mandel, &mandel->workers[worker], args[0], args[1]);
 }
 
 
 static void
 calc_ms_mt (struct mandel_renderer *mandel)
 {
-	struct ms_state state = {mandel, g_mutex_new (), g_queue_new (), g_cond_new (), 0};
-	GThread *threads[mandel->thread_count];
-	int i;
-
-	ms_queue_push (&state, 0, 0, mandel->w - 1, mandel->h - 1);
-
-	for (i = 0; i < mandel->thread_count; i++)
-		threads[i] = g_thread_create (ms_mt_thread_func, &state, TRUE, NULL);
-
-	for (i = 0; i < mandel->thread_count; i++)
-		g_thread_join (threads[i]);
-
-	g_mutex_free (state.mutex);
-	g_queue_free (state.queue);
-	g_cond_free (state.cond);
-}
-
-
-static gpointer
-ms_mt_thread_func (gpointer data)
-{
-	struct ms_state *state = (struct ms_state *) data;
-	struct mandel_renderer *md = state->renderer;
-	while (!md->terminate) {
-		g_mutex_lock (state->mutex);
-		state->idle_threads++;
-		/* Notify all waiting threads about the increase of idle_threads */
-		g_cond_broadcast (state->cond);
-		while (g_queue_is_empty (state->queue)) {
-			if (state->idle_threads == md->thread_count) {
-				/* Queue is empty, all threads idle. We're done. */
-				g_mutex_unlock (state->mutex);
-				return NULL;
-			}
-			g_cond_wait (state->cond, state->mutex);
-		}
-		state->idle_threads--;
-		struct ms_q_entry *entry = g_queue_pop_head (state->queue);
-		g_mutex_unlock (state->mutex);
-
-		int x0 = entry->x0, y0 = entry->y0, x1 = entry->x1, y1 = entry->y1;
-		free (entry);
-
-		ms_do_work (md, x0, y0, x1, y1, ms_mt_enqueue, state);
-	}
-	return NULL;
+	struct thread_pool_job *job = thread_pool_job_new (ms_mt_task, mandel, mandel->thread_count);
+	thread_pool_job_add (job, 0, 0, mandel->w - 1, mandel->h - 1);
+	thread_pool_job_run (job);
 }
 
 
 static void
-ms_queue_push (struct ms_state *state, int x0, int y0, int x1, int y1)
+ms_mt_task (struct thread_pool_job *job, unsigned worker, void *data, const int *args)
 {
-	struct ms_q_entry *new_job = malloc (sizeof (struct ms_q_entry));
-	new_job->x0 = x0;
-	new_job->y0 = y0;
-	new_job->x1 = x1;
-	new_job->y1 = y1;
-	g_mutex_lock (state->mutex);
-	g_queue_push_tail (state->queue, new_job);
-	g_cond_signal (state->cond);
-	g_mutex_unlock (state->mutex);
+	struct mandel_renderer *md = (struct mandel_renderer *) data;
+	struct ms_worker w = {job, worker};
+	if (!md->terminate)
+		ms_do_work (md, &md->workers[worker], args[0], args[1], args[2], args[3], ms_mt_enqueue, &w);
 }
 
 
 static void
-ms_do_work (struct mandel_renderer *md, int x0, int y0, int x1, int y1, void (*enqueue) (int, int, int, int, void *), void *data)
+ms_do_work (struct mandel_renderer *md, struct mandel_worker *worker, int x0, int y0, int x1, int y1, void (*enqueue) (int, int, int, int, void *), void *data)
 {
 	int x, y;
 	bool failed = false;
@@ -653,8 +1195,7 @@ ms_do_work (struct mandel_renderer *md, int x0, int y0, int x1, int y1, void (*e
 	if (failed) {
 		if (x1 - x0 > y1 - y0) {
 			unsigned xm = (x0 + x1) / 2;
-			for (y = y0 + 1; y < y1; y++)
-				mandel_render_pixel (md, xm, y);
+			mandel_render_pixel_line (md, worker, xm, y0 + 1, 0, 1, y1 - y0 - 1);
 
 			if (xm - x0 > 1)
 				enqueue (x0, y0, xm, y1, data);
@@ -662,8 +1203,7 @@ ms_do_work (struct mandel_renderer *md, int x0, int y0, int x1, int y1, void (*e
 				enqueue (xm, y0, x1, y1, data);
 		} else {
 			unsigned ym = (y0 + y1) / 2;
-			for (x = x0 + 1; x < x1; x++)
-				mandel_render_pixel (md, x, ym);
+			mandel_render_pixel_line (md, worker, x0 + 1, ym, 1, 0, x1 - x0 - 1);
 
 			if (ym - y0 > 1)
 				enqueue (x0, y0, x1, ym, data);
@@ -687,8 +1227,8 @@ ms_enqueue (int x0, int y0, int x1, int y1, void *data)
 static void
 ms_mt_enqueue (int x0, int y0, int x1, int y1, void *data)
 {
-	struct ms_state *state = (struct ms_state *) data;
-	ms_queue_push (state, x0, y0, x1, y1);
+	struct ms_worker *w = (struct ms_worker *) data;
+	thread_pool_push (w->job, w->worker, x0, y0, x1, y1);
 }
 
 
@@ -702,6 +1242,66 @@ mandel_get_precision (const struct mandel_renderer *mandel)
 }
 
 
+unsigned
+mandel_get_skipped_iterations (const struct mandel_renderer *mandel)
+{
+	if (mandel->compute_mode == COMPUTE_PERTURB || mandel->compute_mode == COMPUTE_PERTURB_FE)
+		return mandel->perturb.skipped_iter;
+	else
+		return 0;
+}
+
+
+uint64_t
+mandel_get_saved_iterations (const struct mandel_renderer *mandel)
+{
+	if (mandel->md->type->saved_iterations == NULL)
+		return 0;
+	return mandel->md->type->saved_iterations (mandel->fractal_state);
+}
+
+
+/* Adds stats to sum, e. g. to get the totals for several frames. */
+void
+mandel_render_stats_add (struct mandel_render_stats *sum, const struct mandel_render_stats *stats)
+{
+	unsigned i;
+	sum->pixels_computed += stats->pixels_computed;
+	sum->pixels_inferred += stats->pixels_inferred;
+	sum->iterations += stats->iterations;
+	sum->saved_iterations += stats->saved_iterations;
+	for (i = 0; i < COMPUTE_MAX; i++)
+		sum->pixels_by_mode[i] += stats->pixels_by_mode[i];
+	for (i = 0; i < stats->passes; i++)
+		sum->pass_time[i] += stats->pass_time[i];
+	sum->passes = MAX (sum->passes, stats->passes);
+}
+
+
+void
+mandel_render_stats_print (FILE *f, const struct mandel_render_stats *stats)
+{
+	const uint64_t pixels = stats->pixels_computed + stats->pixels_inferred;
+	const char *sep;
+	double total_time = 0.0;
+	unsigned i;
+	fprintf (f, "Pixels:      %llu computed, %llu inferred (%.1f%%)\n", (unsigned long long) stats->pixels_computed, (unsigned long long) stats->pixels_inferred, pixels > 0 ? 100.0 * stats->pixels_inferred / pixels : 0.0);
+	fprintf (f, "Iterations:  %llu, %llu saved\n", (unsigned long long) stats->iterations, (unsigned long long) stats->saved_iterations);
+	fprintf (f, "Arithmetic: ");
+	for (i = 0, sep = " "; i < COMPUTE_MAX; i++)
+		if (stats->pixels_by_mode[i] > 0) {
+			fprintf (f, "%s%s: %llu", sep, compute_mode_names[i], (unsigned long long) stats->pixels_by_mode[i]);
+			sep = ", ";
+		}
+	fprintf (f, "\nPasses:     ");
+	for (i = 0; i < stats->passes; i++) {
+		fprintf (f, " %.3f", stats->pass_time[i]);
+		total_time += stats->pass_time[i];
+	}
+	fprintf (f, " (total %.3f s)\n", total_time);
+}
+
+
 static bool
 is_inside (struct mandel_renderer *md, int x, int y, int iter)
 {
@@ -710,17 +1310,148 @@ is_inside (struct mandel_renderer *md, int x, int y, int iter)
 }
 
 
+static inline bool
+btrace_in_tile (const struct btrace_tile *tile, int x, int y)
+{
+	return x >= tile->x0 && x <= tile->x1 && y >= tile->y0 && y <= tile->y1;
+}
+
+
+/*
+ * Boundary-trace the given rectangle. With BTRACE_QUEUE defined, the
+ * regions are found by following their neighbors from a queue, instead of
+ * scanning all pixels.
+ */
 static void
-render_btrace (struct mandel_renderer *md, int x0, int y0, unsigned char *flags, bool fill_mode)
+calc_btrace_tile (struct mandel_renderer *md, struct mandel_worker *worker, int x0, int y0, int x1, int y1)
+{
+	struct btrace_tile tile = {x0, y0, x1, y1};
+	int x, y;
+
+	if (!pixel_bitmap_init (&tile.flags, x0, y0, x1 - x0 + 1, y1 - y0 + 1, true)) {
+		fprintf (stderr, "* ERROR: Out of memory for boundary trace flags (%dx%d pixels).\n", x1 - x0 + 1, y1 - y0 + 1);
+		md->terminate = true;
+		return;
+	}
+
+#ifdef BTRACE_QUEUE
+	GQueue *queue = g_queue_new ();
+	btrace_queue_push (queue, x0, y0, 0, -1);
+	while (!g_queue_is_empty (queue)) {
+		int xstep, ystep;
+		btrace_queue_pop (queue, &x, &y, &xstep, &ystep);
+		if (!md->terminate && !pixel_bitmap_get (&tile.flags, x, y)) {
+			render_btrace_test (md, worker, &tile, x, y, xstep, ystep, queue, false);
+			render_btrace_test (md, worker, &tile, x, y, xstep, ystep, queue, true);
+		}
+	}
+	g_queue_free (queue);
+#else
+	for (y = y0; !md->terminate && y <= y1; y++)
+		for (x = x0; !md->terminate && x <= x1; x++)
+			if (!pixel_bitmap_get (&tile.flags, x, y)) {
+				render_btrace (md, worker, &tile, x, y, false);
+				render_btrace (md, worker, &tile, x, y, true);
+			}
+#endif
+
+	pixel_bitmap_clear (&tile.flags);
+}
+
+
+/* The tile size of the boundary tracer for a frame of w x h subpixels */
+static int
+btrace_tile_size (unsigned w, unsigned h)
+{
+	const int ts = (int) sqrt ((double) w * h / BTRACE_TILES);
+	return CLAMP (ts, BTRACE_MIN_TILE_SIZE, BTRACE_MAX_TILE_SIZE);
+}
+
+
+/*
+ * The image is split into square tiles, adjacent tiles share their edges.
+ * The shared edges are rendered first, then the tiles are traced in
+ * parallel. As every tile sees the shared edges completely rendered, it
+ * doesn't matter which of the neighbors fills them.
+ * The edges cut through regions which could otherwise be filled without
+ * calculating them, so the tiles are only made as small as necessary to
+ * keep the threads busy. The tile size depends on the frame size only, the
+ * edges would otherwise make the result depend on the thread count.
+ * The tiles are laid out on the whole frame, so a strip traces the same
+ * tiles as the frame. Those cut by the ends of the strip are traced as
+ * well, but they only come out right in the frame.
+ */
+static void
+calc_btrace_mt (struct mandel_renderer *mandel)
+{
+	const int w = mandel->w, fh = mandel->frame_h;
+	const int y0 = mandel->y_offset, y1 = y0 + (int) mandel->h - 1;
+	const int ts = btrace_tile_size (w, fh);
+	const int first = y0 / ts * ts; /* the first tile row which has rows in the strip */
+	const unsigned nworkers = MAX (mandel->thread_count, 1);
+	struct thread_pool_job *job;
+	int x, y;
+
+	/* Coordinates are in the frame, the tasks get them relative to the strip. */
+	job = thread_pool_job_new (btrace_edge_task, mandel, nworkers);
+	for (y = MAX (first, ts); y < fh - 1 && y <= y1; y += ts)
+		if (y >= y0)
+			thread_pool_job_add (job, 0, y - y0, 0, w);
+	/* The vertical edges are split at the horizontal ones, which are already done. */
+	for (x = ts; x < w - 1; x += ts)
+		for (y = first; y < MAX (fh - 1, 1) && y <= y1; y += ts) {
+			int ya = MAX (y > 0 ? y + 1 : y, y0);
+			int yb = MIN (y + ts < fh - 1 ? y + ts - 1 : fh - 1, y1);
+			if (ya <= yb)
+				thread_pool_job_add (job, x, ya - y0, 1, yb - ya + 1);
+		}
+	thread_pool_job_run (job);
+	mandel_render_pass_done (mandel);
+
+	if (mandel->terminate)
+		return;
+
+	job = thread_pool_job_new (btrace_tile_task, mandel, nworkers);
+	for (x = 0; x < MAX (w - 1, 1); x += ts)
+		for (y = first; y < MAX (fh - 1, 1) && y <= y1; y += ts)
+			thread_pool_job_add (job, x, MAX (y, y0) - y0, MIN (x + ts, w - 1), MIN (MIN (y + ts, fh - 1), y1) - y0);
+	thread_pool_job_run (job);
+	mandel_render_pass_done (mandel);
+}
+
+
+/* args: x, y, vertical, length */
+static void
+btrace_edge_task (struct thread_pool_job *job, unsigned worker, void *data, const int *args)
+{
+	struct mandel_renderer *mandel = (struct mandel_renderer *) data;
+	if (args[2])
+		mandel_render_pixel_line (mandel, &mandel->workers[worker], args[0], args[1], 0, 1, args[3]);
+	else
+		mandel_render_pixel_line (mandel, &mandel->workers[worker], args[0], args[1], 1, 0, args[3]);
+}
+
+
+static void
+btrace_tile_task (struct thread_pool_job *job, unsigned worker, void *data, const int *args)
+{
+	struct mandel_renderer *mandel = (struct mandel_renderer *) data;
+	if (!mandel->terminate)
+		calc_btrace_tile (mandel, &mandel->workers[worker], args[0], args[1], args[2], args[3]);
+}
+
+
+static void
+render_btrace (struct mandel_renderer *md, struct mandel_worker *worker, struct btrace_tile *tile, int x0, int y0, bool fill_mode)
 {
 	int x = x0, y = y0;
 	/* XXX is it safe to choose this arbitrarily? */
 	int xstep = 0, ystep = -1;
-	unsigned inside = mandel_render_pixel (md, x0, y0);
+	unsigned inside = mandel_render_pixel (md, worker, x0, y0);
 
 	int turns = 0;
 	while (!md->terminate) {
-		if (x + xstep < 0 || x + xstep >= md->w || y + ystep < 0 || y + ystep >= md->h || mandel_render_pixel (md, x + xstep, y + ystep) != inside) {
+		if (!btrace_in_tile (tile, x + xstep, y + ystep) || mandel_render_pixel (md, worker, x + xstep, y + ystep) != inside) {
 			/* can't move forward, turn left */
 			bt_turn_left (xstep, ystep, &xstep, &ystep);
 			if (++turns == 4)
@@ -735,8 +1466,8 @@ render_btrace (struct mandel_renderer *md, int x0, int y0, unsigned char *flags,
 			int xfs, yfs;
 			bt_turn_left (xstep, ystep, &xfs, &yfs);
 			int xf = x, yf = y;
-			while (xf >= 0 && yf >= 0 && xf < md->w && yf < md->h && is_inside (md, xf, yf, inside)) {
-				flags[xf * md->h + yf] = 1;
+			while (btrace_in_tile (tile, xf, yf) && is_inside (md, xf, yf, inside)) {
+				pixel_bitmap_set (&tile->flags, xf, yf);
 				mandel_put_point (md, xf, yf, inside);
 				xf += xfs;
 				yf += yfs;
@@ -747,7 +1478,7 @@ render_btrace (struct mandel_renderer *md, int x0, int y0, unsigned char *flags,
 		int xsn, ysn;
 		bt_turn_right (xstep, ystep, &xsn, &ysn);
 		/* If we don't have a wall at the right, turn right. */
-		if (x + xsn >= 0 && x + xsn < md->w && y + ysn >= 0 && y + ysn < md->h && mandel_render_pixel (md, x + xsn, y + ysn) == inside) {
+		if (btrace_in_tile (tile, x + xsn, y + ysn) && mandel_render_pixel (md, worker, x + xsn, y + ysn) == inside) {
 			xstep = xsn;
 			ystep = ysn;
 		}
@@ -755,26 +1486,19 @@ render_btrace (struct mandel_renderer *md, int x0, int y0, unsigned char *flags,
 }
 
 
-static inline bool
-pixel_in_bounds (struct mandel_renderer *renderer, int x, int y)
-{
-	return x >= 0 && x < renderer->w && y >= 0 && y < renderer->h;
-}
-
-
 static void
-render_btrace_test (struct mandel_renderer *md, int x0, int y0, int xstep0, int ystep0, GQueue *queue, unsigned char *flags, bool fill_mode)
+render_btrace_test (struct mandel_renderer *md, struct mandel_worker *worker, struct btrace_tile *tile, int x0, int y0, int xstep0, int ystep0, GQueue *queue, bool fill_mode)
 {
 	int x = x0, y = y0;
 	int xstep = xstep0, ystep = ystep0;
-	unsigned inside = mandel_render_pixel (md, x0, y0);
+	unsigned inside = mandel_render_pixel (md, worker, x0, y0);
 
 	int turns = 0;
 	while (!md->terminate) {
 		if (fill_mode)
-			flags[x * md->h + y] = 1;
-		if (!pixel_in_bounds (md, x + xstep, y + ystep) || mandel_render_pixel (md, x + xstep, y + ystep) != inside) {
-			if (fill_mode && pixel_in_bounds (md, x + xstep, y + ystep))
+			pixel_bitmap_set (&tile->flags, x, y);
+		if (!btrace_in_tile (tile, x + xstep, y + ystep) || mandel_render_pixel (md, worker, x + xstep, y + ystep) != inside) {
+			if (fill_mode && btrace_in_tile (tile, x + xstep, y + ystep))
 				btrace_queue_push (queue, x + xstep, y + ystep, -ystep, xstep);
 			/* can't move forward, turn left */
 			bt_turn_left (xstep, ystep, &xstep, &ystep);
@@ -790,8 +1514,8 @@ render_btrace_test (struct mandel_renderer *md, int x0, int y0, int xstep0, int
 			int xfs, yfs;
 			bt_turn_left (xstep, ystep, &xfs, &yfs);
 			int xf = x + xfs, yf = y + yfs;
-			while (pixel_in_bounds (md, xf, yf) && is_inside (md, xf, yf, inside)) {
-				flags[xf * md->h + yf] = 1;
+			while (btrace_in_tile (tile, xf, yf) && is_inside (md, xf, yf, inside)) {
+				pixel_bitmap_set (&tile->flags, xf, yf);
 				mandel_put_point (md, xf, yf, inside);
 				xf += xfs;
 				yf += yfs;
@@ -806,10 +1530,10 @@ render_btrace_test (struct mandel_renderer *md, int x0, int y0, int xstep0, int
 		int xsn, ysn;
 		bt_turn_right (xstep, ystep, &xsn, &ysn);
 		/* If we don't have a wall at the right, turn right. */
-		if (pixel_in_bounds (md, x + xsn, y + ysn) && mandel_render_pixel (md, x + xsn, y + ysn) == inside) {
+		if (btrace_in_tile (tile, x + xsn, y + ysn) && mandel_render_pixel (md, worker, x + xsn, y + ysn) == inside) {
 			xstep = xsn;
 			ystep = ysn;
-		} else if (fill_mode && pixel_in_bounds (md, x + xsn, y + ysn))
+		} else if (fill_mode && btrace_in_tile (tile, x + xsn, y + ysn))
 			btrace_queue_push (queue, x + xsn, y + ysn, -xstep, -ystep);
 	}
 }
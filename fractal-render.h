@@ -3,17 +3,50 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <glib.h>
 
 #include <gmp.h>
 #include <mpfr.h>
 
 #include "fpdefs.h"
+#include "floatexp.h"
 #include "fractal-math.h"
 
 #define DEFAULT_RENDER_METHOD RM_SUCCESSIVE_REFINE
 #define MP_THRESHOLD 53
+/*
+ * Up to this precision (in bits), double-double math can be used instead of
+ * MP. This leaves some room for the integer part.
+ */
+#define DD_THRESHOLD 100
+/*
+ * Beyond this precision (in bits), perturbation offsets and distance
+ * estimates are too small for FP and need floatexp.
+ */
+#define FE_THRESHOLD 1000
 #define SR_CHUNK_SIZE 32
+/*
+ * The boundary tracer splits the image into about this many tiles, enough
+ * to keep a few threads each busy, but none smaller than
+ * BTRACE_MIN_TILE_SIZE pixels. Neither are they larger than
+ * BTRACE_MAX_TILE_SIZE, as strips have to be extended by a tile.
+ */
+#define BTRACE_TILES 64
+#define BTRACE_MIN_TILE_SIZE 64
+#define BTRACE_MAX_TILE_SIZE 256
+/* Maximum number of pixels to calculate in one batch */
+#define PIXEL_BATCH_SIZE 64
+/*
+ * The iteration buffer is stored in square tiles of 2^MANDEL_TILE_SHIFT
+ * pixels, row by row within each tile, so the neighbors of a pixel in both
+ * directions are usually in the same few cache lines.
+ */
+#define MANDEL_TILE_SHIFT 6
+#define MANDEL_TILE_SIZE (1 << MANDEL_TILE_SHIFT)
+#define MANDEL_TILE_MASK (MANDEL_TILE_SIZE - 1)
+/* Number of render passes for which the time is recorded */
+#define MANDEL_MAX_PASSES 8
 
 typedef enum render_method_enum {
 	RM_SUCCESSIVE_REFINE = 0,
@@ -22,6 +55,15 @@ typedef enum render_method_enum {
 	RM_MAX = 3
 } render_method_t;
 
+typedef enum compute_mode_enum {
+	COMPUTE_FP = 0,
+	COMPUTE_MP = 1,
+	COMPUTE_PERTURB = 2,
+	COMPUTE_DD = 3,
+	COMPUTE_PERTURB_FE = 4,
+	COMPUTE_MAX = 5
+} compute_mode_t;
+
 typedef enum fractal_repres_enum {
 	REPRES_ESCAPE = 0,
 	REPRES_ESCAPE_LOG = 1,
@@ -38,6 +80,7 @@ struct color {
 struct mandeldata;
 struct mandel_renderer;
 struct mandel_representation;
+struct mandel_coords;
 
 
 struct mandel_repres {
@@ -56,14 +99,54 @@ struct mandeldata {
 };
 
 
+/*
+ * Statistics about a rendered frame. Inferred pixels have been filled in
+ * by the render method from their neighbors, without calculating them.
+ * Iterations are counted for all representations, they include the saved
+ * ones.
+ */
+struct mandel_render_stats {
+	uint64_t pixels_computed, pixels_inferred;
+	uint64_t iterations, saved_iterations;
+	uint64_t pixels_by_mode[COMPUTE_MAX]; /* computed pixels */
+	unsigned passes;
+	double pass_time[MANDEL_MAX_PASSES]; /* seconds */
+};
+
+
+/*
+ * Data of one thread rendering a frame, so it doesn't have to be shared
+ * with the others. The statistics are added up when the frame is done.
+ * The fractal state is a clone of the renderer's (see struct fractal_type),
+ * except for the first worker.
+ */
+struct mandel_worker {
+	struct mandel_render_stats stats;
+	void *fractal_state;
+};
+
+
 struct mandel_renderer {
 	const struct mandeldata *md;
-	unsigned w, h;
+	unsigned w, h; /* of data, in subpixels */
+	unsigned frame_h, y_offset; /* the whole frame, and where data starts in it, when rendering in strips */
 	volatile gint pixels_done;
 	mpf_t xmin_f, xmax_f, ymin_f, ymax_f;
+	struct mandel_coords *coords; /* the same, precalculated for the pixels */
 	unsigned frac_limbs;
+	unsigned required_bits; /* for the pixel spacing and the parameters */
+	compute_mode_t compute_mode;
+	struct {
+		/* Offsets from the reference point (i. e. the center) */
+		mandel_fe_t xmin, ymax, xstep, ystep;
+		/* Iterations skipped for each point by series approximation */
+		unsigned skipped_iter;
+		/* The reference point, rounded to FP, for the interior test */
+		mandel_fp_t center_real, center_imag;
+	} perturb;
 	double aspect;
 	int *data; /* This is signed so we can represent not-yet-rendered pixels as -1 */
+	unsigned tiles_x, tiles_y; /* size of data in tiles, padded at the right and bottom */
 	render_method_t render_method;
 	void *user_data;
 	void *fractal_state;
@@ -71,16 +154,40 @@ struct mandel_renderer {
 	unsigned thread_count;
 	union {
 		double log_factor;
-		mpfr_t distance_est_k;
 	} rep_state;
 	struct color *palette;
 	unsigned palette_size;
 	unsigned aa_level;
 	void (*notify_update) (unsigned x, unsigned y, unsigned w, unsigned h, void *user_data);
+	struct mandel_worker *workers; /* one for each thread, while rendering */
+	struct mandel_render_stats stats; /* of the last frame */
+	double pass_start;
+};
+
+
+/*
+ * Walks a rectangle of output pixels in pieces which are made up of
+ * whole tiles of the iteration buffer (as far as anti-aliasing allows),
+ * for updating large areas without jumping through the buffer.
+ */
+struct mandel_tile_iter {
+	const struct mandel_renderer *mandel;
+	int x0, y0, x1, y1; /* the rectangle, in output pixels */
+	int x, y; /* upper left corner of the next piece */
 };
 
 
+/* Index into the data of struct mandel_renderer, x and y are in subpixels. */
+static inline size_t
+mandel_data_index (const struct mandel_renderer *mandel, unsigned x, unsigned y)
+{
+	const size_t tile = (size_t) (y >> MANDEL_TILE_SHIFT) * mandel->tiles_x + (x >> MANDEL_TILE_SHIFT);
+	return (tile << (2 * MANDEL_TILE_SHIFT)) + ((y & MANDEL_TILE_MASK) << MANDEL_TILE_SHIFT) + (x & MANDEL_TILE_MASK);
+}
+
+
 extern const char *const render_method_names[];
+extern const char *const compute_mode_names[];
 
 int fractal_supported_representations (const struct fractal_type *type, fractal_repres_t *res);
 
@@ -93,17 +200,31 @@ void mandel_put_point (struct mandel_renderer *mandel, unsigned x, unsigned y, u
 int mandel_get_point (const struct mandel_renderer *mandel, int x, int y);
 
 void mandel_get_pixel (const struct mandel_renderer *mandel, int x, int y, struct color *px);
+void mandel_get_pixel_row (const struct mandel_renderer *mandel, int y, struct color *row);
+void mandel_tile_iter_init (struct mandel_tile_iter *iter, const struct mandel_renderer *mandel, int x, int y, int w, int h);
+bool mandel_tile_iter_next (struct mandel_tile_iter *iter, int *x, int *y, int *w, int *h);
 
-int mandel_render_pixel (struct mandel_renderer *mandel, int x, int y);
+int mandel_render_pixel (struct mandel_renderer *mandel, struct mandel_worker *worker, int x, int y);
+void mandel_render_pixel_line (struct mandel_renderer *mandel, struct mandel_worker *worker, int x, int y, int xstep, int ystep, int n);
 int mandel_pixel_value (const struct mandel_renderer *mandel, int x, int y);
 void mandel_put_rect (struct mandel_renderer *mandel, int x, int y, int w, int h, unsigned iter);
 void mandel_display_rect (struct mandel_renderer *mandel, int x, int y, int w, int h, unsigned iter);
 void mandel_render (struct mandel_renderer *mandel);
+unsigned mandel_render_strip_margin (unsigned w, unsigned h, unsigned aa_level);
 void mandel_renderer_init (struct mandel_renderer *renderer, const struct mandeldata *md, unsigned w, unsigned h, unsigned aa_level);
+void mandel_renderer_init_strips (struct mandel_renderer *renderer, const struct mandeldata *md, unsigned w, unsigned h, unsigned aa_level, unsigned rows);
+void mandel_renderer_set_strip (struct mandel_renderer *renderer, unsigned y0, unsigned rows);
+void mandel_renderer_init_preview (struct mandel_renderer *preview, const struct mandel_renderer *renderer, unsigned scale);
+bool mandel_renderer_set_compute_mode (struct mandel_renderer *renderer, compute_mode_t mode);
+void mandel_renderer_add_precision (struct mandel_renderer *renderer, unsigned limbs);
 struct color *mandel_create_default_palette (unsigned size);
 struct color *mandel_get_default_palette (void);
 void mandel_renderer_clear (struct mandel_renderer *renderer);
 unsigned mandel_get_precision (const struct mandel_renderer *mandel);
+unsigned mandel_get_skipped_iterations (const struct mandel_renderer *mandel);
+uint64_t mandel_get_saved_iterations (const struct mandel_renderer *mandel);
+void mandel_render_stats_add (struct mandel_render_stats *sum, const struct mandel_render_stats *stats);
+void mandel_render_stats_print (FILE *f, const struct mandel_render_stats *stats);
 double mandel_renderer_progress (const struct mandel_renderer *renderer);
 unsigned mandel_renderer_width (const struct mandel_renderer *renderer);
 unsigned mandel_renderer_height (const struct mandel_renderer *renderer);
@@ -23,6 +23,10 @@
 #include "util.h"
 
 
+/* The preview is rendered with this fraction of the width and height */
+#define PREVIEW_SCALE 8
+
+
 struct rendering_started_info {
 	GtkMandel *mandel;
 	int bits;
@@ -31,6 +35,7 @@ struct rendering_started_info {
 struct rendering_stopped_info {
 	GtkMandel *mandel;
 	bool completed;
+	struct mandel_render_stats stats;
 };
 
 
@@ -45,7 +50,7 @@ static void my_realize (GtkWidget *my_img, gpointer user_data);
 static void gtk_mandel_class_init (GtkMandelClass *class);
 static void gtk_mandel_init (GtkMandel *mandel);
 static gboolean my_expose (GtkWidget *widget, GdkEventExpose *event, gpointer user_data);
-static gpointer calcmandel (gpointer data);
+static void calcmandel (struct thread_pool_job *job, unsigned worker, void *data, const int *args);
 static void size_allocate (GtkWidget *widget, GtkAllocation *allocation, gpointer data);
 static gboolean do_emit_rendering_started (gpointer data);
 static gboolean do_emit_rendering_stopped (gpointer data);
@@ -53,6 +58,8 @@ static gboolean redraw_source_func (gpointer data);
 static gboolean redraw_source_func_once (gpointer data);
 static void redraw_area (GtkMandel *mandel, int x, int y, int w, int h);
 static void init_renderer (GtkMandel *mandel);
+static void scale_last_frame (GtkMandel *mandel, const struct mandel_renderer *last);
+static void show_preview (GtkMandel *mandel, const struct mandel_renderer *preview);
 static void update_selection_cursor (GtkMandel *mandel);
 static void gtk_mandel_dispose (GObject *object);
 static void gtk_mandel_finalize (GObject *object);
@@ -162,10 +169,12 @@ gtk_mandel_init (GtkMandel *mandel)
 	mandel->aa_level = 1;
 	mandel->md = NULL;
 	mandel->renderer = NULL;
+	mandel->preview = NULL;
 	mandel->pixbuf = NULL;
 	mandel->gc = NULL;
-	mandel->thread = NULL;
+	mandel->job = NULL;
 	mandel->realized = false;
+	memset (&mandel->stats, 0, sizeof (mandel->stats));
 
 	mandel->selection_type = GTK_MANDEL_SELECT_NONE;
 	mandel->cur_w = -1;
@@ -193,10 +202,12 @@ gtk_mandel_init (GtkMandel *mandel)
 void
 gtk_mandel_stop (GtkMandel *mandel)
 {
-	if (mandel->thread != NULL) {
+	if (mandel->job != NULL) {
+		if (mandel->preview != NULL)
+			mandel->preview->terminate = true;
 		mandel->renderer->terminate = true;
-		g_thread_join (mandel->thread);
-		mandel->thread = NULL;
+		thread_pool_job_wait (mandel->job);
+		mandel->job = NULL;
 	}
 }
 
@@ -204,15 +215,15 @@ gtk_mandel_stop (GtkMandel *mandel)
 static void
 init_renderer (GtkMandel *mandel)
 {
-	if (mandel->renderer != NULL)
+	struct mandel_renderer *last = mandel->renderer;
+
+	if (mandel->preview != NULL)
 	{
-		mandel_renderer_clear (mandel->renderer);
-		free (mandel->renderer);
-		mandel->renderer = NULL;
+		mandel_renderer_clear (mandel->preview);
+		free (mandel->preview);
+		mandel->preview = NULL;
 	}
 
-	GtkWidget *widget = GTK_WIDGET (mandel);
-
 	struct mandel_renderer *renderer = malloc (sizeof (*renderer));
 	mandel_renderer_init (renderer, mandel->md, mandel->cur_w, mandel->cur_h, mandel->aa_level);
 	renderer->render_method = mandel->render_method;
@@ -221,13 +232,79 @@ init_renderer (GtkMandel *mandel)
 	renderer->notify_update = gtk_mandel_notify_update;
 	mandel->renderer = renderer;
 
-	/* Clear image */
-	if (mandel->pixbuf != NULL)
+	/*
+	 * The preview has so few pixels that it is done long before the first
+	 * pass over the full resolution, so it fills the widget quickly. It
+	 * uses the reference orbit of the renderer instead of its own.
+	 */
+	if (mandel->cur_w >= 2 * PREVIEW_SCALE && mandel->cur_h >= 2 * PREVIEW_SCALE) {
+		struct mandel_renderer *preview = malloc (sizeof (*preview));
+		mandel_renderer_init_preview (preview, renderer, PREVIEW_SCALE);
+		preview->render_method = mandel->render_method;
+		preview->thread_count = mandel->thread_count;
+		preview->user_data = mandel;
+		mandel->preview = preview;
+	}
+
+	/* Until then, show the last frame moved and scaled to the new area. */
+	if (mandel->pixbuf != NULL) {
+		g_mutex_lock (mandel->pb_mutex);
+		scale_last_frame (mandel, last);
+		g_mutex_unlock (mandel->pb_mutex);
+	}
+	if (last != NULL) {
+		mandel_renderer_clear (last);
+		free (last);
+	}
+	if (mandel->gc != NULL)
+		redraw_area (mandel, 0, 0, mandel->cur_w, mandel->cur_h);
+}
+
+
+/*
+ * Fills the pixbuf with the part of the last frame which is still visible
+ * with the new renderer, scaled to its pixel spacing, and the rest with
+ * black. The pixbuf must still contain the last frame, rendered by last
+ * (which may be NULL). The caller must hold pb_mutex.
+ */
+static void
+scale_last_frame (GtkMandel *mandel, const struct mandel_renderer *last)
+{
+	const struct mandel_renderer *renderer = mandel->renderer;
+
+	if (last == NULL || last->w / last->aa_level != (unsigned) mandel->cur_w || last->h / last->aa_level != (unsigned) mandel->cur_h || last->md->type != renderer->md->type) {
 		gdk_pixbuf_fill (mandel->pixbuf, 0);
-	if (mandel->gc != NULL) {
-		gdk_gc_set_foreground (mandel->gc, &mandel->black);
-		gdk_draw_rectangle (GDK_DRAWABLE (widget->window), mandel->gc, true, 0, 0, mandel->cur_w, mandel->cur_h);
+		return;
 	}
+
+	/* The new pixel spacing and upper left corner, in pixels of the last frame */
+	mpf_t last_pitch, tmp;
+	mpf_init (last_pitch);
+	mpf_init (tmp);
+	mpf_sub (last_pitch, last->xmax_f, last->xmin_f);
+	mpf_div_ui (last_pitch, last_pitch, mandel->cur_w);
+	mpf_sub (tmp, renderer->xmax_f, renderer->xmin_f);
+	mpf_div_ui (tmp, tmp, mandel->cur_w);
+	mpf_div (tmp, tmp, last_pitch);
+	const double scale = mpf_get_d (tmp);
+	mpf_sub (tmp, renderer->xmin_f, last->xmin_f);
+	mpf_div (tmp, tmp, last_pitch);
+	const double x0 = mpf_get_d (tmp);
+	mpf_sub (tmp, last->ymax_f, renderer->ymax_f);
+	mpf_div (tmp, tmp, last_pitch);
+	const double y0 = mpf_get_d (tmp);
+	mpf_clear (tmp);
+	mpf_clear (last_pitch);
+
+	/* The new pixels which lie within the last frame */
+	const double dx0 = MAX (0.0, ceil (-x0 / scale)), dx1 = MIN ((double) mandel->cur_w, ceil ((mandel->cur_w - x0) / scale));
+	const double dy0 = MAX (0.0, ceil (-y0 / scale)), dy1 = MIN ((double) mandel->cur_h, ceil ((mandel->cur_h - y0) / scale));
+
+	GdkPixbuf *frame = gdk_pixbuf_copy (mandel->pixbuf);
+	gdk_pixbuf_fill (mandel->pixbuf, 0);
+	if (scale > 0.0 && dx0 < dx1 && dy0 < dy1)
+		gdk_pixbuf_scale (frame, mandel->pixbuf, (int) dx0, (int) dy0, (int) (dx1 - dx0), (int) (dy1 - dy0), -x0 / scale, -y0 / scale, 1.0 / scale, 1.0 / scale, GDK_INTERP_NEAREST);
+	g_object_unref (G_OBJECT (frame));
 }
 
 
@@ -251,12 +328,13 @@ gtk_mandel_start (GtkMandel *mandel)
 
 	mandel->redraw_source_id = g_timeout_add (500, redraw_source_func, mandel);
 
-	GError *thread_err;
-	mandel->thread = g_thread_create (calcmandel, (gpointer) mandel->renderer, true, &thread_err);
-	if (mandel->thread == NULL) {
-		fprintf (stderr, "* BUG: g_thread_create() error: %s\n", thread_err->message);
-		g_error_free (thread_err);
-	}
+	/*
+	 * The render thread comes from the thread pool, as do the threads used
+	 * by mandel_render(), so they are reused from one frame to the next.
+	 */
+	mandel->job = thread_pool_job_new (calcmandel, mandel->renderer, 1);
+	thread_pool_job_add (mandel->job, 0, 0, 0, 0);
+	thread_pool_job_start (mandel->job);
 }
 
 
@@ -437,20 +515,23 @@ my_expose (GtkWidget *widget, GdkEventExpose *event, gpointer user_data)
 static void
 gtk_mandel_notify_update (unsigned x, unsigned y, unsigned w, unsigned h, void *user_data)
 {
-	int xi, yi;
+	struct mandel_tile_iter iter;
+	int xi, yi, tx, ty, tw, th;
 
 	GtkMandel *mandel = GTK_MANDEL (user_data);
 
 	g_mutex_lock (mandel->pb_mutex);
-	for (xi = x; xi < x + w; xi++)
-		for (yi = y; yi < y + h; yi++) {
-			guchar *p = mandel->pb_data + yi * mandel->pb_rowstride + xi * mandel->pb_nchan;
-			struct color color;
-			mandel_get_pixel (mandel->renderer, xi, yi, &color);
-			p[0] = color.r >> 8;
-			p[1] = color.g >> 8;
-			p[2] = color.b >> 8;
-		}
+	mandel_tile_iter_init (&iter, mandel->renderer, x, y, w, h);
+	while (mandel_tile_iter_next (&iter, &tx, &ty, &tw, &th))
+		for (yi = ty; yi < ty + th; yi++)
+			for (xi = tx; xi < tx + tw; xi++) {
+				guchar *p = mandel->pb_data + yi * mandel->pb_rowstride + xi * mandel->pb_nchan;
+				struct color color;
+				mandel_get_pixel (mandel->renderer, xi, yi, &color);
+				p[0] = color.r >> 8;
+				p[1] = color.g >> 8;
+				p[2] = color.b >> 8;
+			}
 
 	if (mandel->need_redraw) {
 		if (x < mandel->pb_xmin)
@@ -473,12 +554,18 @@ gtk_mandel_notify_update (unsigned x, unsigned y, unsigned w, unsigned h, void *
 }
 
 
-static gpointer
-calcmandel (gpointer data)
+static void
+calcmandel (struct thread_pool_job *job, unsigned worker, void *data, const int *args)
 {
 	struct mandel_renderer *renderer = (struct mandel_renderer *) data;
 	GtkMandel *mandel = GTK_MANDEL (renderer->user_data);
 
+	if (mandel->preview != NULL) {
+		mandel_render (mandel->preview);
+		if (!renderer->terminate)
+			show_preview (mandel, mandel->preview);
+	}
+
 	mandel_render (renderer);
 
 	if (!g_source_remove (mandel->redraw_source_id))
@@ -489,9 +576,42 @@ calcmandel (gpointer data)
 	struct rendering_stopped_info *info = malloc (sizeof (struct rendering_stopped_info));
 	info->mandel = mandel;
 	info->completed = !renderer->terminate;
+	info->stats = renderer->stats;
 	g_idle_add (do_emit_rendering_stopped, info);
+}
+
+
+/* Copies the preview into the pixbuf, each pixel of it enlarged to a block. */
+static void
+show_preview (GtkMandel *mandel, const struct mandel_renderer *preview)
+{
+	const int pw = preview->w, ph = preview->h;
+	int px, py, xi, yi;
 
-	return NULL;
+	g_mutex_lock (mandel->pb_mutex);
+	for (py = 0; py < ph; py++) {
+		const int y0 = py * mandel->cur_h / ph, y1 = (py + 1) * mandel->cur_h / ph;
+		for (px = 0; px < pw; px++) {
+			const int x0 = px * mandel->cur_w / pw, x1 = (px + 1) * mandel->cur_w / pw;
+			struct color color;
+			mandel_get_pixel (preview, px, py, &color);
+			for (yi = y0; yi < y1; yi++)
+				for (xi = x0; xi < x1; xi++) {
+					guchar *p = mandel->pb_data + yi * mandel->pb_rowstride + xi * mandel->pb_nchan;
+					p[0] = color.r >> 8;
+					p[1] = color.g >> 8;
+					p[2] = color.b >> 8;
+				}
+		}
+	}
+	mandel->need_redraw = true;
+	mandel->pb_xmin = 0;
+	mandel->pb_ymin = 0;
+	mandel->pb_xmax = mandel->cur_w;
+	mandel->pb_ymax = mandel->cur_h;
+	g_mutex_unlock (mandel->pb_mutex);
+
+	g_idle_add (redraw_source_func_once, mandel);
 }
 
 
@@ -566,6 +686,7 @@ do_emit_rendering_stopped (gpointer data)
 	struct rendering_stopped_info *info = (struct rendering_stopped_info *) data;
 	GtkMandel *mandel = info->mandel;
 	gboolean completed = info->completed;
+	mandel->stats = info->stats;
 	free (info);
 	g_signal_emit (G_OBJECT (mandel), GTK_MANDEL_GET_CLASS (mandel)->rendering_stopped_signal, 0, completed);
 	return FALSE;
@@ -672,6 +793,14 @@ gtk_mandel_get_progress (GtkMandel *mandel)
 }
 
 
+/* Statistics of the last frame which was finished or stopped. */
+const struct mandel_render_stats *
+gtk_mandel_get_render_stats (GtkMandel *mandel)
+{
+	return &mandel->stats;
+}
+
+
 static void
 gtk_mandel_dispose (GObject *object)
 {
@@ -699,6 +828,11 @@ gtk_mandel_finalize (GObject *object)
 	//fprintf (stderr, "* DEBUG: finalizing GtkMandel\n");
 	GtkMandel *mandel = GTK_MANDEL (object);
 	g_mutex_free (mandel->pb_mutex);
+	/* The preview shares the state of the renderer, so it goes first. */
+	if (mandel->preview != NULL) {
+		mandel_renderer_clear (mandel->preview);
+		free (mandel->preview);
+	}
 	if (mandel->renderer != NULL) {
 		mandel_renderer_clear (mandel->renderer);
 		free (mandel->renderer);
@@ -4,6 +4,7 @@
 
 #include "fractal-render.h"
 #include "gui-util.h"
+#include "thread-pool.h"
 
 
 typedef enum {
@@ -25,12 +26,14 @@ typedef struct
 	int pb_xmin, pb_xmax, pb_ymin, pb_ymax; /* These indicate the area that has been updated and must be redrawn on screen. */
 	GdkGC *gc, *frame_gc;
 	GdkColor black, red, white;
-	GThread *thread;
+	struct thread_pool_job *job;
 	const struct mandeldata *md;
 	render_method_t render_method;
 	unsigned thread_count;
 	unsigned aa_level;
 	struct mandel_renderer *renderer;
+	struct mandel_renderer *preview; /* at a lower resolution, rendered first */
+	struct mandel_render_stats stats;
 	volatile guint redraw_source_id;
 	gdouble center_x, center_y, selection_size;
 	int cur_w, cur_h;
@@ -71,5 +74,6 @@ void gtk_mandel_stop (GtkMandel *mandel);
 void gtk_mandel_redraw (GtkMandel *mandel);
 void gtk_mandel_set_selection_type (GtkMandel *mandel, GtkMandelSelectionType selection_type);
 double gtk_mandel_get_progress (GtkMandel *mandel);
+const struct mandel_render_stats *gtk_mandel_get_render_stats (GtkMandel *mandel);
 
 #endif /* _GTKMANDEL_H */
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -10,13 +11,17 @@
 #include "util.h"
 
 
+#define STATS_ITEMS 5
+
 struct _FractalInfoDialogPrivate {
 	GtkTextBuffer *center_buffers[3], *corner_buffers[4];
+	GtkWidget *stats_labels[STATS_ITEMS];
 	bool disposed;
 };
 
 
 static GtkTextBuffer *create_area_info_item (GtkWidget *table, int i, const char *label);
+static GtkWidget *create_stats_item (GtkWidget *table, int i, const char *label);
 static void fractal_info_dialog_class_init (gpointer g_class, gpointer data);
 static void fractal_info_dialog_init (GTypeInstance *instance, gpointer g_class);
 static void fractal_info_dialog_dispose (GObject *object);
@@ -92,6 +97,18 @@ fractal_info_dialog_init (GTypeInstance *instance, gpointer g_class)
 	priv->corner_buffers[2] = create_area_info_item (container, 2, "ymin");
 	priv->corner_buffers[3] = create_area_info_item (container, 3, "ymax");
 
+	container = gtk_table_new (2, STATS_ITEMS, false);
+	gtk_notebook_append_page (GTK_NOTEBOOK (notebook), container, gtk_label_new ("Statistics"));
+	gtk_table_set_homogeneous (GTK_TABLE (container), FALSE);
+	gtk_table_set_row_spacings (GTK_TABLE (container), 2);
+	gtk_table_set_col_spacings (GTK_TABLE (container), 8);
+	gtk_container_set_border_width (GTK_CONTAINER (container), 2);
+	priv->stats_labels[0] = create_stats_item (container, 0, "Computed pixels");
+	priv->stats_labels[1] = create_stats_item (container, 1, "Inferred pixels");
+	priv->stats_labels[2] = create_stats_item (container, 2, "Iterations");
+	priv->stats_labels[3] = create_stats_item (container, 3, "Arithmetic");
+	priv->stats_labels[4] = create_stats_item (container, 4, "Pass times");
+
 	gtk_widget_show_all (GTK_WIDGET (GTK_DIALOG (dlg)->vbox));
 }
 
@@ -112,6 +129,18 @@ create_area_info_item (GtkWidget *table, int i, const char *label)
 }
 
 
+static GtkWidget *
+create_stats_item (GtkWidget *table, int i, const char *label)
+{
+	GtkWidget *widget;
+	gtk_table_attach (GTK_TABLE (table), my_gtk_label_new_with_align (label, NULL, 0.0, 0.5), 0, 1, i, i + 1, GTK_FILL, 0, 0, 0);
+	widget = my_gtk_label_new_with_align ("-", NULL, 0.0, 0.5);
+	gtk_label_set_selectable (GTK_LABEL (widget), TRUE);
+	gtk_table_attach (GTK_TABLE (table), widget, 1, 2, i, i + 1, GTK_EXPAND | GTK_FILL, 0, 0, 0);
+	return widget;
+}
+
+
 void
 fractal_info_dialog_set_mandeldata (FractalInfoDialog *dlg, const struct mandeldata *md, double aspect)
 {
@@ -151,6 +180,38 @@ fractal_info_dialog_set_mandeldata (FractalInfoDialog *dlg, const struct mandeld
 }
 
 
+/* Shows the statistics of the last rendered frame. */
+void
+fractal_info_dialog_set_render_stats (FractalInfoDialog *dlg, const struct mandel_render_stats *stats)
+{
+	FractalInfoDialogPrivate *priv = dlg->priv;
+	if (priv->disposed)
+		return;
+
+	const uint64_t pixels = stats->pixels_computed + stats->pixels_inferred;
+	char buf[256];
+	int i, len;
+
+	snprintf (buf, sizeof (buf), "%llu", (unsigned long long) stats->pixels_computed);
+	gtk_label_set_text (GTK_LABEL (priv->stats_labels[0]), buf);
+	snprintf (buf, sizeof (buf), "%llu (%.1f%%)", (unsigned long long) stats->pixels_inferred, pixels > 0 ? 100.0 * stats->pixels_inferred / pixels : 0.0);
+	gtk_label_set_text (GTK_LABEL (priv->stats_labels[1]), buf);
+	snprintf (buf, sizeof (buf), "%llu (%llu saved)", (unsigned long long) stats->iterations, (unsigned long long) stats->saved_iterations);
+	gtk_label_set_text (GTK_LABEL (priv->stats_labels[2]), buf);
+
+	buf[0] = '\0';
+	for (i = 0, len = 0; i < COMPUTE_MAX && len >= 0 && len < sizeof (buf); i++)
+		if (stats->pixels_by_mode[i] > 0)
+			len += snprintf (buf + len, sizeof (buf) - len, "%s%s: %llu", len > 0 ? ", " : "", compute_mode_names[i], (unsigned long long) stats->pixels_by_mode[i]);
+	gtk_label_set_text (GTK_LABEL (priv->stats_labels[3]), buf);
+
+	buf[0] = '\0';
+	for (i = 0, len = 0; i < stats->passes && len >= 0 && len < sizeof (buf); i++)
+		len += snprintf (buf + len, sizeof (buf) - len, "%s%.3f", len > 0 ? " " : "", stats->pass_time[i]);
+	gtk_label_set_text (GTK_LABEL (priv->stats_labels[4]), buf);
+}
+
+
 FractalInfoDialog *
 fractal_info_dialog_new (GtkWindow *parent)
 {
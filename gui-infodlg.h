@@ -23,6 +23,7 @@ GType fractal_info_dialog_get_type (void);
 FractalInfoDialog *fractal_info_dialog_new (GtkWindow *parent);
 
 void fractal_info_dialog_set_mandeldata (FractalInfoDialog *dlg, const struct mandeldata *md, double aspect);
+void fractal_info_dialog_set_render_stats (FractalInfoDialog *dlg, const struct mandel_render_stats *stats);
 
 #define TYPE_FRACTAL_INFO_DIALOG (fractal_info_dialog_get_type ())
 #define FRACTAL_INFO_DIALOG(obj) (GTK_CHECK_CAST ((obj), fractal_info_dialog_get_type (), FractalInfoDialog))
@@ -162,6 +162,16 @@ fractal_main_window_class_init (gpointer g_class_, gpointer data)
 		G_TYPE_NONE,
 		0
 	);
+
+	g_class->render_stats_updated_signal = g_signal_new (
+		"render-stats-updated",
+		G_TYPE_FROM_CLASS (g_class),
+		G_SIGNAL_RUN_LAST,
+		0, NULL, NULL,
+		g_cclosure_marshal_VOID__VOID,
+		G_TYPE_NONE,
+		0
+	);
 }
 
 
@@ -576,6 +586,7 @@ rendering_stopped (FractalMainWindow *win, gboolean completed, gpointer data)
 	gtk_widget_set_sensitive (priv->stop, FALSE);
 	gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (priv->status_info), progress);
 	gtk_progress_bar_set_text (GTK_PROGRESS_BAR (priv->status_info), msg);
+	g_signal_emit (win, FRACTAL_MAIN_WINDOW_GET_CLASS (win)->render_stats_updated_signal, 0);
 }
 
 
@@ -730,6 +741,13 @@ fractal_main_window_get_mandeldata (FractalMainWindow *win)
 }
 
 
+const struct mandel_render_stats *
+fractal_main_window_get_render_stats (FractalMainWindow *win)
+{
+	return gtk_mandel_get_render_stats (GTK_MANDEL (win->priv->mandel));
+}
+
+
 void
 fractal_main_window_restart (FractalMainWindow *win)
 {
@@ -24,12 +24,14 @@ struct _FractalMainWindowClass {
 	guint info_dlg_signal;
 	guint type_dlg_signal;
 	guint about_dlg_signal;
+	guint render_stats_updated_signal;
 };
 
 GType fractal_main_window_get_class (void);
 FractalMainWindow *fractal_main_window_new (void);
 const struct mandeldata *fractal_main_window_get_mandeldata (FractalMainWindow *win);
 void fractal_main_window_set_mandeldata (FractalMainWindow *win, const struct mandeldata *md);
+const struct mandel_render_stats *fractal_main_window_get_render_stats (FractalMainWindow *win);
 void fractal_main_window_restart (FractalMainWindow *win);
 
 #define TYPE_FRACTAL_MAIN_WINDOW (fractal_main_window_get_type ())
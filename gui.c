@@ -25,6 +25,7 @@ static void connect_signals (GtkMandelApplication *app);
 static void open_coord_dlg_response (GtkMandelApplication *app, gint response, gpointer data);
 static void save_coord_dlg_response (GtkMandelApplication *app, gint response, gpointer data);
 static void mandeldata_updated (GtkMandelApplication *app, gpointer data);
+static void render_stats_updated (GtkMandelApplication *app, gpointer data);
 static void area_info_dlg_response (GtkMandelApplication *app, gpointer data);
 static void type_dlg_response (GtkMandelApplication *app, gint response, gpointer data);
 static GtkAboutDialog *create_about_dlg (GtkWindow *parent);
@@ -116,6 +117,8 @@ connect_signals (GtkMandelApplication *app)
 	g_signal_connect_object (G_OBJECT (app->main_window), "about-dialog-requested", (GCallback) about_dlg_requested, app, G_CONNECT_SWAPPED);
 
 	g_signal_connect_object (G_OBJECT (app->main_window), "mandeldata-updated", (GCallback) mandeldata_updated, app, G_CONNECT_SWAPPED);
+
+	g_signal_connect_object (G_OBJECT (app->main_window), "render-stats-updated", (GCallback) render_stats_updated, app, G_CONNECT_SWAPPED);
 }
 
 
@@ -156,6 +159,14 @@ mandeldata_updated (GtkMandelApplication *app, gpointer data)
 }
 
 
+static void
+render_stats_updated (GtkMandelApplication *app, gpointer data)
+{
+	if (app->fractal_info_dlg != NULL)
+		fractal_info_dialog_set_render_stats (app->fractal_info_dlg, fractal_main_window_get_render_stats (app->main_window));
+}
+
+
 static void
 area_info_dlg_response (GtkMandelApplication *app, gpointer data)
 {
@@ -236,6 +247,7 @@ info_dlg_requested (GtkMandelApplication *app, gpointer data)
 
 	}
 	fractal_info_dialog_set_mandeldata (app->fractal_info_dlg, fractal_main_window_get_mandeldata (app->main_window), 1.0 /* XXX aspect */);
+	fractal_info_dialog_set_render_stats (app->fractal_info_dlg, fractal_main_window_get_render_stats (app->main_window));
 	gtk_widget_show (GTK_WIDGET (app->fractal_info_dlg));
 }
 
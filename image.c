@@ -9,6 +9,7 @@
 
 #include "defs.h"
 #include "fractal-render.h"
+#include "fp-kernels.h"
 #include "file.h"
 #include "render-png.h"
 
@@ -18,6 +19,8 @@ static gint thread_count = 1;
 static gint compression = 9;
 static gchar *output_file = NULL;
 static gint aa_level = 1;
+static gint strip_height = 0;
+static gboolean print_stats = FALSE;
 
 static GOptionEntry option_entries[] = {
 	{"width", 'W', 0, G_OPTION_ARG_INT, &img_width, "Image width", "PIXELS"},
@@ -26,6 +29,8 @@ static GOptionEntry option_entries[] = {
 	{"compression", 'C', 0, G_OPTION_ARG_INT, &compression, "Compression level for PNG output (0..9)", "LEVEL"},
 	{"output-file", 'o', 0, G_OPTION_ARG_FILENAME, &output_file, "Output file", "NAME"},
 	{"anti-alias", 'a', 0, G_OPTION_ARG_INT, &aa_level, "Anti-aliasing level", "LEVEL"},
+	{"strip-height", 'S', 0, G_OPTION_ARG_INT, &strip_height, "Render in strips of N rows to save memory", "N"},
+	{"stats", 's', 0, G_OPTION_ARG_NONE, &print_stats, "Print rendering statistics", NULL},
 	{NULL}
 };
 
@@ -36,6 +41,8 @@ parse_command_line (int *argc, char ***argv)
 	GError *err = NULL;
 	GOptionContext *context = g_option_context_new (NULL);
 	g_option_context_add_main_entries (context, option_entries, "fractlab-image");
+	g_option_context_add_group (context, fp_kernel_get_option_group ());
+	g_option_context_add_group (context, fractal_math_get_option_group ());
 	if (!g_option_context_parse (context, argc, argv, &err)) {
 		fprintf (stderr, "* ERROR: %s\n", err->message);
 		return false;
@@ -71,7 +78,13 @@ main (int argc, char **argv)
 		fprintf (stderr, "%s: cannot read: %s\n", argv[1], errbuf);
 	}
 
-	render_to_png (&md, output_file, compression, NULL, img_width, img_height, thread_count, aa_level);
+	struct mandel_render_stats stats;
+	if (strip_height > 0)
+		render_to_png_strips (&md, output_file, compression, &stats, img_width, img_height, thread_count, aa_level, strip_height);
+	else
+		render_to_png (&md, output_file, compression, NULL, NULL, &stats, img_width, img_height, thread_count, aa_level);
+	if (print_stats)
+		mandel_render_stats_print (stderr, &stats);
 
 	return 0;
 }
@@ -5,6 +5,7 @@
 
 #include "anim.h"
 #include "file.h"
+#include "fp-kernels.h"
 
 /* preal = A * sin (a * t + delta); pimag = B * sin (b * t) */
 
@@ -63,6 +64,8 @@ main (int argc, char *argv[])
 	GOptionContext *context = g_option_context_new (NULL);
 	g_option_context_add_main_entries (context, option_entries, "lissajoulia");
 	g_option_context_add_group (context, anim_get_option_group ());
+	g_option_context_add_group (context, fp_kernel_get_option_group ());
+	g_option_context_add_group (context, fractal_math_get_option_group ());
 	g_option_context_parse (context, &argc, &argv, NULL);
 
 	state->delta *= M_PI;
@@ -7,10 +7,11 @@
 #include <gmp.h>
 
 #include "fpdefs.h"
+#include "dd-math.h"
+#include "floatexp.h"
 #include "misc-math.h"
 
 
-/* Currently unused. */
 unsigned *
 pascal_triangle (unsigned n)
 {
@@ -77,17 +78,25 @@ complex_pow_fp (mandel_fp_t xreal, mandel_fp_t ximag, unsigned n, mandel_fp_t *r
 }
 
 
+/*
+ * (real, imag) = (xreal + i ximag)^n for n >= 1. xsqr and ysqr are the
+ * squares of xreal and ximag, which the callers need for the bailout test
+ * anyway, so the first squaring comes for free.
+ */
 void
-complex_pow (mp_srcptr xreal, bool xreal_sign, mp_srcptr ximag, bool ximag_sign, unsigned n, mp_ptr real, bool *rreal_sign, mp_ptr imag, bool *rimag_sign, unsigned frac_limbs)
+complex_pow (mp_srcptr xreal, mp_srcptr ximag, mp_srcptr xsqr, mp_srcptr ysqr, unsigned n, mp_ptr real, mp_ptr imag, unsigned frac_limbs)
 {
 	unsigned total_limbs = INT_LIMBS + frac_limbs;
-	mp_limb_t real_buf[total_limbs], imag_buf[total_limbs], temp[total_limbs];
-	bool src_real_sign = xreal_sign, src_imag_sign = ximag_sign, dst_real_sign, dst_imag_sign;
-	mp_ptr src_real = real_buf, src_imag = imag_buf, dst_real = real, dst_imag = imag, temp_ptr;
-
-	/* XXX This copy could be avoided. */
-	memcpy (src_real, xreal, total_limbs * sizeof (*src_real));
-	memcpy (src_imag, ximag, total_limbs * sizeof (*src_imag));
+	mp_limb_t xreal_buf[total_limbs], ximag_buf[total_limbs], rsqr[total_limbs], isqr[total_limbs];
+
+	/* real and imag may be the same as xreal and ximag. */
+	memcpy (xreal_buf, xreal, total_limbs * sizeof (*xreal_buf));
+	memcpy (ximag_buf, ximag, total_limbs * sizeof (*ximag_buf));
+	if (n == 1) {
+		memcpy (real, xreal_buf, total_limbs * sizeof (*real));
+		memcpy (imag, ximag_buf, total_limbs * sizeof (*imag));
+		return;
+	}
 
 	/*
 	 * Use an integer of well-defined size, so we can safely check
@@ -103,88 +112,68 @@ complex_pow (mp_srcptr xreal, bool xreal_sign, mp_srcptr ximag, bool ximag_sign,
 	m <<= 1;
 	bits--;
 
+	/* The first squaring, using the given squares */
+	my_mpn_complex_sqr (real, imag, xreal_buf, ximag_buf, xsqr, ysqr, frac_limbs);
+	if ((m & (1 << 31)) != 0)
+		my_mpn_complex_mul (real, imag, real, imag, xreal_buf, ximag_buf, frac_limbs);
+	m <<= 1;
+
 	int i;
-	for (i = 0; i < bits; i++) {
+	for (i = 1; i < bits; i++) {
 		/* square */
-		my_mpn_mul_fast (dst_real, src_real, src_real, frac_limbs);
-		my_mpn_mul_fast (temp, src_imag, src_imag, frac_limbs);
-		dst_real_sign = my_mpn_add_signed (dst_real, dst_real, false, temp, true, frac_limbs);
-
-		my_mpn_mul_fast (dst_imag, src_real, src_imag, frac_limbs);
-		mpn_lshift (dst_imag, dst_imag, total_limbs, 1);
-		dst_imag_sign = src_real_sign != src_imag_sign;
+		my_mpn_ssqr_fast (rsqr, real, frac_limbs);
+		my_mpn_ssqr_fast (isqr, imag, frac_limbs);
+		my_mpn_complex_sqr (real, imag, real, imag, rsqr, isqr, frac_limbs);
 
-		/* swap src <-> dst */
-		temp_ptr = src_real;
-		src_real = dst_real;
-		dst_real = temp_ptr;
-
-		temp_ptr = src_imag;
-		src_imag = dst_imag;
-		dst_imag = temp_ptr;
-
-		src_real_sign = dst_real_sign;
-		src_imag_sign = dst_imag_sign;
-
-		if ((m & (1 << 31)) != 0) {
+		if ((m & (1 << 31)) != 0)
 			/* multiply by x */
-			my_mpn_mul_fast (dst_real, src_real, xreal, frac_limbs);
-			my_mpn_mul_fast (temp, src_imag, ximag, frac_limbs);
-			dst_real_sign = my_mpn_add_signed (dst_real, dst_real, src_real_sign != xreal_sign, temp, src_imag_sign == ximag_sign, frac_limbs);
-
-			my_mpn_mul_fast (dst_imag, src_real, ximag, frac_limbs);
-			my_mpn_mul_fast (temp, src_imag, xreal, frac_limbs);
-			dst_imag_sign = my_mpn_add_signed (dst_imag, dst_imag, src_real_sign != ximag_sign, temp, src_imag_sign != xreal_sign, frac_limbs);
-
-			/* swap src <-> dst */
-			temp_ptr = src_real;
-			src_real = dst_real;
-			dst_real = temp_ptr;
-
-			temp_ptr = src_imag;
-			src_imag = dst_imag;
-			dst_imag = temp_ptr;
-
-			src_real_sign = dst_real_sign;
-			src_imag_sign = dst_imag_sign;
-		}
+			my_mpn_complex_mul (real, imag, real, imag, xreal_buf, ximag_buf, frac_limbs);
 
 		m <<= 1;
 	}
-
-	*rreal_sign = src_real_sign;
-	if (src_real != real)
-		memcpy (real, src_real, total_limbs * sizeof (*real));
-
-	*rimag_sign = src_imag_sign;
-	if (src_imag != imag)
-		memcpy (imag, src_imag, total_limbs * sizeof (*imag));
 }
 
 
-bool
+void
 my_mpf_get_mpn (mp_ptr rop, mpf_srcptr op, unsigned frac_limbs)
 {
-	const unsigned total_limbs = INT_LIMBS + frac_limbs;
+	const int total_limbs = INT_LIMBS + frac_limbs;
+	const int size = op->_mp_size < 0 ? -op->_mp_size : op->_mp_size;
+	/*
+	 * DIRTY as well, but without a temporary mpf and mpz: limb j of the
+	 * result is limb j - shift of the mantissa, the ones below are
+	 * truncated like mpz_set_f() would.
+	 */
+	const int shift = op->_mp_exp - size + (int) frac_limbs;
 	int i;
-	mpf_t f;
-	mpz_t z;
-	mpf_init2 (f, total_limbs * GMP_NUMB_BITS);
-	mpz_init (z);
-	mpf_mul_2exp (f, op, frac_limbs * GMP_NUMB_BITS);
-	mpz_set_f (z, f);
-	mpf_clear (f);
 	for (i = 0; i < total_limbs; i++)
-		rop[i] = mpz_getlimbn (z, i);
-	mpz_clear (z);
-	return mpf_sgn (op) < 0;
+		rop[i] = i - shift >= 0 && i - shift < size ? op->_mp_d[i - shift] : 0;
+	if (op->_mp_size < 0)
+		mpn_neg (rop, rop, total_limbs);
+}
+
+
+/* The number of fraction bits needed to represent op exactly. */
+unsigned
+my_mpf_frac_bits (mpf_srcptr op)
+{
+	const int size = op->_mp_size < 0 ? -op->_mp_size : op->_mp_size;
+	int low = 0;
+	while (low < size && op->_mp_d[low] == 0)
+		low++;
+	if (low == size)
+		return 0;
+	const long bits = (long) (size - low - op->_mp_exp) * GMP_NUMB_BITS - mpn_scan1 (op->_mp_d + low, 0);
+	return bits > 0 ? (unsigned) bits : 0;
 }
 
 
 void
-my_mpn_get_mpf (mpf_ptr rop, mp_srcptr op, bool sign, unsigned frac_limbs)
+my_mpn_get_mpf (mpf_ptr rop, mp_srcptr op, unsigned frac_limbs)
 {
 	const unsigned total_limbs = frac_limbs + INT_LIMBS;
+	mp_limb_t abs[total_limbs];
+	const bool sign = my_mpn_abs (abs, op, frac_limbs);
 	int i;
 	/* DIRTY! */
 	mpf_set_prec (rop, total_limbs * mp_bits_per_limb);
@@ -192,15 +181,88 @@ my_mpn_get_mpf (mpf_ptr rop, mp_srcptr op, bool sign, unsigned frac_limbs)
 	rop->_mp_exp = INT_LIMBS;
 	bool zero = true;
 	for (i = total_limbs - 1; i >= 0; i--)
-		if (zero && op[i] == 0) {
+		if (zero && abs[i] == 0) {
 			rop->_mp_size--;
 			rop->_mp_exp--;
 		} else {
 			zero = false;
-			rop->_mp_d[i] = op[i];
+			rop->_mp_d[i] = abs[i];
 		}
 	if (sign)
 		mpf_neg (rop, rop);
 }
 
 
+
+
+mandel_fp_t
+my_mpn_get_fp (mp_srcptr op, unsigned frac_limbs)
+{
+	const unsigned total_limbs = frac_limbs + INT_LIMBS;
+	mp_limb_t abs[total_limbs];
+	const bool sign = my_mpn_abs (abs, op, frac_limbs);
+	/* The same as ldexp (r, -GMP_NUMB_BITS), but without the call */
+	const mandel_fp_t limb_scale = ldexp (1.0, -GMP_NUMB_BITS);
+	mandel_fp_t r = 0.0;
+	int i;
+	/* Horner scheme, starting at the least significant limb */
+	for (i = 0; i < total_limbs; i++)
+		r = r * limb_scale + (mandel_fp_t) abs[i];
+	r = ldexp (r, (INT_LIMBS - 1) * GMP_NUMB_BITS);
+	return sign ? -r : r;
+}
+
+
+/*
+ * mpf_get_d() truncates, so the low part may have the wrong sign and the
+ * two parts need to be renormalized.
+ */
+void
+mpf_get_dd (struct mandel_dd *rop, mpf_srcptr op)
+{
+	mpf_t rest, tmp;
+	mandel_fp_t hi, lo;
+	mpf_init2 (rest, mpf_get_prec (op));
+	mpf_init2 (tmp, 64);
+	hi = mpf_get_d (op);
+	mpf_set_d (tmp, hi);
+	mpf_sub (rest, op, tmp);
+	lo = mpf_get_d (rest);
+	mpf_clear (rest);
+	mpf_clear (tmp);
+	rop->hi = dd_quick_two_sum (hi, lo, &rop->lo);
+}
+
+
+void
+mpf_get_fe (struct mandel_fe *rop, mpf_srcptr op)
+{
+	long exp;
+	mandel_fp_t mant = mpf_get_d_2exp (&exp, op);
+	*rop = fe_set_2exp (mant, exp);
+}
+
+
+void
+mpf_set_fe (mpf_ptr rop, const struct mandel_fe *op)
+{
+	mpf_set_d (rop, op->mant);
+	if (op->mant == 0.0)
+		return;
+	if (op->exp >= 0)
+		mpf_mul_2exp (rop, rop, op->exp);
+	else
+		mpf_div_2exp (rop, rop, -op->exp);
+}
+
+
+/*
+ * The distance estimate log |z|^2 * |z| / |dz/dc| for the final z = (x, y),
+ * which is small enough for FP after the bailout.
+ */
+void
+mp_derivative_distance (struct mandel_fe *rop, mandel_fp_t x, mandel_fp_t y, const struct mp_derivative *der)
+{
+	const mandel_fp_t zabs = sqrt (x * x + y * y);
+	*rop = fe_div (fe_set_d (log (zabs * zabs) * zabs), fe_set_2exp (hypot (der->x, der->y), der->exp));
+}
@@ -5,79 +5,235 @@
  * INT_LIMBS is the number of mp_limb_t's to use for the integer part of
  * the number in fixed-point MP math. It probably shouldn't be defined
  * statically.
+ * The numbers are stored in two's complement, so adding and subtracting
+ * them doesn't depend on their signs. The highest bit of the integer part
+ * is the sign bit.
  */
 #define INT_LIMBS 1
 
 unsigned *pascal_triangle (unsigned n);
 void complex_pow_fp (mandel_fp_t xreal, mandel_fp_t ximag, unsigned n, mandel_fp_t *rreal, mandel_fp_t *rimag);
-void complex_pow (mp_srcptr xreal, bool xreal_sign, mp_srcptr ximag, bool ximag_sign, unsigned n, mp_ptr real, bool *rreal_sign, mp_ptr imag, bool *rimag_sign, unsigned frac_limbs);
+void complex_pow (mp_srcptr xreal, mp_srcptr ximag, mp_srcptr xsqr, mp_srcptr ysqr, unsigned n, mp_ptr real, mp_ptr imag, unsigned frac_limbs);
 
-void my_mpn_get_mpf (mpf_ptr rop, mp_srcptr op, bool sign, unsigned frac_limbs);
-bool my_mpf_get_mpn (mp_ptr rop, mpf_srcptr op, unsigned frac_limbs);
+void my_mpn_get_mpf (mpf_ptr rop, mp_srcptr op, unsigned frac_limbs);
+void my_mpf_get_mpn (mp_ptr rop, mpf_srcptr op, unsigned frac_limbs);
+unsigned my_mpf_frac_bits (mpf_srcptr op);
+mandel_fp_t my_mpn_get_fp (mp_srcptr op, unsigned frac_limbs);
+
+struct mandel_dd;
+struct mandel_fe;
+void mpf_get_dd (struct mandel_dd *rop, mpf_srcptr op);
+void mpf_get_fe (struct mandel_fe *rop, mpf_srcptr op);
+void mpf_set_fe (mpf_ptr rop, const struct mandel_fe *op);
+
+struct mp_derivative;
+void mp_derivative_distance (struct mandel_fe *rop, mandel_fp_t x, mandel_fp_t y, const struct mp_derivative *der);
+
+/*
+ * my_mpn_mul_fast() leaves out the partial products which only affect the
+ * limbs more than this many limbs below the fraction of the result.
+ */
+#define MPN_MUL_GUARD_LIMBS 1
+
+/*
+ * The derivative dz/dc for distance estimation in fixed-point MP. FP
+ * precision is plenty for it, but it outgrows the FP range at deep zooms,
+ * so it is kept as (x + iy) * 2^exp with one exponent for both parts.
+ * one is 1 * 2^-exp, the summand of each iteration. Unlike floatexp, the
+ * parts are only rescaled (by 2^-MP_DERIVATIVE_EXP_STEP) when the sum of
+ * their absolute values exceeds MP_DERIVATIVE_MAX.
+ */
+struct mp_derivative {
+	mandel_fp_t x, y, one;
+	int64_t exp;
+};
+
+#define MP_DERIVATIVE_EXP_STEP 256
+#define MP_DERIVATIVE_MAX 0x1p256
 
 static inline void my_mpn_mul_fast (mp_ptr p, mp_srcptr f0, mp_srcptr f1, unsigned frac_limbs);
-static inline void my_mpn_invert (mp_ptr op, unsigned total_limbs);
+static inline void my_mpn_sqr_fast (mp_ptr p, mp_srcptr f, unsigned frac_limbs);
+static inline bool my_mpn_sign (mp_srcptr op, unsigned frac_limbs);
+static inline bool my_mpn_abs (mp_ptr rop, mp_srcptr op, unsigned frac_limbs);
+static inline void my_mpn_smul_fast (mp_ptr p, mp_srcptr f0, mp_srcptr f1, unsigned frac_limbs);
+static inline void my_mpn_ssqr_fast (mp_ptr p, mp_srcptr f, unsigned frac_limbs);
+static inline void my_mpn_complex_sqr (mp_ptr real, mp_ptr imag, mp_srcptr x, mp_srcptr y, mp_srcptr xsqr, mp_srcptr ysqr, unsigned frac_limbs);
+static inline void my_mpn_complex_mul (mp_ptr real, mp_ptr imag, mp_srcptr a, mp_srcptr b, mp_srcptr c, mp_srcptr d, unsigned frac_limbs);
+static inline void mp_derivative_init (struct mp_derivative *der);
+static inline void mp_derivative_step (struct mp_derivative *der, mandel_fp_t factor, mandel_fp_t treal, mandel_fp_t timag);
+
 
 /*
- * FIXME: Despite the name, this routine isn't especially fast.
- * It should probably suffice to multiply only part of the operands,
- * ignoring a few of the least significant limbs, but when I tried this
- * resulted in a significant loss of precision.
+ * Fixed-point multiplication as a short product: only the partial products
+ * f0[i] * f1[j] with i + j >= frac_limbs - MPN_MUL_GUARD_LIMBS are added up,
+ * which is about half of them for many limbs.
+ * Error bound: each of the left out partial products is below B^2 (with
+ * B = 2^GMP_NUMB_BITS), and there are s + 1 of them at limb s, so together
+ * they are below (frac_limbs - MPN_MUL_GUARD_LIMBS) * B^(frac_limbs -
+ * MPN_MUL_GUARD_LIMBS + 1). With one guard limb, the result is therefore
+ * at most frac_limbs - 1 units in the last place below the truncated exact
+ * product, which is a few bits of the lowest limb.
  */
 static inline void
 my_mpn_mul_fast (mp_ptr p, mp_srcptr f0, mp_srcptr f1, unsigned frac_limbs)
 {
-	unsigned total_limbs = INT_LIMBS + frac_limbs;
+	const unsigned total_limbs = INT_LIMBS + frac_limbs;
+	/* The lowest limb of the product which is calculated */
+	const unsigned low = frac_limbs > MPN_MUL_GUARD_LIMBS ? frac_limbs - MPN_MUL_GUARD_LIMBS : 0;
 	mp_limb_t tmp[total_limbs * 2];
-	int i;
-	mpn_mul (tmp, f0, total_limbs, f1, total_limbs);
+	unsigned i;
+
+	if (low == 0)
+		mpn_mul_n (tmp, f0, f1, total_limbs);
+	else {
+		/* Row i adds f0[i] * f1[j] for j >= low - i, starting at limb low. */
+		tmp[total_limbs] = mpn_mul_1 (tmp + low, f1 + low, total_limbs - low, f0[0]);
+		for (i = 1; i < total_limbs; i++) {
+			const unsigned j = i < low ? low - i : 0;
+			tmp[total_limbs + i] = mpn_addmul_1 (tmp + i + j, f1 + j, total_limbs - j, f0[i]);
+		}
+	}
 	for (i = 0; i < total_limbs; i++)
 		p[i] = tmp[frac_limbs + i];
 }
 
 
+/*
+ * Fixed-point squaring. mpn_sqr() only needs about half of the partial
+ * products because of the symmetry, and the result is exact except for
+ * the truncation.
+ */
+static inline void
+my_mpn_sqr_fast (mp_ptr p, mp_srcptr f, unsigned frac_limbs)
+{
+	const unsigned total_limbs = INT_LIMBS + frac_limbs;
+	mp_limb_t tmp[total_limbs * 2];
+	unsigned i;
+	mpn_sqr (tmp, f, total_limbs);
+	for (i = 0; i < total_limbs; i++)
+		p[i] = tmp[frac_limbs + i];
+}
+
+
+/* Whether op is negative */
 static inline bool
-my_mpn_add_signed (mp_ptr rop, mp_srcptr op1, bool op1_sign, mp_srcptr op2, bool op2_sign, unsigned frac_limbs)
+my_mpn_sign (mp_srcptr op, unsigned frac_limbs)
 {
-	unsigned total_limbs = INT_LIMBS + frac_limbs;
-	if (op1_sign == op2_sign) {
-		mpn_add_n (rop, op1, op2, total_limbs);
-		return op1_sign;
-	} else {
-#ifdef MY_MPN_SUB_SLOW
-		if (mpn_cmp (op1, op2, total_limbs) > 0) {
-			mpn_sub_n (rop, op1, op2, total_limbs);
-			return op1_sign;
-		} else {
-			mpn_sub_n (rop, op2, op1, total_limbs);
-			return op2_sign;
-		}
-#else /* MY_MPN_SUB_SLOW */
-		if (mpn_sub_n (rop, op1, op2, total_limbs) != 0) {
-			my_mpn_invert (rop, total_limbs);
-			return op2_sign;
-		} else
-			return op1_sign;
-#endif /* MY_MPN_SUB_SLOW */
-	}
+	return (op[INT_LIMBS + frac_limbs - 1] >> (GMP_NUMB_BITS - 1)) != 0;
 }
 
 
-/* XXX this doesn't work with GMP nails */
+/* rop = |op|, returns whether op is negative. rop may be the same as op. */
+static inline bool
+my_mpn_abs (mp_ptr rop, mp_srcptr op, unsigned frac_limbs)
+{
+	const unsigned total_limbs = INT_LIMBS + frac_limbs;
+	const bool sign = my_mpn_sign (op, frac_limbs);
+	if (sign)
+		mpn_neg (rop, op, total_limbs);
+	else if (rop != op)
+		mpn_copyi (rop, op, total_limbs);
+	return sign;
+}
+
+
+/*
+ * my_mpn_mul_fast() for signed numbers. A negative f0 is f0 + B^total_limbs
+ * as an unsigned number, so the unsigned product is too large by
+ * f1 * B^total_limbs, which is f1 shifted up by INT_LIMBS in the result
+ * (and the same with f0 and f1 swapped). The correction is exact, so the
+ * result is rounded down like the unsigned one. p must not overlap f0 or f1.
+ */
 static inline void
-my_mpn_invert (mp_ptr op, unsigned total_limbs)
+my_mpn_smul_fast (mp_ptr p, mp_srcptr f0, mp_srcptr f1, unsigned frac_limbs)
 {
-	int i = 0;
-	while (i < total_limbs) {
-		bool bk = op[i] != 0;
-		op[i] = ~op[i] + 1;
-		i++;
-		if (bk)
-			break;
+	my_mpn_mul_fast (p, f0, f1, frac_limbs);
+	if (my_mpn_sign (f0, frac_limbs))
+		mpn_sub_n (p + INT_LIMBS, p + INT_LIMBS, f1, frac_limbs);
+	if (my_mpn_sign (f1, frac_limbs))
+		mpn_sub_n (p + INT_LIMBS, p + INT_LIMBS, f0, frac_limbs);
+}
+
+
+/*
+ * my_mpn_sqr_fast() for signed numbers, corrected like my_mpn_smul_fast().
+ * The result is the same as for |f|. p must not overlap f.
+ */
+static inline void
+my_mpn_ssqr_fast (mp_ptr p, mp_srcptr f, unsigned frac_limbs)
+{
+	my_mpn_sqr_fast (p, f, frac_limbs);
+	if (my_mpn_sign (f, frac_limbs)) {
+		mpn_sub_n (p + INT_LIMBS, p + INT_LIMBS, f, frac_limbs);
+		mpn_sub_n (p + INT_LIMBS, p + INT_LIMBS, f, frac_limbs);
 	}
-	while (i < total_limbs) {
-		op[i] = ~op[i];
-		i++;
+}
+
+
+/*
+ * (real, imag) = (x + iy)^2, given xsqr = x^2 and ysqr = y^2, which are
+ * needed for the bailout test anyway. So this takes just one more
+ * multiplication for 2xy. real and imag may be the same as x and y.
+ */
+static inline void
+my_mpn_complex_sqr (mp_ptr real, mp_ptr imag, mp_srcptr x, mp_srcptr y, mp_srcptr xsqr, mp_srcptr ysqr, unsigned frac_limbs)
+{
+	const unsigned total_limbs = INT_LIMBS + frac_limbs;
+	mp_limb_t prod[total_limbs];
+	my_mpn_smul_fast (prod, x, y, frac_limbs);
+	mpn_lshift (imag, prod, total_limbs, 1);
+	mpn_sub_n (real, xsqr, ysqr, total_limbs);
+}
+
+
+/*
+ * (real, imag) = (a + ib) * (c + id) with three multiplications (Gauss):
+ * k1 = c (a + b), k2 = a (d - c), k3 = b (c + d),
+ * real = k1 - k3, imag = k1 + k2.
+ * The additions are cheaper than the fourth multiplication even at two
+ * limbs. real and imag may be the same as any of the factors.
+ */
+static inline void
+my_mpn_complex_mul (mp_ptr real, mp_ptr imag, mp_srcptr a, mp_srcptr b, mp_srcptr c, mp_srcptr d, unsigned frac_limbs)
+{
+	const unsigned total_limbs = INT_LIMBS + frac_limbs;
+	mp_limb_t k1[total_limbs], k2[total_limbs], k3[total_limbs], tmp[total_limbs];
+	mpn_add_n (tmp, a, b, total_limbs);
+	my_mpn_smul_fast (k1, c, tmp, frac_limbs);
+	mpn_sub_n (tmp, d, c, total_limbs);
+	my_mpn_smul_fast (k2, a, tmp, frac_limbs);
+	mpn_add_n (tmp, c, d, total_limbs);
+	my_mpn_smul_fast (k3, b, tmp, frac_limbs);
+	mpn_sub_n (real, k1, k3, total_limbs);
+	mpn_add_n (imag, k1, k2, total_limbs);
+}
+
+
+static inline void
+mp_derivative_init (struct mp_derivative *der)
+{
+	der->x = 0.0;
+	der->y = 0.0;
+	der->one = 1.0;
+	der->exp = 0;
+}
+
+
+/*
+ * der = factor * t * der + 1, with t = z for z^2 (factor 2) and
+ * t = z^(zpower - 1) otherwise (factor zpower).
+ */
+static inline void
+mp_derivative_step (struct mp_derivative *der, mandel_fp_t factor, mandel_fp_t treal, mandel_fp_t timag)
+{
+	const mandel_fp_t new_x = factor * (treal * der->x - timag * der->y) + der->one;
+	der->y = factor * (treal * der->y + timag * der->x);
+	der->x = new_x;
+	if (fabs (der->x) + fabs (der->y) > MP_DERIVATIVE_MAX) {
+		der->x = ldexp (der->x, -MP_DERIVATIVE_EXP_STEP);
+		der->y = ldexp (der->y, -MP_DERIVATIVE_EXP_STEP);
+		der->exp += MP_DERIVATIVE_EXP_STEP;
+		der->one = ldexp (1.0, (int) -der->exp);
 	}
 }
 
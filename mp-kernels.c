@@ -0,0 +1,382 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <glib.h>
+#include <gmp.h>
+
+#include "fpdefs.h"
+#include "fp-kernels.h"
+#include "misc-math.h"
+#include "mp-kernels.h"
+
+/* The kernels need a double-limb type for the partial products. */
+#if defined (__SIZEOF_INT128__) && GMP_NUMB_BITS == 64 && GMP_NAIL_BITS == 0
+#define MP_KERNELS_INT128
+#endif
+
+
+#ifdef MP_KERNELS_INT128
+
+typedef unsigned __int128 mp_dlimb_t;
+
+/*
+ * These are the fixed-point operations of misc-math.h for n limbs in total.
+ * They are always inlined into the kernels, where n is a constant, so all
+ * loops are unrolled completely. The multiplications add up the partial
+ * products column by column in an accumulator of three limbs (acc and
+ * hi), which is shifted down by one limb after each column.
+ */
+static inline void mp_mul (mp_ptr p, mp_srcptr a, mp_srcptr b, const unsigned n) __attribute__ ((always_inline));
+static inline void mp_sqr (mp_ptr p, mp_srcptr a, const unsigned n) __attribute__ ((always_inline));
+static inline mp_limb_t mp_sign_mask (mp_srcptr a, const unsigned n) __attribute__ ((always_inline));
+static inline void mp_sub_masked (mp_ptr r, mp_srcptr a, mp_limb_t mask, const unsigned n) __attribute__ ((always_inline));
+static inline void mp_smul (mp_ptr p, mp_srcptr a, mp_srcptr b, const unsigned n) __attribute__ ((always_inline));
+static inline void mp_ssqr (mp_ptr p, mp_srcptr a, const unsigned n) __attribute__ ((always_inline));
+static inline void mp_add (mp_ptr r, mp_srcptr a, mp_srcptr b, const unsigned n) __attribute__ ((always_inline));
+static inline void mp_sub (mp_ptr r, mp_srcptr a, mp_srcptr b, const unsigned n) __attribute__ ((always_inline));
+static inline void mp_lshift1 (mp_ptr r, mp_srcptr a, const unsigned n) __attribute__ ((always_inline));
+static inline bool mp_equal (mp_srcptr a, mp_srcptr b, const unsigned n) __attribute__ ((always_inline));
+static inline bool mp_below_four (mp_srcptr a, const unsigned n) __attribute__ ((always_inline));
+static inline void mp_copy (mp_ptr r, mp_srcptr a, const unsigned n) __attribute__ ((always_inline));
+static inline mandel_fp_t mp_get_fp (mp_srcptr a, const unsigned n) __attribute__ ((always_inline));
+static inline unsigned mp_z2 (const unsigned n, unsigned maxiter, bool interior, mp_srcptr x0, mp_srcptr y0, mp_srcptr preal, mp_srcptr pimag, struct mandel_fe *distance, uint64_t *saved) __attribute__ ((always_inline));
+
+
+/*
+ * Same partial products as my_mpn_mul_fast(), so the result is the same.
+ * Only the columns from low up are calculated.
+ */
+static inline void
+mp_mul (mp_ptr p, mp_srcptr a, mp_srcptr b, const unsigned n)
+{
+	const unsigned frac = n - INT_LIMBS;
+	const unsigned low = frac > MPN_MUL_GUARD_LIMBS ? frac - MPN_MUL_GUARD_LIMBS : 0;
+	mp_dlimb_t acc = 0;
+	mp_limb_t hi = 0;
+	unsigned i, k;
+
+#pragma GCC unroll 32
+	for (k = low; k < frac + n; k++) {
+#pragma GCC unroll 16
+		for (i = k < n ? 0 : k - n + 1; i <= k && i < n; i++) {
+			const mp_dlimb_t prod = (mp_dlimb_t) a[i] * b[k - i];
+			acc += prod;
+			hi += acc < prod;
+		}
+		if (k >= frac)
+			p[k - frac] = (mp_limb_t) acc;
+		acc = (acc >> GMP_NUMB_BITS) | ((mp_dlimb_t) hi << GMP_NUMB_BITS);
+		hi = 0;
+	}
+}
+
+
+/*
+ * Exact square, truncated like my_mpn_sqr_fast(). The products of
+ * different limbs occur twice in each column, they are added up once and
+ * doubled.
+ */
+static inline void
+mp_sqr (mp_ptr p, mp_srcptr a, const unsigned n)
+{
+	const unsigned frac = n - INT_LIMBS;
+	mp_dlimb_t acc = 0;
+	mp_limb_t hi = 0;
+	unsigned i, k;
+
+#pragma GCC unroll 32
+	for (k = 0; k < frac + n; k++) {
+		mp_dlimb_t col = 0;
+		mp_limb_t col_hi = 0;
+#pragma GCC unroll 16
+		for (i = k < n ? 0 : k - n + 1; 2 * i < k; i++) {
+			const mp_dlimb_t prod = (mp_dlimb_t) a[i] * a[k - i];
+			col += prod;
+			col_hi += col < prod;
+		}
+		col_hi = (col_hi << 1) | (mp_limb_t) (col >> (2 * GMP_NUMB_BITS - 1));
+		col <<= 1;
+		if (k % 2 == 0) {
+			const mp_dlimb_t prod = (mp_dlimb_t) a[k / 2] * a[k / 2];
+			col += prod;
+			col_hi += col < prod;
+		}
+		acc += col;
+		hi += col_hi + (acc < col);
+		if (k >= frac)
+			p[k - frac] = (mp_limb_t) acc;
+		acc = (acc >> GMP_NUMB_BITS) | ((mp_dlimb_t) hi << GMP_NUMB_BITS);
+		hi = 0;
+	}
+}
+
+
+/* All bits set if a is negative, 0 otherwise */
+static inline mp_limb_t
+mp_sign_mask (mp_srcptr a, const unsigned n)
+{
+	return -(a[n - 1] >> (GMP_NUMB_BITS - 1));
+}
+
+
+/* r -= a & mask, so the sign corrections don't need branches */
+static inline void
+mp_sub_masked (mp_ptr r, mp_srcptr a, mp_limb_t mask, const unsigned n)
+{
+	bool borrow = false;
+	unsigned i;
+#pragma GCC unroll 16
+	for (i = 0; i < n; i++) {
+		mp_limb_t d;
+		const bool b1 = __builtin_sub_overflow (r[i], a[i] & mask, &d);
+		const bool b2 = __builtin_sub_overflow (d, (mp_limb_t) borrow, &d);
+		r[i] = d;
+		borrow = b1 | b2;
+	}
+}
+
+
+/* my_mpn_smul_fast() */
+static inline void
+mp_smul (mp_ptr p, mp_srcptr a, mp_srcptr b, const unsigned n)
+{
+	mp_mul (p, a, b, n);
+	mp_sub_masked (p + INT_LIMBS, b, mp_sign_mask (a, n), n - INT_LIMBS);
+	mp_sub_masked (p + INT_LIMBS, a, mp_sign_mask (b, n), n - INT_LIMBS);
+}
+
+
+/* my_mpn_ssqr_fast() */
+static inline void
+mp_ssqr (mp_ptr p, mp_srcptr a, const unsigned n)
+{
+	const mp_limb_t mask = mp_sign_mask (a, n);
+	mp_sqr (p, a, n);
+	mp_sub_masked (p + INT_LIMBS, a, mask, n - INT_LIMBS);
+	mp_sub_masked (p + INT_LIMBS, a, mask, n - INT_LIMBS);
+}
+
+
+/* r may be the same as a or b, the carry out is dropped. */
+static inline void
+mp_add (mp_ptr r, mp_srcptr a, mp_srcptr b, const unsigned n)
+{
+	bool carry = false;
+	unsigned i;
+#pragma GCC unroll 16
+	for (i = 0; i < n; i++) {
+		mp_limb_t s;
+		const bool c1 = __builtin_add_overflow (a[i], b[i], &s);
+		const bool c2 = __builtin_add_overflow (s, (mp_limb_t) carry, &s);
+		r[i] = s;
+		carry = c1 | c2;
+	}
+}
+
+
+/* The borrow is dropped as well. */
+static inline void
+mp_sub (mp_ptr r, mp_srcptr a, mp_srcptr b, const unsigned n)
+{
+	bool borrow = false;
+	unsigned i;
+#pragma GCC unroll 16
+	for (i = 0; i < n; i++) {
+		mp_limb_t d;
+		const bool b1 = __builtin_sub_overflow (a[i], b[i], &d);
+		const bool b2 = __builtin_sub_overflow (d, (mp_limb_t) borrow, &d);
+		r[i] = d;
+		borrow = b1 | b2;
+	}
+}
+
+
+static inline void
+mp_lshift1 (mp_ptr r, mp_srcptr a, const unsigned n)
+{
+	unsigned i;
+#pragma GCC unroll 16
+	for (i = n - 1; i > 0; i--)
+		r[i] = (a[i] << 1) | (a[i - 1] >> (GMP_NUMB_BITS - 1));
+	r[0] = a[0] << 1;
+}
+
+
+static inline bool
+mp_equal (mp_srcptr a, mp_srcptr b, const unsigned n)
+{
+	mp_limb_t diff = 0;
+	unsigned i;
+#pragma GCC unroll 16
+	for (i = 0; i < n; i++)
+		diff |= a[i] ^ b[i];
+	return diff == 0;
+}
+
+
+/* Whether the integer part of a is below 4 */
+static inline bool
+mp_below_four (mp_srcptr a, const unsigned n)
+{
+	mp_limb_t high = 0;
+	unsigned i;
+#pragma GCC unroll 16
+	for (i = n - INT_LIMBS + 1; i < n; i++)
+		high |= a[i];
+	return high == 0 && a[n - INT_LIMBS] < 4;
+}
+
+
+static inline void
+mp_copy (mp_ptr r, mp_srcptr a, const unsigned n)
+{
+	unsigned i;
+#pragma GCC unroll 16
+	for (i = 0; i < n; i++)
+		r[i] = a[i];
+}
+
+
+/* my_mpn_get_fp(), with the absolute value taken without branches */
+static inline mandel_fp_t
+mp_get_fp (mp_srcptr a, const unsigned n)
+{
+	const mp_limb_t mask = mp_sign_mask (a, n);
+	const mandel_fp_t limb_scale = ldexp (1.0, -GMP_NUMB_BITS);
+	bool carry = mask != 0;
+	mandel_fp_t r = 0.0;
+	unsigned i;
+#pragma GCC unroll 16
+	for (i = 0; i < n; i++) {
+		mp_limb_t abs;
+		carry = __builtin_add_overflow (a[i] ^ mask, (mp_limb_t) carry, &abs);
+		r = r * limb_scale + (mandel_fp_t) abs;
+	}
+	r = ldexp (r, (INT_LIMBS - 1) * GMP_NUMB_BITS);
+	return mask != 0 ? -r : r;
+}
+
+
+/* The loop of mandel_julia_z2(), operation by operation */
+static inline unsigned
+mp_z2 (const unsigned n, unsigned maxiter, bool interior, mp_srcptr x0, mp_srcptr y0, mp_srcptr preal, mp_srcptr pimag, struct mandel_fe *distance, uint64_t *saved)
+{
+	const bool distance_est = distance != NULL;
+	/* Inlined functions can't have VLAs, only the first n limbs are used. */
+	mp_limb_t x[MP_KERNEL_MAX_LIMBS], y[MP_KERNEL_MAX_LIMBS], xsqr[MP_KERNEL_MAX_LIMBS], ysqr[MP_KERNEL_MAX_LIMBS];
+	mp_limb_t sqrsum[MP_KERNEL_MAX_LIMBS], cd_x[MP_KERNEL_MAX_LIMBS], cd_y[MP_KERNEL_MAX_LIMBS];
+	mp_limb_t prod[MP_KERNEL_MAX_LIMBS];
+	struct mp_derivative dz;
+	mandel_fp_t der_x = 1.0, der_y = 0.0, rho_z = HUGE_VAL, rho_d = 1.0;
+	unsigned i = 0;
+	int k = 1, m = 1;
+
+	mp_copy (x, x0, n);
+	mp_copy (cd_x, x0, n);
+	mp_copy (y, y0, n);
+	mp_copy (cd_y, y0, n);
+	mp_derivative_init (&dz);
+
+	mandel_fp_t xfp = mp_get_fp (x, n), yfp = mp_get_fp (y, n);
+	mandel_fp_t cd_xfp = xfp, cd_yfp = yfp;
+
+	mp_ssqr (xsqr, x, n);
+	mp_ssqr (ysqr, y, n);
+	mp_add (sqrsum, xsqr, ysqr, n);
+	while (i < maxiter && mp_below_four (sqrsum, n)) {
+		if (interior) {
+			interior_track (xfp, yfp, der_x, der_y, &rho_z, &rho_d);
+			mandel_fp_t new_der_x = 2.0 * (der_x * xfp - der_y * yfp);
+			der_y = 2.0 * (der_x * yfp + der_y * xfp);
+			der_x = new_der_x;
+		}
+		if (distance_est)
+			mp_derivative_step (&dz, 2.0, xfp, yfp);
+
+		/* my_mpn_complex_sqr() */
+		mp_smul (prod, x, y, n);
+		mp_lshift1 (y, prod, n);
+		mp_sub (x, xsqr, ysqr, n);
+		mp_add (x, x, preal, n);
+		mp_add (y, y, pimag, n);
+		if (interior || distance_est) {
+			xfp = mp_get_fp (x, n);
+			yfp = mp_get_fp (y, n);
+		}
+
+		k--;
+		if ((mp_equal (x, cd_x, n) && mp_equal (y, cd_y, n))
+				|| (interior && interior_returned (xfp, yfp, cd_xfp, cd_yfp, der_x, der_y, rho_z, rho_d))) {
+			*saved += maxiter - i;
+			i = maxiter;
+			break;
+		}
+		if (k == 0) {
+			k = m <<= 1;
+			mp_copy (cd_x, x, n);
+			mp_copy (cd_y, y, n);
+			cd_xfp = xfp;
+			cd_yfp = yfp;
+			der_x = 1.0;
+			der_y = 0.0;
+			rho_z = HUGE_VAL;
+			rho_d = 1.0;
+		}
+
+		mp_ssqr (xsqr, x, n);
+		mp_ssqr (ysqr, y, n);
+		mp_add (sqrsum, xsqr, ysqr, n);
+
+		i++;
+	}
+
+	if (distance_est)
+		mp_derivative_distance (distance, xfp, yfp, &dz);
+	return i;
+}
+
+
+#define MP_Z2_KERNEL(n) \
+static unsigned \
+mp_z2_ ## n (unsigned maxiter, bool interior, mp_srcptr x0, mp_srcptr y0, mp_srcptr preal, mp_srcptr pimag, struct mandel_fe *distance, uint64_t *saved) \
+{ \
+	return mp_z2 (n, maxiter, interior, x0, y0, preal, pimag, distance, saved); \
+}
+
+MP_Z2_KERNEL (2)
+MP_Z2_KERNEL (3)
+MP_Z2_KERNEL (4)
+MP_Z2_KERNEL (5)
+MP_Z2_KERNEL (6)
+MP_Z2_KERNEL (7)
+MP_Z2_KERNEL (8)
+MP_Z2_KERNEL (9)
+MP_Z2_KERNEL (10)
+MP_Z2_KERNEL (11)
+MP_Z2_KERNEL (12)
+MP_Z2_KERNEL (13)
+MP_Z2_KERNEL (14)
+MP_Z2_KERNEL (15)
+MP_Z2_KERNEL (16)
+
+/* Indexed by the total number of limbs */
+static const mp_z2_kernel_t mp_z2_kernels[MP_KERNEL_MAX_LIMBS + 1] = {
+	NULL, NULL, mp_z2_2, mp_z2_3, mp_z2_4, mp_z2_5, mp_z2_6, mp_z2_7, mp_z2_8,
+	mp_z2_9, mp_z2_10, mp_z2_11, mp_z2_12, mp_z2_13, mp_z2_14, mp_z2_15, mp_z2_16
+};
+
+#endif /* MP_KERNELS_INT128 */
+
+
+mp_z2_kernel_t
+mp_z2_kernel_get (unsigned frac_limbs)
+{
+#ifdef MP_KERNELS_INT128
+	const unsigned total_limbs = INT_LIMBS + frac_limbs;
+	if (total_limbs >= MP_KERNEL_MIN_LIMBS && total_limbs <= MP_KERNEL_MAX_LIMBS)
+		return mp_z2_kernels[total_limbs];
+#endif
+	return NULL;
+}
@@ -0,0 +1,33 @@
+#ifndef _GTKMANDEL_MP_KERNELS_H
+#define _GTKMANDEL_MP_KERNELS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <gmp.h>
+
+/*
+ * Unrolled fixed-point MP kernels exist for these numbers of limbs in
+ * total (INT_LIMBS + frac_limbs). Beyond that, the loop overhead of the
+ * generic mpn functions doesn't matter much any more.
+ */
+#define MP_KERNEL_MIN_LIMBS 2
+#define MP_KERNEL_MAX_LIMBS 16
+
+struct mandel_fe;
+
+/*
+ * Iterates z -> z^2 + c in fixed-point MP, starting at z = (x0, y0) with
+ * c = (preal, pimag), all of them with the number of limbs the kernel was
+ * made for. This is the same as mandel_julia_z2(), with the same
+ * periodicity and interior checking (if interior is true), and it gives
+ * identical results. If distance isn't NULL, the distance estimate is
+ * stored there. Returns the number of iterations, iterations saved by the
+ * checks are added to *saved.
+ */
+typedef unsigned (*mp_z2_kernel_t) (unsigned maxiter, bool interior, mp_srcptr x0, mp_srcptr y0, mp_srcptr preal, mp_srcptr pimag, struct mandel_fe *distance, uint64_t *saved);
+
+/* Returns the kernel for frac_limbs, or NULL if there is none. */
+mp_z2_kernel_t mp_z2_kernel_get (unsigned frac_limbs);
+
+#endif /* _GTKMANDEL_MP_KERNELS_H */
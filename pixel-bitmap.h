@@ -0,0 +1,100 @@
+#ifndef _GTKMANDEL_PIXEL_BITMAP_H
+#define _GTKMANDEL_PIXEL_BITMAP_H
+
+/*
+ * Heap-allocated bitmaps with one bit per pixel, e. g. for marking pixels
+ * which have been visited. They cover a rectangle of pixels, which doesn't
+ * have to start at (0, 0).
+ *
+ * The bits are either stored row by row, 64 pixels per word, or "tiled",
+ * i. e. each word holds a block of 8x8 pixels. The tiled layout keeps
+ * neighbors in both directions close together, which is better for
+ * scanning along columns as well as rows.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define PIXEL_BITMAP_TILE 8
+
+struct pixel_bitmap {
+	int x0, y0;
+	unsigned w, h;
+	bool tiled;
+	size_t words_per_row;
+	uint64_t *words;
+};
+
+
+static inline bool pixel_bitmap_init (struct pixel_bitmap *bm, int x0, int y0, unsigned w, unsigned h, bool tiled);
+static inline void pixel_bitmap_clear (struct pixel_bitmap *bm);
+static inline void pixel_bitmap_locate (const struct pixel_bitmap *bm, int x, int y, size_t *word, unsigned *bit);
+static inline bool pixel_bitmap_get (const struct pixel_bitmap *bm, int x, int y);
+static inline void pixel_bitmap_set (struct pixel_bitmap *bm, int x, int y);
+
+
+/* All bits are initially 0. Returns false if out of memory. */
+static inline bool
+pixel_bitmap_init (struct pixel_bitmap *bm, int x0, int y0, unsigned w, unsigned h, bool tiled)
+{
+	size_t rows;
+	bm->x0 = x0;
+	bm->y0 = y0;
+	bm->w = w;
+	bm->h = h;
+	bm->tiled = tiled;
+	if (tiled) {
+		bm->words_per_row = (w + PIXEL_BITMAP_TILE - 1) / PIXEL_BITMAP_TILE;
+		rows = (h + PIXEL_BITMAP_TILE - 1) / PIXEL_BITMAP_TILE;
+	} else {
+		bm->words_per_row = (w + 63) / 64;
+		rows = h;
+	}
+	bm->words = calloc (bm->words_per_row * rows, sizeof (*bm->words));
+	return bm->words != NULL;
+}
+
+
+static inline void
+pixel_bitmap_clear (struct pixel_bitmap *bm)
+{
+	free (bm->words);
+	bm->words = NULL;
+}
+
+
+static inline void
+pixel_bitmap_locate (const struct pixel_bitmap *bm, int x, int y, size_t *word, unsigned *bit)
+{
+	const unsigned xr = x - bm->x0, yr = y - bm->y0;
+	if (bm->tiled) {
+		*word = yr / PIXEL_BITMAP_TILE * bm->words_per_row + xr / PIXEL_BITMAP_TILE;
+		*bit = yr % PIXEL_BITMAP_TILE * PIXEL_BITMAP_TILE + xr % PIXEL_BITMAP_TILE;
+	} else {
+		*word = yr * bm->words_per_row + xr / 64;
+		*bit = xr % 64;
+	}
+}
+
+
+static inline bool
+pixel_bitmap_get (const struct pixel_bitmap *bm, int x, int y)
+{
+	size_t word;
+	unsigned bit;
+	pixel_bitmap_locate (bm, x, y, &word, &bit);
+	return (bm->words[word] >> bit) & 1;
+}
+
+
+static inline void
+pixel_bitmap_set (struct pixel_bitmap *bm, int x, int y)
+{
+	size_t word;
+	unsigned bit;
+	pixel_bitmap_locate (bm, x, y, &word, &bit);
+	bm->words[word] |= (uint64_t) 1 << bit;
+}
+
+#endif /* _GTKMANDEL_PIXEL_BITMAP_H */
@@ -1,22 +1,20 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include <png.h>
 
 #include "render-png.h"
+#include "util.h"
 
 
-void
-write_png (const struct mandel_renderer *renderer, const char *filename, int compression)
-{
-	const unsigned width = mandel_renderer_width (renderer);
-	const unsigned height = mandel_renderer_height (renderer);
+static void png_begin (png_structp png_ptr, png_infop info_ptr, FILE *f, unsigned width, unsigned height, int compression);
+static void png_write_renderer_rows (png_structp png_ptr, const struct mandel_renderer *renderer, unsigned y0, unsigned rows);
 
-	FILE *f = fopen (filename, "wb");
-
-	png_structp png_ptr = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-	png_infop info_ptr = png_create_info_struct (png_ptr);
-
-	if (setjmp (png_jmpbuf (png_ptr)))
-		fprintf (stderr, "PNG longjmp!\n");
 
+/* Writes the header, the caller has to set up error handling before. */
+static void
+png_begin (png_structp png_ptr, png_infop info_ptr, FILE *f, unsigned width, unsigned height, int compression)
+{
 	//png_set_swap (png_ptr); /* FIXME this should only be done on little-endian systems */
 	png_init_io (png_ptr, f);
 	if (compression == 0)
@@ -26,25 +24,54 @@ write_png (const struct mandel_renderer *renderer, const char *filename, int com
 	png_set_IHDR (png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
 		PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 	png_write_info (png_ptr, info_ptr);
+}
 
-	unsigned char row[width * 3];
+
+/* Encodes the given rows of the renderer's image. */
+static void
+png_write_renderer_rows (png_structp png_ptr, const struct mandel_renderer *renderer, unsigned y0, unsigned rows)
+{
+	const unsigned width = mandel_renderer_width (renderer);
+	unsigned char *row = malloc (width * 3);
+	struct color *colors = malloc (width * sizeof (*colors));
 	png_bytep row_ptr[] = {(png_bytep) row};
 
 	unsigned int x, y;
 	//int opct = -1;
 
-	for (y = 0; y < height; y++) {
+	for (y = y0; y < y0 + rows; y++) {
+		mandel_get_pixel_row (renderer, y, colors);
 		for (x = 0; x < width; x++) {
-			struct color px;
-			mandel_get_pixel (renderer, x, y, &px);
-
-			row[3 * x + 0] = px.r >> 8;
-			row[3 * x + 1] = px.g >> 8;
-			row[3 * x + 2] = px.b >> 8;
+			row[3 * x + 0] = colors[x].r >> 8;
+			row[3 * x + 1] = colors[x].g >> 8;
+			row[3 * x + 2] = colors[x].b >> 8;
 		}
 		png_write_rows (png_ptr, row_ptr, 1);
 	}
 
+	free (row);
+	free (colors);
+}
+
+
+void
+write_png (const struct mandel_renderer *renderer, const char *filename, int compression)
+{
+	const unsigned width = mandel_renderer_width (renderer);
+	const unsigned height = mandel_renderer_height (renderer);
+
+	FILE *f = fopen (filename, "wb");
+
+	png_structp png_ptr = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop info_ptr = png_create_info_struct (png_ptr);
+
+	if (setjmp (png_jmpbuf (png_ptr)))
+		fprintf (stderr, "PNG longjmp!\n");
+
+	png_begin (png_ptr, info_ptr, f, width, height, compression);
+
+	png_write_renderer_rows (png_ptr, renderer, 0, height);
+
 	png_write_end (png_ptr, info_ptr);
 	png_destroy_write_struct (&png_ptr, &info_ptr);
 
@@ -53,19 +80,73 @@ write_png (const struct mandel_renderer *renderer, const char *filename, int com
 
 
 void
-render_to_png (struct mandeldata *md, const char *filename, int compression, unsigned *bits, unsigned w, unsigned h, unsigned threads, unsigned aa_level)
+render_to_png (struct mandeldata *md, const char *filename, int compression, unsigned *bits, unsigned *skipped_iter, struct mandel_render_stats *stats, unsigned w, unsigned h, unsigned threads, unsigned aa_level)
 {
 	struct mandel_renderer renderer[1];
 
 	mandel_renderer_init (renderer, md, w, h, aa_level);
-	if (threads > 1)
-		renderer->render_method = RM_MARIANI_SILVER;
-	else
-		renderer->render_method = RM_BOUNDARY_TRACE;
+	renderer->render_method = RM_BOUNDARY_TRACE;
 	renderer->thread_count = threads;
 	mandel_render (renderer);
 	write_png (renderer, filename, compression);
 	if (bits != NULL)
 		*bits = mandel_get_precision (renderer);
+	if (skipped_iter != NULL)
+		*skipped_iter = mandel_get_skipped_iterations (renderer);
+	if (stats != NULL)
+		*stats = renderer->stats;
 	mandel_renderer_clear (renderer);
 }
+
+
+/*
+ * Like render_to_png(), but the image is rendered in horizontal strips of
+ * strip_height rows, each of which is encoded as soon as it is finished.
+ * Only one strip is kept in memory at a time, so the image size is not
+ * limited by the available memory. The strips share the reference point
+ * etc. of the whole image, and they are extended by the margin the
+ * boundary tracer needs to trace the same tiles as in the whole image, so
+ * the result is the same as from render_to_png(). The statistics of the
+ * strips are added up, including the margins.
+ */
+void
+render_to_png_strips (struct mandeldata *md, const char *filename, int compression, struct mandel_render_stats *stats, unsigned w, unsigned h, unsigned threads, unsigned aa_level, unsigned strip_height)
+{
+	const unsigned margin = mandel_render_strip_margin (w, h, aa_level);
+	struct mandel_renderer strip[1];
+	unsigned y0;
+
+	if (stats != NULL)
+		memset (stats, 0, sizeof (*stats));
+
+	FILE *f = fopen (filename, "wb");
+
+	png_structp png_ptr = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop info_ptr = png_create_info_struct (png_ptr);
+
+	if (setjmp (png_jmpbuf (png_ptr)))
+		fprintf (stderr, "PNG longjmp!\n");
+
+	png_begin (png_ptr, info_ptr, f, w, h, compression);
+
+	mandel_renderer_init_strips (strip, md, w, h, aa_level, strip_height + 2 * margin);
+	strip->render_method = RM_BOUNDARY_TRACE;
+	strip->thread_count = threads;
+	for (y0 = 0; y0 < h; y0 += strip_height) {
+		const unsigned rows = MIN (strip_height, h - y0);
+		const unsigned top = MIN (margin, y0);
+		const unsigned bottom = MIN (margin, h - y0 - rows);
+
+		mandel_renderer_set_strip (strip, y0 - top, top + rows + bottom);
+		mandel_render (strip);
+		png_write_renderer_rows (png_ptr, strip, top, rows);
+		if (stats != NULL)
+			mandel_render_stats_add (stats, &strip->stats);
+	}
+	mandel_renderer_clear (strip);
+
+	png_write_end (png_ptr, info_ptr);
+	png_destroy_write_struct (&png_ptr, &info_ptr);
+
+	fclose (f);
+}
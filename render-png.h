@@ -5,6 +5,7 @@
 
 
 void write_png (const struct mandel_renderer *md, const char *filename, int compression);
-void render_to_png (struct mandeldata *md, const char *filename, int compression, unsigned *bits, unsigned w, unsigned h, unsigned threads, unsigned aa_level);
+void render_to_png (struct mandeldata *md, const char *filename, int compression, unsigned *bits, unsigned *skipped_iter, struct mandel_render_stats *stats, unsigned w, unsigned h, unsigned threads, unsigned aa_level);
+void render_to_png_strips (struct mandeldata *md, const char *filename, int compression, struct mandel_render_stats *stats, unsigned w, unsigned h, unsigned threads, unsigned aa_level, unsigned strip_height);
 
 #endif /* _GTKMANDEL_RENDER_PNG_H */
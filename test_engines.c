@@ -0,0 +1,382 @@
+/*
+ * Renders coordinate files with each compute engine and compares the
+ * iteration buffers with those of the MP engine with a few guard limbs,
+ * which is the reference. The FP batch kernels have to give exactly the
+ * same buffers as the scalar FP loop.
+ * The reference buffers can be kept as golden files, so they only have to
+ * be computed once.
+ * Optionally, boundary-traced renders in strips are compared with those of
+ * the whole frame, which have to be the same.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <gmp.h>
+#include <mpfr.h>
+
+#include <glib.h>
+
+#include "fractal-render.h"
+#include "fp-kernels.h"
+#include "file.h"
+
+
+struct engine {
+	const char *name;
+	compute_mode_t mode;
+	/* for COMPUTE_FP: the batch kernel, or NULL for the scalar loop */
+	const struct fp_kernel *kernel;
+};
+
+
+struct engine_result {
+	unsigned mismatches;
+	unsigned max_delta;
+};
+
+
+static bool parse_command_line (int *argc, char ***argv);
+static bool render_engine (const struct mandeldata *md, const struct engine *engine, unsigned extra_limbs, int *buf);
+static void render_traced (const struct mandeldata *md, unsigned strip_height, int *buf);
+static void compare_buffers (const int *ref, const int *buf, unsigned n, struct engine_result *res);
+static char *golden_file_name (const char *coord_file);
+static bool read_golden (const char *filename, unsigned maxiter, int *buf);
+static void write_golden (const char *filename, unsigned maxiter, const int *buf);
+static bool test_file (const char *filename);
+
+
+static gint img_width = 48, img_height = 36;
+static gint max_iterations = 0;
+static gchar *golden_dir = NULL;
+static gdouble tolerance = 1.0;
+static gint guard_limbs = 2;
+static gint strip_height = 0;
+
+static GOptionEntry option_entries[] = {
+	{"width", 'W', 0, G_OPTION_ARG_INT, &img_width, "Image width (default 48)", "PIXELS"},
+	{"height", 'H', 0, G_OPTION_ARG_INT, &img_height, "Image height (default 36)", "PIXELS"},
+	{"max-iterations", 'i', 0, G_OPTION_ARG_INT, &max_iterations, "Limit maxiter of the coordinates to N", "N"},
+	{"golden-dir", 'g', 0, G_OPTION_ARG_FILENAME, &golden_dir, "Read the reference buffers from DIR, or write them there if they are missing", "DIR"},
+	{"guard-limbs", 'G', 0, G_OPTION_ARG_INT, &guard_limbs, "Compute the reference with N more limbs of precision than needed for the pixel spacing (default 2)", "N"},
+	{"tolerance", 't', 0, G_OPTION_ARG_DOUBLE, &tolerance, "Fail if more than PCT percent of the pixels differ from the MP reference (default 1)", "PCT"},
+	{"strip-height", 'S', 0, G_OPTION_ARG_INT, &strip_height, "Also check that rendering in strips of N rows gives the same result", "N"},
+	{NULL}
+};
+
+
+static bool
+parse_command_line (int *argc, char ***argv)
+{
+	GError *err = NULL;
+	GOptionContext *context = g_option_context_new ("COORD-FILE...");
+	g_option_context_add_main_entries (context, option_entries, "test_engines");
+	g_option_context_add_group (context, fractal_math_get_option_group ());
+	if (!g_option_context_parse (context, argc, argv, &err)) {
+		fprintf (stderr, "* ERROR: %s\n", err->message);
+		return false;
+	}
+	if (guard_limbs < 0) {
+		fprintf (stderr, "* ERROR: Invalid number of guard limbs %d\n", guard_limbs);
+		return false;
+	}
+	if (strip_height < 0) {
+		fprintf (stderr, "* ERROR: Invalid strip height %d\n", strip_height);
+		return false;
+	}
+	if (img_width <= 0 || img_height <= 0) {
+		fprintf (stderr, "* ERROR: Invalid image size %dx%d\n", img_width, img_height);
+		return false;
+	}
+	return true;
+}
+
+
+/*
+ * Renders every pixel of md with the given engine, without a render method
+ * which could infer some of them, and with extra_limbs more than the usual
+ * precision. Returns false if the engine doesn't support md at this depth.
+ */
+static bool
+render_engine (const struct mandeldata *md, const struct engine *engine, unsigned extra_limbs, int *buf)
+{
+	struct mandel_renderer renderer[1];
+	struct mandel_worker worker[1];
+	int x, y;
+
+	mandel_renderer_init (renderer, md, img_width, img_height, 1);
+	if (!mandel_renderer_set_compute_mode (renderer, engine->mode)) {
+		mandel_renderer_clear (renderer);
+		return false;
+	}
+	if (extra_limbs > 0)
+		mandel_renderer_add_precision (renderer, extra_limbs);
+	if (engine->kernel != NULL && !fp_kernel_select (engine->kernel->name)) {
+		mandel_renderer_clear (renderer);
+		return false;
+	}
+
+	memset (worker, 0, sizeof (*worker));
+	worker->fractal_state = renderer->fractal_state;
+	for (y = 0; y < img_height; y++)
+		for (x = 0; x < img_width; x++)
+			renderer->data[mandel_data_index (renderer, x, y)] = -1;
+	for (y = 0; y < img_height; y++) {
+		if (engine->mode == COMPUTE_FP && engine->kernel != NULL)
+			mandel_render_pixel_line (renderer, worker, 0, y, 1, 0, img_width);
+		else
+			for (x = 0; x < img_width; x++)
+				mandel_render_pixel (renderer, worker, x, y);
+	}
+	for (y = 0; y < img_height; y++)
+		for (x = 0; x < img_width; x++)
+			buf[y * img_width + x] = mandel_get_point (renderer, x, y);
+
+	mandel_renderer_clear (renderer);
+	return true;
+}
+
+
+/*
+ * Renders md with the boundary tracer, like render_to_png() does, or in
+ * strips of strip_height rows like render_to_png_strips() if that isn't 0.
+ */
+static void
+render_traced (const struct mandeldata *md, unsigned strip_height, int *buf)
+{
+	const unsigned h = img_height;
+	const unsigned margin = mandel_render_strip_margin (img_width, h, 1);
+	struct mandel_renderer renderer[1];
+	unsigned x, y, y0;
+
+	if (strip_height > 0)
+		mandel_renderer_init_strips (renderer, md, img_width, h, 1, strip_height + 2 * margin);
+	else {
+		mandel_renderer_init (renderer, md, img_width, h, 1);
+		strip_height = h;
+	}
+	renderer->render_method = RM_BOUNDARY_TRACE;
+	renderer->thread_count = 1;
+	for (y0 = 0; y0 < h; y0 += strip_height) {
+		const unsigned rows = MIN (strip_height, h - y0);
+		unsigned top = 0;
+
+		if (rows < h) {
+			const unsigned bottom = MIN (margin, h - y0 - rows);
+			top = MIN (margin, y0);
+			mandel_renderer_set_strip (renderer, y0 - top, top + rows + bottom);
+		}
+		mandel_render (renderer);
+		for (y = 0; y < rows; y++)
+			for (x = 0; x < (unsigned) img_width; x++)
+				buf[(y0 + y) * img_width + x] = mandel_get_point (renderer, x, top + y);
+	}
+	mandel_renderer_clear (renderer);
+}
+
+
+static void
+compare_buffers (const int *ref, const int *buf, unsigned n, struct engine_result *res)
+{
+	unsigned i;
+	res->mismatches = 0;
+	res->max_delta = 0;
+	for (i = 0; i < n; i++)
+		if (buf[i] != ref[i]) {
+			const unsigned delta = abs (buf[i] - ref[i]);
+			res->mismatches++;
+			if (delta > res->max_delta)
+				res->max_delta = delta;
+		}
+}
+
+
+/* The golden file for coord_file and the image size, to be freed with g_free(). */
+static char *
+golden_file_name (const char *coord_file)
+{
+	gchar *base = g_path_get_basename (coord_file);
+	gchar *name = g_strdup_printf ("%s/%s-%dx%d.golden", golden_dir, base, img_width, img_height);
+	g_free (base);
+	return name;
+}
+
+
+/*
+ * A golden file has a header with the image size, maxiter and the guard
+ * limbs, followed by the iteration buffer in text, one line per row.
+ * Returns false if the
+ * file doesn't exist or if it was made with different parameters.
+ */
+static bool
+read_golden (const char *filename, unsigned maxiter, int *buf)
+{
+	FILE *f = fopen (filename, "r");
+	int w, h, guard, i;
+	unsigned file_maxiter;
+	if (f == NULL)
+		return false;
+	if (fscanf (f, "fractlab-golden %d %d %u %d", &w, &h, &file_maxiter, &guard) != 4 || w != img_width || h != img_height || file_maxiter != maxiter || guard != guard_limbs) {
+		fclose (f);
+		return false;
+	}
+	for (i = 0; i < w * h; i++)
+		if (fscanf (f, "%d", &buf[i]) != 1) {
+			fprintf (stderr, "* WARNING: %s is truncated, rendering the reference again.\n", filename);
+			fclose (f);
+			return false;
+		}
+	fclose (f);
+	return true;
+}
+
+
+static void
+write_golden (const char *filename, unsigned maxiter, const int *buf)
+{
+	FILE *f = fopen (filename, "w");
+	int x, y;
+	if (f == NULL) {
+		perror (filename);
+		return;
+	}
+	fprintf (f, "fractlab-golden %d %d %u %d\n", img_width, img_height, maxiter, guard_limbs);
+	for (y = 0; y < img_height; y++)
+		for (x = 0; x < img_width; x++)
+			fprintf (f, "%d%c", buf[y * img_width + x], x == img_width - 1 ? '\n' : ' ');
+	fclose (f);
+}
+
+
+/*
+ * Returns false if an engine differs from the reference by more than the
+ * tolerance, or an FP kernel from the scalar FP loop at all.
+ */
+static bool
+test_file (const char *filename)
+{
+	static const struct engine reference = {"mp", COMPUTE_MP, NULL};
+	static const struct engine engines[] = {
+		{"mp", COMPUTE_MP, NULL},
+		{"fp", COMPUTE_FP, NULL},
+		{"dd", COMPUTE_DD, NULL},
+		{"perturb", COMPUTE_PERTURB, NULL},
+		{"perturb-fe", COMPUTE_PERTURB_FE, NULL}
+	};
+	const unsigned n = img_width * img_height;
+	struct mandeldata md;
+	char errbuf[256];
+	int *ref, *fp_ref, *buf;
+	bool ok = true;
+	unsigned i;
+
+	if (!read_mandeldata (filename, &md, errbuf, sizeof (errbuf))) {
+		fprintf (stderr, "* ERROR: %s: cannot read: %s\n", filename, errbuf);
+		return false;
+	}
+	struct mandel_julia_param *param = md.type_param;
+	if (max_iterations > 0 && param->maxiter > (unsigned) max_iterations)
+		param->maxiter = max_iterations;
+
+	ref = malloc (n * sizeof (*ref));
+	fp_ref = malloc (n * sizeof (*fp_ref));
+	buf = malloc (n * sizeof (*buf));
+
+	char *golden = golden_dir != NULL ? golden_file_name (filename) : NULL;
+	if (golden == NULL || !read_golden (golden, param->maxiter, ref)) {
+		render_engine (&md, &reference, guard_limbs, ref);
+		if (golden != NULL)
+			write_golden (golden, param->maxiter, ref);
+	}
+	g_free (golden);
+
+	/*
+	 * The FP batch kernels are compared with the scalar loop, which is
+	 * compared with the reference below. They must give the same results.
+	 */
+	static const struct engine scalar_fp = {"fp", COMPUTE_FP, NULL};
+	const struct fp_kernel *default_kernel = fp_kernel_get ();
+	if (render_engine (&md, &scalar_fp, 0, fp_ref)) {
+		for (i = 0; fp_kernels[i].name != NULL; i++) {
+			if (!fp_kernels[i].supported ())
+				continue;
+			const struct engine engine = {NULL, COMPUTE_FP, &fp_kernels[i]};
+			gchar *name = g_strdup_printf ("fp-%s", fp_kernels[i].name);
+			struct engine_result res;
+			if (render_engine (&md, &engine, 0, buf)) {
+				compare_buffers (fp_ref, buf, n, &res);
+				printf ("%s,%s,%u,%u,%.3f,%u\n", filename, name, n, res.mismatches, 100.0 * res.mismatches / n, res.max_delta);
+				if (res.mismatches > 0) {
+					fprintf (stderr, "* ERROR: %s: FP kernel %s differs from the scalar FP loop\n", filename, fp_kernels[i].name);
+					ok = false;
+				}
+			}
+			g_free (name);
+		}
+		fp_kernel_select (default_kernel->name);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (engines); i++) {
+		struct engine_result res;
+		if (!render_engine (&md, &engines[i], 0, buf))
+			continue;
+		compare_buffers (ref, buf, n, &res);
+		printf ("%s,%s,%u,%u,%.3f,%u\n", filename, engines[i].name, n, res.mismatches, 100.0 * res.mismatches / n, res.max_delta);
+		if (100.0 * res.mismatches / n > tolerance) {
+			fprintf (stderr, "* ERROR: %s: engine %s differs from the MP reference by more than %g%%\n", filename, engines[i].name, tolerance);
+			ok = false;
+		}
+	}
+
+	if (strip_height > 0) {
+		struct engine_result res;
+		render_traced (&md, 0, ref);
+		render_traced (&md, strip_height, buf);
+		compare_buffers (ref, buf, n, &res);
+		printf ("%s,strips,%u,%u,%.3f,%u\n", filename, n, res.mismatches, 100.0 * res.mismatches / n, res.max_delta);
+		if (res.mismatches > 0) {
+			fprintf (stderr, "* ERROR: %s: rendering in strips of %d rows differs from the whole frame\n", filename, strip_height);
+			ok = false;
+		}
+	}
+	fflush (stdout);
+
+	free (ref);
+	free (fp_ref);
+	free (buf);
+	mandeldata_clear (&md);
+	return ok;
+}
+
+
+int
+main (int argc, char **argv)
+{
+	int i, failed = 0;
+
+	g_thread_init (NULL);
+
+	mpf_set_default_prec (1024); /* ! */
+	mpfr_set_default_prec (1024); /* ! */
+
+	if (!parse_command_line (&argc, &argv))
+		return 1;
+
+	if (argc < 2) {
+		fprintf (stderr, "* ERROR: No coordinate files specified.\n");
+		return 1;
+	}
+
+	printf ("file,engine,pixels,mismatches,mismatch_pct,max_delta\n");
+	for (i = 1; i < argc; i++)
+		if (!test_file (argv[i]))
+			failed++;
+
+	if (failed > 0) {
+		fprintf (stderr, "%d of %d files failed.\n", failed, argc - 1);
+		return 1;
+	}
+	return 0;
+}
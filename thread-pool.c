@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "thread-pool.h"
+
+/* Initial number of tasks per deque, the deques grow as needed. */
+#define DEQUE_INITIAL_SIZE 64
+
+
+struct tp_task {
+	int args[THREAD_POOL_TASK_ARGS];
+};
+
+
+struct tp_deque {
+	GMutex *mutex;
+	struct tp_task *tasks;
+	/* The tasks in the deque are tasks[top] ... tasks[bottom - 1]. */
+	volatile unsigned top, bottom;
+	unsigned size;
+	/* Keep the deques of different workers on different cache lines. */
+	char pad[64];
+};
+
+
+struct thread_pool_job {
+	thread_pool_func_t func;
+	void *data;
+	unsigned nworkers;
+	struct tp_deque *deques;
+	unsigned next_deque; /* used by thread_pool_job_add() */
+	volatile gint pending; /* tasks pushed, but not finished yet */
+	volatile gint queued; /* tasks sitting in the deques */
+	volatile gint idle; /* workers waiting for tasks */
+	unsigned joined; /* protected by the pool mutex */
+	unsigned left; /* protected by mutex */
+	GMutex *mutex;
+	GCond *work_cond, *done_cond;
+};
+
+
+struct thread_pool {
+	GMutex *mutex;
+	GCond *cond;
+	GQueue *jobs; /* jobs which are still waiting for workers */
+	unsigned threads, idle_threads, wanted_threads;
+};
+
+
+static gpointer pool_init (gpointer data);
+static struct thread_pool *pool_get (void);
+static gpointer pool_thread_func (gpointer data);
+static void worker_loop (struct thread_pool_job *job, unsigned worker);
+static void deque_push (struct tp_deque *dq, int a0, int a1, int a2, int a3);
+static bool deque_pop (struct tp_deque *dq, struct tp_task *task);
+static bool deque_steal (struct tp_deque *dq, struct tp_task *task);
+static void job_push (struct thread_pool_job *job, unsigned deque, int a0, int a1, int a2, int a3);
+
+
+static struct thread_pool the_pool;
+static GOnce pool_once = G_ONCE_INIT;
+
+
+static gpointer
+pool_init (gpointer data)
+{
+	struct thread_pool *pool = (struct thread_pool *) data;
+	pool->mutex = g_mutex_new ();
+	pool->cond = g_cond_new ();
+	pool->jobs = g_queue_new ();
+	pool->threads = 0;
+	pool->idle_threads = 0;
+	pool->wanted_threads = 0;
+	return pool;
+}
+
+
+static struct thread_pool *
+pool_get (void)
+{
+	return (struct thread_pool *) g_once (&pool_once, pool_init, &the_pool);
+}
+
+
+static gpointer
+pool_thread_func (gpointer data)
+{
+	struct thread_pool *pool = (struct thread_pool *) data;
+	g_mutex_lock (pool->mutex);
+	while (true) {
+		while (g_queue_is_empty (pool->jobs))
+			g_cond_wait (pool->cond, pool->mutex);
+		struct thread_pool_job *job = g_queue_peek_head (pool->jobs);
+		unsigned worker = job->joined++;
+		if (job->joined == job->nworkers)
+			g_queue_pop_head (pool->jobs);
+		pool->idle_threads--;
+		pool->wanted_threads--;
+		g_mutex_unlock (pool->mutex);
+
+		worker_loop (job, worker);
+
+		/* The job may be freed as soon as the last worker has left. */
+		g_mutex_lock (job->mutex);
+		if (++job->left == job->nworkers)
+			g_cond_broadcast (job->done_cond);
+		g_mutex_unlock (job->mutex);
+
+		g_mutex_lock (pool->mutex);
+		pool->idle_threads++;
+	}
+	return NULL;
+}
+
+
+static void
+worker_loop (struct thread_pool_job *job, unsigned worker)
+{
+	struct tp_task task;
+	unsigned i;
+
+	while (true) {
+		bool found = deque_pop (&job->deques[worker], &task);
+		for (i = 1; !found && i < job->nworkers; i++)
+			found = deque_steal (&job->deques[(worker + i) % job->nworkers], &task);
+
+		if (found) {
+			g_atomic_int_add (&job->queued, -1);
+			job->func (job, worker, job->data, task.args);
+			if (g_atomic_int_dec_and_test (&job->pending)) {
+				/* That was the last one, wake up the idle workers so they can leave. */
+				g_mutex_lock (job->mutex);
+				g_cond_broadcast (job->work_cond);
+				g_mutex_unlock (job->mutex);
+			}
+			continue;
+		}
+
+		/*
+		 * Nothing to do right now, but tasks which are still running may
+		 * push new ones.
+		 */
+		g_mutex_lock (job->mutex);
+		g_atomic_int_inc (&job->idle);
+		while (g_atomic_int_get (&job->queued) == 0 && g_atomic_int_get (&job->pending) > 0)
+			g_cond_wait (job->work_cond, job->mutex);
+		g_atomic_int_add (&job->idle, -1);
+		bool done = g_atomic_int_get (&job->pending) == 0;
+		g_mutex_unlock (job->mutex);
+		if (done)
+			break;
+	}
+}
+
+
+static void
+deque_push (struct tp_deque *dq, int a0, int a1, int a2, int a3)
+{
+	g_mutex_lock (dq->mutex);
+	if (dq->bottom == dq->size) {
+		if (dq->top >= dq->size / 2) {
+			memmove (dq->tasks, dq->tasks + dq->top, (dq->bottom - dq->top) * sizeof (*dq->tasks));
+			dq->bottom -= dq->top;
+			dq->top = 0;
+		} else {
+			dq->size *= 2;
+			dq->tasks = realloc (dq->tasks, dq->size * sizeof (*dq->tasks));
+		}
+	}
+	struct tp_task *task = &dq->tasks[dq->bottom];
+	task->args[0] = a0;
+	task->args[1] = a1;
+	task->args[2] = a2;
+	task->args[3] = a3;
+	dq->bottom++;
+	g_mutex_unlock (dq->mutex);
+}
+
+
+/* Takes the most recently pushed task, this is for the owner of the deque. */
+static bool
+deque_pop (struct tp_deque *dq, struct tp_task *task)
+{
+	bool found = false;
+	if (dq->bottom == dq->top)
+		return false;
+	g_mutex_lock (dq->mutex);
+	if (dq->bottom > dq->top) {
+		*task = dq->tasks[--dq->bottom];
+		found = true;
+	}
+	if (dq->bottom == dq->top)
+		dq->bottom = dq->top = 0;
+	g_mutex_unlock (dq->mutex);
+	return found;
+}
+
+
+/*
+ * Takes the oldest task, this is for the other workers. With recursive
+ * subdivision, the oldest task is usually the largest one.
+ */
+static bool
+deque_steal (struct tp_deque *dq, struct tp_task *task)
+{
+	bool found = false;
+	/* Unlocked peek, so idle workers don't hammer the mutexes of empty deques. */
+	if (dq->bottom == dq->top)
+		return false;
+	g_mutex_lock (dq->mutex);
+	if (dq->bottom > dq->top) {
+		*task = dq->tasks[dq->top++];
+		found = true;
+	}
+	if (dq->bottom == dq->top)
+		dq->bottom = dq->top = 0;
+	g_mutex_unlock (dq->mutex);
+	return found;
+}
+
+
+static void
+job_push (struct thread_pool_job *job, unsigned deque, int a0, int a1, int a2, int a3)
+{
+	/* Increment pending first, so it can't drop to 0 while the task is queued. */
+	g_atomic_int_inc (&job->pending);
+	deque_push (&job->deques[deque], a0, a1, a2, a3);
+	g_atomic_int_inc (&job->queued);
+	if (g_atomic_int_get (&job->idle) > 0) {
+		g_mutex_lock (job->mutex);
+		g_cond_signal (job->work_cond);
+		g_mutex_unlock (job->mutex);
+	}
+}
+
+
+struct thread_pool_job *
+thread_pool_job_new (thread_pool_func_t func, void *data, unsigned nworkers)
+{
+	struct thread_pool_job *job = malloc (sizeof (*job));
+	unsigned i;
+
+	job->func = func;
+	job->data = data;
+	job->nworkers = nworkers;
+	job->deques = malloc (nworkers * sizeof (*job->deques));
+	for (i = 0; i < nworkers; i++) {
+		struct tp_deque *dq = &job->deques[i];
+		dq->mutex = g_mutex_new ();
+		dq->size = DEQUE_INITIAL_SIZE;
+		dq->tasks = malloc (dq->size * sizeof (*dq->tasks));
+		dq->top = 0;
+		dq->bottom = 0;
+	}
+	job->next_deque = 0;
+	job->pending = 0;
+	job->queued = 0;
+	job->idle = 0;
+	job->joined = 0;
+	job->left = 0;
+	job->mutex = g_mutex_new ();
+	job->work_cond = g_cond_new ();
+	job->done_cond = g_cond_new ();
+	return job;
+}
+
+
+/* Adds an initial task, before the job is started. */
+void
+thread_pool_job_add (struct thread_pool_job *job, int a0, int a1, int a2, int a3)
+{
+	job_push (job, job->next_deque, a0, a1, a2, a3);
+	job->next_deque = (job->next_deque + 1) % job->nworkers;
+}
+
+
+/* Adds a task from within a running task of the same job. */
+void
+thread_pool_push (struct thread_pool_job *job, unsigned worker, int a0, int a1, int a2, int a3)
+{
+	job_push (job, worker, a0, a1, a2, a3);
+}
+
+
+/* Starts the job in the background. */
+void
+thread_pool_job_start (struct thread_pool_job *job)
+{
+	struct thread_pool *pool = pool_get ();
+
+	g_mutex_lock (pool->mutex);
+	g_queue_push_tail (pool->jobs, job);
+	/*
+	 * Every worker of every queued job gets a thread of its own. This way,
+	 * workers which are blocked waiting for other jobs can't starve them.
+	 */
+	pool->wanted_threads += job->nworkers;
+	while (pool->idle_threads < pool->wanted_threads) {
+		GError *thread_err = NULL;
+		if (g_thread_create (pool_thread_func, pool, FALSE, &thread_err) == NULL) {
+			fprintf (stderr, "* ERROR: g_thread_create() error: %s\n", thread_err->message);
+			abort ();
+		}
+		pool->threads++;
+		pool->idle_threads++;
+	}
+	g_cond_broadcast (pool->cond);
+	g_mutex_unlock (pool->mutex);
+}
+
+
+/* Waits until the job has finished, and frees it. */
+void
+thread_pool_job_wait (struct thread_pool_job *job)
+{
+	unsigned i;
+
+	g_mutex_lock (job->mutex);
+	while (job->left < job->nworkers)
+		g_cond_wait (job->done_cond, job->mutex);
+	g_mutex_unlock (job->mutex);
+
+	for (i = 0; i < job->nworkers; i++) {
+		g_mutex_free (job->deques[i].mutex);
+		free (job->deques[i].tasks);
+	}
+	free (job->deques);
+	g_mutex_free (job->mutex);
+	g_cond_free (job->work_cond);
+	g_cond_free (job->done_cond);
+	free (job);
+}
+
+
+void
+thread_pool_job_run (struct thread_pool_job *job)
+{
+	thread_pool_job_start (job);
+	thread_pool_job_wait (job);
+}
@@ -0,0 +1,35 @@
+#ifndef _GTKMANDEL_THREAD_POOL_H
+#define _GTKMANDEL_THREAD_POOL_H
+
+#include <stdbool.h>
+
+#include <glib.h>
+
+/*
+ * A process-wide pool of persistent worker threads. Work is submitted as
+ * jobs: a job is executed by a fixed number of workers, each of which has
+ * its own deque of tasks. A worker takes tasks from the bottom of its own
+ * deque and, when that runs empty, steals tasks from the top of the other
+ * workers' deques. Tasks may push new tasks while they are running.
+ * A job is finished when all of its tasks are done.
+ *
+ * The pool grows as needed, so jobs may be started from within tasks of
+ * other jobs. Threads are never destroyed, they are reused by later jobs.
+ * g_thread_init() must have been called before the first job is started.
+ */
+
+#define THREAD_POOL_TASK_ARGS 4
+
+struct thread_pool_job;
+
+/* Executes one task, worker is the index of the executing worker. */
+typedef void (*thread_pool_func_t) (struct thread_pool_job *job, unsigned worker, void *data, const int *args);
+
+struct thread_pool_job *thread_pool_job_new (thread_pool_func_t func, void *data, unsigned nworkers);
+void thread_pool_job_add (struct thread_pool_job *job, int a0, int a1, int a2, int a3);
+void thread_pool_job_start (struct thread_pool_job *job);
+void thread_pool_job_wait (struct thread_pool_job *job);
+void thread_pool_job_run (struct thread_pool_job *job);
+void thread_pool_push (struct thread_pool_job *job, unsigned worker, int a0, int a1, int a2, int a3);
+
+#endif /* _GTKMANDEL_THREAD_POOL_H */
@@ -69,7 +69,7 @@ worker_thread (gpointer data)
 		char buf[256];
 		snprintf (buf, sizeof (buf), "file%06u.png", info->frame);
 		/* XXX much stuff hard-coded here */
-		render_to_png (&info->md, buf, 9, NULL, info->w, info->h, 1, info->aa_level);
+		render_to_png (&info->md, buf, 9, NULL, NULL, NULL, info->w, info->h, 1, info->aa_level);
 		mandeldata_clear (&info->md);
 
 		/*
@@ -13,6 +13,7 @@
 #include "file.h"
 #include "defs.h"
 #include "fractal-render.h"
+#include "fp-kernels.h"
 
 
 
@@ -46,6 +47,8 @@ parse_command_line (int *argc, char ***argv)
 	GOptionContext *context = g_option_context_new (NULL);
 	g_option_context_add_main_entries (context, option_entries, "fractlab-zoom");
 	g_option_context_add_group (context, anim_get_option_group ());
+	g_option_context_add_group (context, fp_kernel_get_option_group ());
+	g_option_context_add_group (context, fractal_math_get_option_group ());
 	if (!g_option_context_parse (context, argc, argv, &err)) {
 		fprintf (stderr, "* ERROR: %s\n", err->message);
 		return false;